@@ -0,0 +1,23 @@
+/* bench.h - services the benchmark needs from the host. They live in host.c, the only file built against the host
+   c library, because the kernel's types.h can not be mixed with libc headers.
+*/
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <types.h>
+
+/* work done by the stubbed paging layer */
+typedef struct bench_paging_t {
+    uint32_t map; // heap pages mapped
+    uint32_t unmap; // heap pages unmapped
+} bench_paging_t;
+
+extern bench_paging_t bench_paging;
+
+void bench_paging_reset(void);
+int32_t bench_map_arena(uint32_t addr, uint32_t size);
+uint64_t bench_now(void);
+void bench_sort(uint32_t* samples, uint32_t nr);
+
+#endif /* _BENCH_H */
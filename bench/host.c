@@ -0,0 +1,80 @@
+/* host.c - the part of the benchmark built against the host c library: the heap arena, the clock, sorting, and the
+   lib.h routines the kernel code expects. Prototypes match bench.h and lib.h with the host's own type names.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+/* bench_map_arena
+   description: back a fixed virtual range with zeroed memory, without clobbering anything already mapped there
+   input: addr - starting virtual address
+          size - size of the range in bytes
+   output: error message on failure
+   return value: 0 if success; -1 if the range is taken
+   side effect: none
+*/
+int bench_map_arena(unsigned int addr, unsigned int size) {
+    void* want = (void* )(unsigned long)addr;
+    void* got = mmap(want, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (got == want)
+        return 0;
+    if (got != MAP_FAILED) // old kernels take the address as a hint only
+        munmap(got, size);
+    fprintf(stderr, "membench: can not map heap arena at %#x\n", addr);
+    return -1;
+}
+
+
+/* bench_now
+   description: read the monotonic clock
+   input: none
+   output: none
+   return value: time in nanoseconds
+   side effect: none
+*/
+unsigned long long bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int cmp_sample(const void* a, const void* b) {
+    unsigned int x = *(const unsigned int* )a, y = *(const unsigned int* )b;
+    return (x > y) - (x < y);
+}
+
+
+/* bench_sort
+   description: sort latency samples in ascending order
+   input: samples - array of samples
+          nr - number of samples
+   output: none
+   return value: none
+   side effect: none
+*/
+void bench_sort(unsigned int* samples, unsigned int nr) {
+    qsort(samples, nr, sizeof(*samples), cmp_sample);
+}
+
+
+/* itoa
+   description: convert a number to a string, as the kernel's lib does
+   input: value - number to convert
+          buf - buffer receiving the string
+          radix - 10 or 16
+   output: none
+   return value: buf
+   side effect: none
+*/
+char* itoa(unsigned int value, char* buf, int radix) {
+    sprintf(buf, (radix == 16) ? "%X" : "%u", value);
+    return buf;
+}
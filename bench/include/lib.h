@@ -0,0 +1,23 @@
+/* lib.h - host stand-in for the kernel's lib.h, just enough for the heap and bitmap code to build as a linux
+   program. String routines go to the compiler builtins, which size their arguments correctly on 64-bit hosts as
+   well. There are no interrupts to mask in user space, so the critical section macros do nothing.
+*/
+
+#ifndef _LIB_H
+#define _LIB_H
+
+#include <types.h>
+
+#define memset(s, c, n) __builtin_memset((s), (c), (n))
+#define memcpy(dest, src, n) __builtin_memcpy((dest), (src), (n))
+#define memmove(dest, src, n) __builtin_memmove((dest), (src), (n))
+
+int32_t printf(int8_t* format, ...);
+int8_t* itoa(uint32_t value, int8_t* buf, int32_t radix);
+
+#define cli() do {} while (0)
+#define sti() do {} while (0)
+#define cli_and_save(flags) do { (flags) = 0; } while (0)
+#define restore_flags(flags) do { (void)(flags); } while (0)
+
+#endif /* _LIB_H */
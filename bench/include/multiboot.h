@@ -0,0 +1,34 @@
+/* multiboot.h - host stand-in for the kernel's multiboot.h, the two structures frame.c reads. The benchmark hands
+   frame_init a memory map it builds itself.
+*/
+
+#ifndef _MULTIBOOT_H
+#define _MULTIBOOT_H
+
+#include <types.h>
+
+/* multiboot information passed by the bootloader */
+typedef struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower;
+    uint32_t mem_upper;
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+} multiboot_info_t;
+
+/* an entry of the memory map; size does not count itself */
+typedef struct memory_map {
+    uint32_t size;
+    uint32_t base_addr_low;
+    uint32_t base_addr_high;
+    uint32_t length_low;
+    uint32_t length_high;
+    uint32_t type;
+} memory_map_t;
+
+#endif /* _MULTIBOOT_H */
@@ -0,0 +1,503 @@
+/* membench.c - host microbenchmark for the kernel heap (mem.c, slab.c) and bitmap.c. Randomized traces are replayed
+   against the real kernel code, with paging stubbed out over an anonymous arena at the heap's own virtual window.
+   Every trace starts from a freshly initialized heap and a fixed seed, so runs are reproducible; per trace it reports
+   throughput, latency percentiles and, for heap traces, the fragmentation index, peak heap pages and page mappings.
+
+   usage: membench [-n ops] [-s seed] [trace ...]
+*/
+
+#include <mem.h>
+#include <heapinfo.h>
+#include <bitmap.h>
+#include <frame.h>
+#include <multiboot.h>
+#include <lib.h>
+#include <types.h>
+#include "bench.h"
+
+#define DEFAULT_OPS 200000
+#define MAX_OPS 0x200000 // latency samples kept per trace
+#define MAX_SLOTS 4096 // live objects a heap trace can hold
+#define BENCH_RAM 0x8000000 // ram reported to the frame allocator, 128mb
+#define MBI_FLAG_MEM 0x1 // mem_upper is valid
+#define TIMER_PROBES 1000
+#define BITMAP_BITS 0x8000 // bits in the plain bitmap trace
+#define HBITMAP_BITS NUM_FRAMES // bits in the two-level bitmap trace, as many as frame.c tracks
+#define MAX_AREA 16 // largest run searched for in the bitmap trace
+#define GROW_BLOCKS 7 // half sized blocks taken per round of the grow trace
+#define GROW_SPREAD 16 // grow trace sizes fall this many bytes around the largest block
+#define MAX_BLOCK (MAX_HEAP_ENTRY * HEAP_PAGE_SIZE) // bytes in the largest buddy block
+#define PER_MILLE 1000
+
+typedef struct result_t {
+    uint32_t ops; // operations timed
+    uint64_t total; // nanoseconds spent in the code under test
+    uint32_t fails; // allocations that returned nothing
+    uint32_t errors; // corrupted objects and leaked objects
+    uint32_t frag; // fragmentation index at the end of the trace, in thousandths
+    uint32_t peak_pages; // most heap pages in use at once
+    uint32_t maps; // heap pages mapped by the paging layer
+} result_t;
+
+struct trace_t;
+typedef void (*trace_fn)(const struct trace_t* t, uint32_t nops, result_t* res);
+
+/* a randomized workload */
+typedef struct trace_t {
+    const int8_t* name;
+    trace_fn run;
+    uint32_t slots; // live objects juggled
+    uint32_t small_max; // sizes are 1..small_max bytes...
+    uint32_t large_max; // ...or small_max..large_max bytes
+    uint32_t large_pct; // percentage of sizes drawn from the large range
+    uint32_t realloc_pct; // percentage of operations on a live object that resize it instead of freeing it
+} trace_t;
+
+static void run_heap(const trace_t* t, uint32_t nops, result_t* res);
+static void run_grow(const trace_t* t, uint32_t nops, result_t* res);
+static void run_bitmap(const trace_t* t, uint32_t nops, result_t* res);
+static void run_hbitmap(const trace_t* t, uint32_t nops, result_t* res);
+
+static const trace_t traces[] = {
+    { "small", run_heap, 4096, 256, 256, 0, 0 }, // slab objects only
+    { "mixed", run_heap, 2048, 512, 16384, 20, 0 },
+    { "large", run_heap, 96, 4096, 262144, 100, 0 }, // buddy blocks only
+    { "realloc", run_heap, 1024, 2048, 65536, 10, 50 },
+    { "grow", run_grow, 0, 0, 0, 0, 0 }, // in place growth up to the largest block
+    { "bitmap", run_bitmap, 0, 0, 0, 0, 0 },
+    { "hbitmap", run_hbitmap, 0, 0, 0, 0, 0 }
+};
+
+#define NUM_TRACES (sizeof(traces) / sizeof(traces[0]))
+
+static uint32_t samples[MAX_OPS];
+static void* objs[MAX_SLOTS];
+static uint32_t sizes[MAX_SLOTS];
+static uint32_t bitmap_map[BITMAP_BITS / BITS_LONG];
+static uint32_t hbitmap_map[HBITMAP_BITS / BITS_LONG];
+static uint32_t hbitmap_summary[HBITMAP_SUMMARY_LONG(HBITMAP_BITS)];
+static uint32_t rand_state;
+static uint32_t timer_cost; // cost of one pair of clock reads, taken off every sample
+
+/* rand_next
+   description: xorshift32 pseudo random number generator, the same sequence on every host
+   input: none
+   output: none
+   return value: next pseudo random number
+   side effect: none
+*/
+static uint32_t rand_next(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+
+/* elapsed
+   description: time since a starting point, without the cost of reading the clock
+   input: start - value of bench_now at the starting point
+   output: none
+   return value: nanoseconds elapsed
+   side effect: none
+*/
+static uint32_t elapsed(uint64_t start) {
+    uint32_t ns = (uint32_t)(bench_now() - start);
+    return (ns > timer_cost) ? ns - timer_cost : 0;
+}
+
+
+/* timer_calibrate
+   description: measure the cheapest pair of clock reads
+   input: none
+   output: none
+   return value: none
+   side effect: set timer_cost
+*/
+static void timer_calibrate(void) {
+    uint32_t i, ns;
+    uint64_t start;
+    timer_cost = ~0U;
+    for (i = 0; i < TIMER_PROBES; i++) {
+        start = bench_now();
+        ns = (uint32_t)(bench_now() - start);
+        if (ns < timer_cost)
+            timer_cost = ns;
+    }
+}
+
+
+/* heap_reset
+   description: start over with an empty heap and a fresh frame allocator
+   input: none
+   output: none
+   return value: none
+   side effect: every object handed out before is gone
+*/
+static void heap_reset(void) {
+    multiboot_info_t mbi;
+    memset(&mbi, 0, sizeof(mbi));
+    mbi.flags = MBI_FLAG_MEM;
+    mbi.mem_upper = (BENCH_RAM - 0x100000) / 1024;
+    memset((void* )HEAP_VIRT_TOP, 0, HEAP_SIZE);
+    bench_paging_reset();
+    frame_init(&mbi);
+    heap_init();
+}
+
+
+/* trace_size
+   description: draw an allocation size for a heap trace
+   input: t - the trace
+   output: none
+   return value: size in bytes
+   side effect: none
+*/
+static uint32_t trace_size(const trace_t* t) {
+    if (rand_next() % 100 < t->large_pct)
+        return t->small_max + 1 + rand_next() % (t->large_max - t->small_max);
+    return 1 + rand_next() % t->small_max;
+}
+
+
+/* obj_fill
+   description: tag the first and last byte of an object with its slot
+   input: ptr - the object
+          size - size of the object
+          slot - slot holding the object
+   output: none
+   return value: none
+   side effect: none
+*/
+static void obj_fill(void* ptr, uint32_t size, uint32_t slot) {
+    ((uint8_t* )ptr)[0] = (uint8_t)slot;
+    ((uint8_t* )ptr)[size - 1] = (uint8_t)slot;
+}
+
+
+/* obj_check
+   description: check the tags of an object, up to a size
+   input: ptr - the object
+          size - number of bytes expected to be intact
+          slot - slot holding the object
+   output: none
+   return value: 0 if intact; 1 if corrupted
+   side effect: none
+*/
+static uint32_t obj_check(void* ptr, uint32_t size, uint32_t slot) {
+    return ((uint8_t* )ptr)[0] != (uint8_t)slot || ((uint8_t* )ptr)[size - 1] != (uint8_t)slot;
+}
+
+
+/* run_heap
+   description: replay a random mix of malloc, free and realloc over a set of slots, then free whatever is left
+   input: t - the trace
+          nops - number of operations
+   output: res - results of the trace
+   return value: none
+   side effect: none
+*/
+static void run_heap(const trace_t* t, uint32_t nops, result_t* res) {
+    uint32_t i, slot, size;
+    uint64_t start;
+    void* ptr;
+    heap_reset();
+    memset(objs, 0, sizeof(objs));
+
+    for (i = 0; i < nops; i++) {
+        slot = rand_next() % t->slots;
+        if (objs[slot] == NULL) {
+            size = trace_size(t);
+            start = bench_now();
+            ptr = malloc(size);
+            samples[i] = elapsed(start);
+        }
+        else if (rand_next() % 100 < t->realloc_pct) {
+            res->errors += obj_check(objs[slot], sizes[slot], slot);
+            size = trace_size(t);
+            start = bench_now();
+            ptr = realloc(objs[slot], size);
+            samples[i] = elapsed(start);
+            if (ptr != NULL)
+                res->errors += ((uint8_t* )ptr)[0] != (uint8_t)slot;
+        }
+        else {
+            res->errors += obj_check(objs[slot], sizes[slot], slot);
+            start = bench_now();
+            free(objs[slot]);
+            samples[i] = elapsed(start);
+            objs[slot] = NULL;
+            continue;
+        }
+        if (ptr == NULL) { // a failed realloc leaves the object as it was
+            res->fails++;
+            continue;
+        }
+        objs[slot] = ptr;
+        sizes[slot] = size;
+        obj_fill(ptr, size, slot);
+    }
+
+    res->ops = nops;
+    res->frag = heap_frag_index();
+    res->peak_pages = alloc_info.page_peak;
+    res->maps = bench_paging.map;
+    for (slot = 0; slot < t->slots; slot++) {
+        if (objs[slot] == NULL)
+            continue;
+        res->errors += obj_check(objs[slot], sizes[slot], slot);
+        free(objs[slot]);
+    }
+    res->errors += alloc_info.obj_alloc; // anything still counted has leaked
+}
+
+
+/* run_grow
+   description: grow a block in place up to and just past the largest buddy block. each round takes GROW_BLOCKS half
+                sized blocks and keeps only the lowest one that starts on a boundary of twice MAX_BLOCK, so every buddy it could
+                grow into is free, then reallocs it to a size around MAX_BLOCK. a size that does not fit the largest
+                block must fail rather than grow it beyond MAX_ORDER.
+   input: t - the trace
+          nops - number of operations
+   output: res - results of the trace
+   return value: none
+   side effect: none
+*/
+static void run_grow(const trace_t* t, uint32_t nops, result_t* res) {
+    uint32_t i, j, keep, size;
+    uint64_t start;
+    void* half[GROW_BLOCKS];
+    void* ptr;
+    heap_reset();
+
+    for (i = 0; i < nops; i++) {
+        keep = GROW_BLOCKS;
+        for (j = 0; j < GROW_BLOCKS; j++) {
+            half[j] = malloc(MAX_BLOCK / 2);
+            if (half[j] != NULL && ((uint32_t)half[j] - HEAP_VIRT_TOP) % (2 * MAX_BLOCK) == HEAP_HEADER_SIZE &&
+                (keep == GROW_BLOCKS || half[j] < half[keep]))
+                keep = j;
+        }
+        for (j = 0; j < GROW_BLOCKS; j++)
+            if (j != keep)
+                free(half[j]);
+        samples[i] = 0;
+        if (keep == GROW_BLOCKS) {
+            res->fails++;
+            continue;
+        }
+        size = MAX_BLOCK - HEAP_HEADER_SIZE - GROW_SPREAD / 2 + rand_next() % GROW_SPREAD;
+        start = bench_now();
+        ptr = realloc(half[keep], size);
+        samples[i] = elapsed(start);
+        if (ptr == NULL) {
+            res->fails++;
+            ptr = half[keep];
+        }
+        else
+            res->errors += size > MAX_BLOCK - HEAP_HEADER_SIZE;
+        res->errors += alloc_info.page_alloc > MAX_HEAP_ENTRY;
+        free(ptr);
+    }
+    res->ops = nops;
+    res->errors += alloc_info.obj_alloc; // anything still counted has leaked
+}
+
+
+/* run_bitmap
+   description: allocate and free runs of bits in a plain bitmap, searching with find_next_zero_area as the user mmap allocator does. frees fall partly on clear bits, so the map drifts towards full, where searching is slowest.
+   input: t - the trace
+          nops - number of operations
+   output: res - results of the trace
+   return value: none
+   side effect: none
+*/
+static void run_bitmap(const trace_t* t, uint32_t nops, result_t* res) {
+    uint32_t i, j, nr, pos;
+    uint64_t start;
+    bitmap_clear(bitmap_map, BITMAP_BITS);
+    for (i = 0; i < BITMAP_BITS / 2; i++)
+        bitmap_set_bit(bitmap_map, rand_next() % BITMAP_BITS);
+
+    for (i = 0; i < nops; i++) {
+        nr = 1 + rand_next() % MAX_AREA;
+        if (rand_next() & 1) {
+            start = bench_now();
+            pos = find_next_zero_area(bitmap_map, BITMAP_BITS, 0, nr);
+            for (j = pos; j < pos + nr && j < BITMAP_BITS; j++)
+                bitmap_set_bit(bitmap_map, j);
+            samples[i] = elapsed(start);
+            res->fails += pos >= BITMAP_BITS;
+        }
+        else {
+            pos = find_next_set_bit(bitmap_map, BITMAP_BITS, rand_next() % BITMAP_BITS);
+            start = bench_now();
+            for (j = pos; j < pos + nr && j < BITMAP_BITS; j++)
+                bitmap_clear_bit(bitmap_map, j);
+            samples[i] = elapsed(start);
+        }
+    }
+    res->ops = nops;
+}
+
+
+/* run_hbitmap
+   description: keep a two-level bitmap the size of the frame map mostly full while allocating and freeing single bits, as the frame allocator does
+   input: t - the trace
+          nops - number of operations
+   output: res - results of the trace
+   return value: none
+   side effect: none
+*/
+static void run_hbitmap(const trace_t* t, uint32_t nops, result_t* res) {
+    uint32_t i, bit;
+    uint64_t start;
+    hbitmap_t hb;
+    bitmap_clear(hbitmap_map, HBITMAP_BITS);
+    hbitmap_init(&hb, hbitmap_map, hbitmap_summary, HBITMAP_BITS);
+    for (i = 0; i < HBITMAP_BITS / 10 * 9; i++)
+        hbitmap_alloc_bit(&hb);
+
+    for (i = 0; i < nops; i++) {
+        if (rand_next() & 1) {
+            start = bench_now();
+            res->fails += hbitmap_alloc_bit(&hb) < 0;
+            samples[i] = elapsed(start);
+        }
+        else {
+            bit = find_next_set_bit(hbitmap_map, HBITMAP_BITS, rand_next() % HBITMAP_BITS);
+            if (bit >= HBITMAP_BITS)
+                bit = find_next_set_bit(hbitmap_map, HBITMAP_BITS, 0);
+            start = bench_now();
+            hbitmap_clear_bit(&hb, bit);
+            samples[i] = elapsed(start);
+        }
+    }
+    res->ops = nops;
+}
+
+
+/* percentile
+   description: pick a percentile out of sorted samples
+   input: nr - number of samples
+          per_mille - percentile in thousandths
+   output: none
+   return value: the sample at that percentile
+   side effect: none
+*/
+static uint32_t percentile(uint32_t nr, uint32_t per_mille) {
+    return samples[(uint32_t)((uint64_t)(nr - 1) * per_mille / PER_MILLE)];
+}
+
+
+/* report
+   description: print one line of results; latencies are in nanoseconds
+   input: t - the trace
+          res - results of the trace
+   output: a line on stdout
+   return value: none
+   side effect: sorts the samples
+*/
+static void report(const trace_t* t, result_t* res) {
+    uint32_t i;
+    for (i = 0; i < res->ops; i++)
+        res->total += samples[i];
+    bench_sort(samples, res->ops);
+    printf("%-8s %8u %10u %6u %6u %6u %7u %8u", t->name, res->ops,
+           res->total ? (uint32_t)((uint64_t)res->ops * 1000000000ULL / res->total) : 0,
+           percentile(res->ops, 500), percentile(res->ops, 900), percentile(res->ops, 990),
+           percentile(res->ops, 999), samples[res->ops - 1]);
+    if (t->run == run_heap)
+        printf(" %5u %6u %7u", res->frag, res->peak_pages, res->maps);
+    else
+        printf(" %5s %6s %7s", "-", "-", "-");
+    printf(" %6u %6u\n", res->fails, res->errors);
+}
+
+
+/* parse_uint
+   description: parse a decimal command line argument
+   input: s - the argument
+   output: none
+   return value: its value; 0 if it is not a number
+   side effect: none
+*/
+static uint32_t parse_uint(const int8_t* s) {
+    uint32_t value = 0;
+    for (; *s >= '0' && *s <= '9'; s++)
+        value = value * 10 + (*s - '0');
+    return (*s == '\0') ? value : 0;
+}
+
+
+/* str_eq
+   description: compare two strings
+   input: a, b - strings to compare
+   output: none
+   return value: 1 if equal; 0 if not
+   side effect: none
+*/
+static int32_t str_eq(const int8_t* a, const int8_t* b) {
+    while (*a != '\0' && *a == *b)
+        a++, b++;
+    return *a == *b;
+}
+
+
+/* find_trace
+   description: look up a trace by name
+   input: name - name of the trace
+   output: none
+   return value: index of the trace; NUM_TRACES if there is none
+   side effect: none
+*/
+static uint32_t find_trace(const int8_t* name) {
+    uint32_t i;
+    for (i = 0; i < NUM_TRACES && !str_eq(traces[i].name, name); i++);
+    return i;
+}
+
+
+int32_t main(int32_t argc, int8_t* argv[]) {
+    uint32_t i, nops = DEFAULT_OPS, seed = 1, errors = 0, usage = 0;
+    uint8_t selected[NUM_TRACES] = { 0 };
+    uint32_t num_selected = 0;
+    result_t res;
+
+    for (i = 1; i < argc; i++) {
+        if (str_eq(argv[i], "-n") && i + 1 < argc)
+            nops = parse_uint(argv[++i]);
+        else if (str_eq(argv[i], "-s") && i + 1 < argc)
+            seed = parse_uint(argv[++i]);
+        else if (find_trace(argv[i]) < NUM_TRACES) {
+            selected[find_trace(argv[i])] = 1;
+            num_selected++;
+        }
+        else
+            usage = 1;
+    }
+    if (usage || nops == 0 || nops > MAX_OPS || seed == 0) {
+        printf("usage: %s [-n ops] [-s seed] [trace ...]\n", argv[0]);
+        printf("ops is 1..%u, seed is nonzero; traces:", MAX_OPS);
+        for (i = 0; i < NUM_TRACES; i++)
+            printf(" %s", traces[i].name);
+        printf("\n");
+        return 2;
+    }
+    if (bench_map_arena(HEAP_VIRT_TOP, HEAP_SIZE) == -1)
+        return 1;
+    timer_calibrate();
+
+    printf("%-8s %8s %10s %6s %6s %6s %7s %8s %5s %6s %7s %6s %6s\n", "trace", "ops", "ops/s",
+           "p50", "p90", "p99", "p99.9", "max(ns)", "frag", "peak", "maps", "fails", "errors");
+    for (i = 0; i < NUM_TRACES; i++) {
+        if (num_selected && !selected[i])
+            continue;
+        memset(&res, 0, sizeof(res));
+        rand_state = seed;
+        traces[i].run(&traces[i], nops, &res);
+        report(&traces[i], &res);
+        errors += res.errors;
+    }
+    return errors ? 1 : 0;
+}
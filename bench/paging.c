@@ -0,0 +1,62 @@
+/* paging.c - stubbed heap paging for the host build. The heap window is backed by an anonymous mapping at its real
+   virtual address, so mapping a page only has to remember which frame it was given; frames are never touched.
+*/
+
+#include <paging.h>
+#include <system.h>
+#include <types.h>
+#include "bench.h"
+
+#define HEAP_PAGE_IDX(virt) (((virt) - HEAP_VIRT_TOP) / PAGE_SIZE)
+
+bench_paging_t bench_paging;
+static uint32_t heap_pte[HEAP_SIZE / PAGE_SIZE]; // frame and present bit of each heap page
+
+/* bench_paging_reset
+   description: unmap the whole heap window and clear the counters
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void bench_paging_reset(void) {
+    uint32_t i;
+    for (i = 0; i < HEAP_SIZE / PAGE_SIZE; i++)
+        heap_pte[i] = 0;
+    bench_paging.map = bench_paging.unmap = 0;
+}
+
+
+void set_virtual_4mb_heap(uint32_t virt_start) {
+}
+
+
+void set_virtual_4kb_heap(uint32_t phys_start, uint32_t virt_start) {
+    heap_pte[HEAP_PAGE_IDX(virt_start)] = (phys_start & 0xFFFFF000) | EN_P;
+    bench_paging.map++;
+}
+
+
+void free_virtual_4kb_heap(uint32_t virt_start) {
+    heap_pte[HEAP_PAGE_IDX(virt_start)] &= ~EN_P;
+    bench_paging.unmap++;
+}
+
+
+uint32_t heap_virt_to_phys(uint32_t virt_addr) {
+    uint32_t pte = heap_pte[HEAP_PAGE_IDX(virt_addr)];
+    if (!(pte & EN_P)) return 0;
+    return (pte & 0xFFFFF000) | (virt_addr & (PAGE_SIZE - 1));
+}
+
+
+void tlb_batch_begin(void) {
+}
+
+
+void tlb_batch_add(uint32_t virt_addr) {
+}
+
+
+void tlb_batch_flush(void) {
+}
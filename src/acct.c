@@ -0,0 +1,65 @@
+/* acct.c - per-process cpu accounting with the time stamp counter. interrupt, system call and exception entries call
+   acct_switch with the mode they enter, the common return path calls acct_exit, and the scheduler charges the
+   outgoing process before it changes cur_proc_pcb, so every cycle is counted once. each cpu keeps its own stamp and
+   mode, since the time stamp counters of two cpus are not in step.
+*/
+
+#include <acct.h>
+#include <types.h>
+#include <lib.h>
+#include <proc.h>
+#include <x86_desc.h>
+#include <smp.h>
+
+uint64_t idle_cycles; // declared in acct.h
+
+/* acct_charge
+   description: charge the cycles since the last accounting point to the current process, and stay in the same mode
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void acct_charge(void) {
+    uint32_t flags;
+    uint64_t now;
+    cpu_t* cpu;
+    cli_and_save(flags); // critical section begins
+    cpu = this_cpu();
+    now = rdtsc();
+    if (cpu->acct_mode == ACCT_IDLE)
+        idle_cycles += now - cpu->acct_stamp;
+    else if (cpu->cur_pcb != NULL)
+        cpu->cur_pcb->acct[cpu->acct_mode] += now - cpu->acct_stamp;
+    cpu->acct_stamp = now;
+    restore_flags(flags); // critical section ends
+}
+
+
+/* acct_switch
+   description: charge the cycles since the last accounting point, and go on in the given mode
+   input: mode - mode from now on
+   output: none
+   return value: none
+   side effect: none
+*/
+void acct_switch(uint8_t mode) {
+    uint32_t flags;
+    cli_and_save(flags); // critical section begins
+    acct_charge();
+    this_cpu()->acct_mode = mode;
+    restore_flags(flags); // critical section ends
+}
+
+
+/* acct_exit
+   description: accounting point on the way out of the kernel
+   input: regs - registers about to be restored
+   output: none
+   return value: none
+   side effect: none
+*/
+__attribute__((fastcall))
+void acct_exit(struct regs* regs) {
+    acct_switch((regs->xcs == USER_CS) ? ACCT_USER : ACCT_SYS);
+}
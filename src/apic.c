@@ -0,0 +1,120 @@
+/* apic.c - Functions to interact with the local APIC of each cpu and the I/O APIC. Device interrupts still come from
+   the 8259 pair: the boot cpu takes them through LINT0 in virtual wire mode, and every I/O APIC input stays masked.
+   The local APICs are used to start the other cpus and to send them interprocessor interrupts.
+   external source: http://wiki.osdev.org/APIC, http://wiki.osdev.org/IOAPIC
+*/
+
+#include <apic.h>
+#include <types.h>
+#include <lib.h>
+#include <paging.h>
+#include <idt.h>
+
+volatile uint32_t* lapic; // declared in apic.h
+
+/* rdmsr
+   description: read a model specific register
+   input: msr - register number
+   output: none
+   return value: low 32 bits of the register
+   side effect: none
+*/
+static inline uint32_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile ("rdmsr\n" : "=a" (lo), "=d" (hi) : "c" (msr));
+    return lo;
+}
+
+
+/* apic_detect
+   description: find the local APIC of the boot cpu and map the APIC registers, uncached and for the kernel only
+   input: none
+   output: none
+   return value: 0 if the cpu has a local APIC; -1 otherwise
+   side effect: modifies the page directory
+*/
+int32_t apic_detect(void) {
+    uint32_t eax, ebx, ecx, edx, base;
+    asm volatile ("cpuid\n" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    if (!(edx & CPUID_APIC))
+        return -1;
+    base = rdmsr(MSR_APIC_BASE);
+    if (!(base & MSR_APIC_BASE_EN))
+        return -1;
+    base &= 0xFFFFF000;
+    if ((base & 0xFFC00000) != APIC_MMIO_BASE) // relocated out of the page we map
+        return -1;
+    map_mmio_4mb(APIC_MMIO_BASE);
+    lapic = (volatile uint32_t* )base;
+    return 0;
+}
+
+
+/* lapic_init
+   description: enable the local APIC of the running cpu. the boot cpu keeps taking 8259 interrupts through LINT0; the other cpus leave LINT0 masked, so device interrupts only ever reach the boot cpu.
+   input: is_bsp - nonzero on the boot cpu
+   output: none
+   return value: none
+   side effect: none
+*/
+void lapic_init(int32_t is_bsp) {
+    lapic_write(LAPIC_SVR, LAPIC_SVR_EN | SPURIOUS_ENTRY);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASK);
+    lapic_write(LAPIC_LVT_LINT0, is_bsp ? LAPIC_DM_EXTINT : LAPIC_LVT_MASK);
+    lapic_write(LAPIC_LVT_LINT1, is_bsp ? LAPIC_DM_NMI : LAPIC_LVT_MASK);
+    lapic_write(LAPIC_LVT_ERR, LAPIC_LVT_MASK);
+    lapic_write(LAPIC_ESR, 0); // the error status register wants two writes to clear
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_EOI, 0); // drop anything left in service
+    lapic_write(LAPIC_TPR, 0); // accept every interrupt
+}
+
+
+/* lapic_eoi
+   description: signal the end of an interrupt delivered by the local APIC
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+
+/* lapic_send_ipi
+   description: send an interprocessor interrupt and wait until the local APIC has delivered it
+   input: apic_id - APIC id of the target cpu
+          icr - delivery mode, level and vector
+   output: none
+   return value: none
+   side effect: none
+*/
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr) {
+    lapic_write(LAPIC_ICR_HI, apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, icr);
+    while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING);
+}
+
+
+/* ioapic_init
+   description: mask every input of an I/O APIC; devices keep interrupting through the 8259 pair
+   input: addr - physical address of the I/O APIC registers, inside the page apic_detect maps
+   output: none
+   return value: none
+   side effect: none
+*/
+void ioapic_init(uint32_t addr) {
+    volatile uint32_t* ioapic = (volatile uint32_t* )addr;
+    uint32_t i, max_red;
+    if ((addr & 0xFFC00000) != APIC_MMIO_BASE)
+        return;
+    ioapic[IOAPIC_REGSEL >> 2] = IOAPIC_REG_VER;
+    max_red = (ioapic[IOAPIC_WIN >> 2] >> 16) & 0xFF;
+    for (i = 0; i <= max_red; i++) {
+        ioapic[IOAPIC_REGSEL >> 2] = IOAPIC_REG_REDTBL + 2 * i;
+        ioapic[IOAPIC_WIN >> 2] = IOAPIC_RED_MASK;
+        ioapic[IOAPIC_REGSEL >> 2] = IOAPIC_REG_REDTBL + 2 * i + 1;
+        ioapic[IOAPIC_WIN >> 2] = 0;
+    }
+}
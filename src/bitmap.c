@@ -9,6 +9,7 @@
 #include <lib.h>
 #include <types.h>
 #include <system.h>
+#include <bitops.h>
 
 /* bitmap_set_bit
    description: set a bit in the bitmap
@@ -196,11 +197,22 @@ done:
 */
 int find_free_region(uint32_t* bitmap, uint32_t num_bits, uint32_t order) {
     uint32_t pos = 0;
+    if (order == 0) { // single bit, no alignment to honor
+        pos = find_first_zero_bit(bitmap, num_bits);
+        if (pos >= num_bits)
+            return -ENOMEM;
+        bitmap_set_bit(bitmap, pos);
+        return (int) pos;
+    }
     for (; pos < num_bits; pos += (1 << order)) {
+        if (order < BITS_LONG_SHIFT && !(~bitmap[entry_offset(pos)])) { // a full entry cannot hold a smaller region, skip it
+            pos = (entry_offset(pos) + 1) * BITS_LONG - (1 << order);
+            continue;
+        }
         if (_reg_op(bitmap, pos, order, REG_OP_ISFREE))
             break;
     }
-    if (pos == num_bits) // if no such contiguous region can be found
+    if (pos >= num_bits) // if no such contiguous region can be found
         return -ENOMEM;
     _reg_op(bitmap, pos, order, REG_OP_ALLOC);
     return (int) pos;
@@ -236,3 +248,214 @@ int allocate_region(uint32_t* bitmap, uint32_t pos, uint32_t order) {
     _reg_op(bitmap, pos, order, REG_OP_ALLOC);
     return 0;
 }
+
+
+/* find_next_zero_bit
+   description: find the next cleared bit in a bitmap, one entry at a time
+   input: bitmap - pointer to the bitmap
+          num_bits - number of bits in the bitmap
+          start - bit index to start searching at
+   output: none
+   return value: index of the first cleared bit at or after start; num_bits if there is none
+   side effect: none
+*/
+uint32_t find_next_zero_bit(const uint32_t* bitmap, uint32_t num_bits, uint32_t start) {
+    uint32_t idx, limit = BITS_TO_LONG(num_bits);
+    uint32_t word;
+    if (start >= num_bits)
+        return num_bits;
+    idx = entry_offset(start);
+    word = ~bitmap[idx] & (~0UL << BIT_OFFSET(start)); // ignore bits below start
+    while (!word) {
+        if (++idx >= limit)
+            return num_bits;
+        word = ~bitmap[idx];
+    }
+    start = idx * BITS_LONG + ffs(word) - 1;
+    return (start < num_bits) ? start : num_bits;
+}
+
+
+/* find_next_set_bit
+   description: find the next set bit in a bitmap, one entry at a time
+   input: bitmap - pointer to the bitmap
+          num_bits - number of bits in the bitmap
+          start - bit index to start searching at
+   output: none
+   return value: index of the first set bit at or after start; num_bits if there is none
+   side effect: none
+*/
+uint32_t find_next_set_bit(const uint32_t* bitmap, uint32_t num_bits, uint32_t start) {
+    uint32_t idx, limit = BITS_TO_LONG(num_bits);
+    uint32_t word;
+    if (start >= num_bits)
+        return num_bits;
+    idx = entry_offset(start);
+    word = bitmap[idx] & (~0UL << BIT_OFFSET(start)); // ignore bits below start
+    while (!word) {
+        if (++idx >= limit)
+            return num_bits;
+        word = bitmap[idx];
+    }
+    start = idx * BITS_LONG + ffs(word) - 1;
+    return (start < num_bits) ? start : num_bits;
+}
+
+
+/* find_next_zero_area
+   description: find a run of contiguous cleared bits. the run does not need to be aligned.
+   input: bitmap - pointer to the bitmap
+          num_bits - number of bits in the bitmap
+          start - bit index to start searching at
+          nr - number of cleared bits requested
+   output: none
+   return value: index of the first bit of the run; num_bits if no run is long enough
+   side effect: none
+*/
+uint32_t find_next_zero_area(const uint32_t* bitmap, uint32_t num_bits, uint32_t start, uint32_t nr) {
+    uint32_t end, set;
+    while (1) {
+        start = find_next_zero_bit(bitmap, num_bits, start);
+        end = start + nr;
+        if (end > num_bits || end < start) // run would not fit
+            return num_bits;
+        set = find_next_set_bit(bitmap, end, start);
+        if (set >= end) // no set bit inside the run
+            return start;
+        start = set + 1; // restart past the obstacle
+    }
+}
+
+
+/* hbitmap_entry_full
+   description: check if an entry of the underlying bitmap has no cleared bit. bits past num_bits in the last entry count as set.
+   input: hb - pointer to the two-level bitmap
+          idx - entry index
+   output: none
+   return value: 1 if full, 0 if not
+   side effect: none
+*/
+static int hbitmap_entry_full(const hbitmap_t* hb, uint32_t idx) {
+    uint32_t word = hb->map[idx];
+    if (idx == entry_offset(hb->num_bits - 1))
+        word |= ~BITMAP_LAST_ENTRY_MASK(hb->num_bits);
+    return !(~word);
+}
+
+
+/* hbitmap_init
+   description: set up a two-level bitmap over an existing bitmap and build its summary level
+   input: hb - pointer to the two-level bitmap
+          map - underlying bitmap, holding num_bits bits
+          summary - summary bitmap, holding one bit per entry of map
+          num_bits - number of bits in map
+   output: none
+   return value: none
+   side effect: modify summary
+*/
+void hbitmap_init(hbitmap_t* hb, uint32_t* map, uint32_t* summary, uint32_t num_bits) {
+    uint32_t i, entries = BITS_TO_LONG(num_bits);
+    hb->map = map;
+    hb->summary = summary;
+    hb->num_bits = num_bits;
+    bitmap_clear(summary, entries);
+    for (i = 0; i < entries; i++) {
+        if (hbitmap_entry_full(hb, i))
+            bitmap_set_bit(summary, i);
+    }
+}
+
+
+/* hbitmap_set_bit
+   description: set a bit in a two-level bitmap, updating the summary
+   input: hb - pointer to the two-level bitmap
+          bit - bit index to set
+   output: none
+   return value: none
+   side effect: modify bitmap
+*/
+void hbitmap_set_bit(hbitmap_t* hb, uint32_t bit) {
+    bitmap_set_bit(hb->map, bit);
+    if (hbitmap_entry_full(hb, entry_offset(bit)))
+        bitmap_set_bit(hb->summary, entry_offset(bit));
+}
+
+
+/* hbitmap_clear_bit
+   description: clear a bit in a two-level bitmap, updating the summary
+   input: hb - pointer to the two-level bitmap
+          bit - bit index to clear
+   output: none
+   return value: none
+   side effect: modify bitmap
+*/
+void hbitmap_clear_bit(hbitmap_t* hb, uint32_t bit) {
+    bitmap_clear_bit(hb->map, bit);
+    bitmap_clear_bit(hb->summary, entry_offset(bit));
+}
+
+
+/* hbitmap_find_next_zero
+   description: find the next cleared bit. full entries are skipped 32 at a time through the summary level.
+   input: hb - pointer to the two-level bitmap
+          start - bit index to start searching at
+   output: none
+   return value: index of the first cleared bit at or after start; num_bits if there is none
+   side effect: none
+*/
+uint32_t hbitmap_find_next_zero(const hbitmap_t* hb, uint32_t start) {
+    uint32_t entries = BITS_TO_LONG(hb->num_bits);
+    uint32_t idx, bit;
+    while (start < hb->num_bits) {
+        idx = find_next_zero_bit(hb->summary, entries, entry_offset(start)); // first entry with room
+        if (idx >= entries)
+            return hb->num_bits;
+        if (idx > entry_offset(start))
+            start = idx * BITS_LONG;
+        bit = find_next_zero_bit(hb->map, hb->num_bits, start);
+        if (entry_offset(bit) == idx || bit >= hb->num_bits)
+            return bit;
+        start = (idx + 1) * BITS_LONG; // zero was only below start in this entry
+    }
+    return hb->num_bits;
+}
+
+
+/* hbitmap_alloc_bit
+   description: find the first cleared bit of a two-level bitmap and set it
+   input: hb - pointer to the two-level bitmap
+   output: none
+   return value: bit index if success; -ENOMEM if bitmap is full
+   side effect: modify bitmap
+*/
+int hbitmap_alloc_bit(hbitmap_t* hb) {
+    uint32_t bit = hbitmap_find_next_zero(hb, 0);
+    if (bit >= hb->num_bits)
+        return -ENOMEM;
+    hbitmap_set_bit(hb, bit);
+    return (int) bit;
+}
+
+
+/* hbitmap_find_zero_area
+   description: find a run of contiguous cleared bits in a two-level bitmap
+   input: hb - pointer to the two-level bitmap
+          start - bit index to start searching at
+          nr - number of cleared bits requested
+   output: none
+   return value: index of the first bit of the run; num_bits if no run is long enough
+   side effect: none
+*/
+uint32_t hbitmap_find_zero_area(const hbitmap_t* hb, uint32_t start, uint32_t nr) {
+    uint32_t end, set;
+    while (1) {
+        start = hbitmap_find_next_zero(hb, start);
+        end = start + nr;
+        if (end > hb->num_bits || end < start) // run would not fit
+            return hb->num_bits;
+        set = find_next_set_bit(hb->map, end, start);
+        if (set >= end) // no set bit inside the run
+            return start;
+        start = set + 1; // restart past the obstacle
+    }
+}
@@ -0,0 +1,236 @@
+/* clock.c - ktime_get counts nanoseconds since boot from the time stamp counter, calibrated against the pit. once the
+   local APIC timer is calibrated too, it replaces the pit interrupt as the clock tick: it is armed one-shot for the
+   next millisecond while a process runs, and for the next pending timer while the cpu idles, so an idle cpu is not
+   woken up a thousand times a second for nothing. system_time.count_ms and the timer wheel still advance in whole
+   milliseconds; a late tick catches up on every millisecond it missed.
+   external source: http://wiki.osdev.org/APIC_timer, http://wiki.osdev.org/TSC
+*/
+
+#include <clock.h>
+#include <types.h>
+#include <lib.h>
+#include <apic.h>
+#include <acct.h>
+#include <time.h>
+#include <pit.h>
+#include <i8259.h>
+#include <idt.h>
+#include <sched.h>
+#include <smp.h>
+#include <spinlock.h>
+
+uint32_t tsc_khz; // declared in clock.h
+static uint32_t tsc_mult; // nanoseconds per tsc cycle, with TSC_SHIFT fraction bits
+static uint64_t tsc_base; // tsc when ktime was base_ns
+static uint64_t base_ns;
+static uint32_t lapic_mult; // local APIC timer counts per nanosecond, with LAPIC_SHIFT fraction bits
+static uint32_t clock_tickless; // the local APIC timer drives the clock tick instead of the pit
+static uint32_t clock_idle; // the cpu is halted with nothing to run
+static uint64_t next_tick; // ktime at which system_time.count_ms goes up next
+static uint32_t ap_tick; // local APIC timer counts in one millisecond, the tick of an AP
+static uint64_t ktime_last; // latest time ktime_get returned on any cpu
+static DEFINE_SPINLOCK(ktime_lock); // guards ktime_last
+
+/* cyc2ns
+   description: convert tsc cycles to nanoseconds. the cycles are split in halves so no product overflows 64 bits
+   input: cyc - number of cycles
+   output: none
+   return value: nanoseconds
+   side effect: none
+*/
+static uint64_t cyc2ns(uint64_t cyc) {
+    uint32_t hi = (uint32_t)(cyc >> 32), lo = (uint32_t)cyc;
+    return (((uint64_t)hi * tsc_mult) << (32 - TSC_SHIFT)) + (((uint64_t)lo * tsc_mult) >> TSC_SHIFT);
+}
+
+
+/* ktime_get
+   description: get the time since boot. the time stamp counter of an AP is first moved onto the boot processor's by
+                the offset measured when it came online, and a time earlier than one already returned, which what is
+                left of that offset can give, is raised to it, so the clock never goes back from one cpu to another
+   input: none
+   output: none
+   return value: time in nanoseconds; in whole milliseconds if the tsc is not calibrated
+   side effect: none
+*/
+uint64_t ktime_get(void) {
+    uint32_t flags;
+    uint64_t ns;
+    if (tsc_khz == 0)
+        return (uint64_t)system_time.count_ms * NSEC_PER_MSEC;
+    spin_lock_irqsave(&ktime_lock, flags); // the counter and the offset have to be read on the same cpu
+    ns = base_ns + cyc2ns(rdtsc() + this_cpu()->tsc_offset - tsc_base);
+    if (ns < ktime_last)
+        ns = ktime_last;
+    ktime_last = ns;
+    spin_unlock_irqrestore(&ktime_lock, flags);
+    return ns;
+}
+
+
+/* ktime_to_timespec
+   description: split a time in nanoseconds into seconds and nanoseconds
+   input: ns - time in nanoseconds
+          ts - receives the time
+   output: none
+   return value: none
+   side effect: none
+*/
+void ktime_to_timespec(uint64_t ns, timespec_t* ts) {
+    uint32_t rem;
+    ts->tv_sec = (uint32_t)div_u64_rem(ns, NSEC_PER_SEC, &rem);
+    ts->tv_nsec = rem;
+}
+
+
+/* clock_program
+   description: arm the local APIC timer for the next clock tick, or, on an idle cpu, for the tick the next timer is due
+   input: now - current ktime
+   output: none
+   return value: none
+   side effect: none
+*/
+static void clock_program(uint64_t now) {
+    uint64_t deadline = next_tick;
+    uint32_t ms, count = 0;
+    if (clock_idle && (ms = timer_next()) > 1)
+        deadline += (uint64_t)(ms - 1) * NSEC_PER_MSEC;
+    if (deadline > now)
+        count = (uint32_t)(((deadline - now) * lapic_mult) >> LAPIC_SHIFT);
+    lapic_write(LAPIC_TIMER_ICR, (count != 0) ? count : 1); // a zero count would stop the timer
+}
+
+
+/* clock_handler
+   description: local APIC timer interrupt. counts every millisecond that has passed, firing the timers due in each, charges the running process for the tick, and arms the next one. on an AP it only charges the running process, and arms the next tick unless the cpu idles, see clock_ap_init.
+   input: none
+   output: none
+   return value: none
+   side effect: may switch to another process and not return
+*/
+void clock_handler(void) {
+    uint64_t now;
+    uint32_t ticked = 0;
+    if (smp_cpu_id() != 0) { // an AP only keeps its scheduler going; the boot cpu keeps time
+        if (!this_cpu()->idle) // an idle AP waits for smp_kick, which comes in through here too
+            lapic_write(LAPIC_TIMER_ICR, ap_tick);
+#ifndef RUN_TESTS
+        sched_tick();
+#endif
+        return;
+    }
+    now = ktime_get();
+    while (now >= next_tick) {
+        system_time.count_ms++;
+        run_timers();
+        next_tick += NSEC_PER_MSEC;
+        ticked = 1;
+    }
+    clock_program(now);
+#ifndef RUN_TESTS
+    if (ticked)
+        sched_tick();
+#endif
+}
+
+
+/* clock_idle_enter
+   description: stop the periodic tick before the cpu halts; it is woken by the next timer or by any other interrupt. an AP runs no timers, so its tick stops altogether until smp_kick wakes it.
+   input: none
+   output: none
+   return value: none
+   side effect: must be called with interrupts off
+*/
+void clock_idle_enter(void) {
+    if (!clock_tickless) return;
+    if (smp_cpu_id() != 0) {
+        lapic_write(LAPIC_TIMER_ICR, 0); // a zero count stops the timer
+        return;
+    }
+    clock_idle = 1;
+    clock_program(ktime_get());
+}
+
+
+/* clock_idle_exit
+   description: restart the periodic tick after the cpu wakes up. if a tick is already overdue, it fires right away and catches up
+   input: none
+   output: none
+   return value: none
+   side effect: must be called with interrupts off
+*/
+void clock_idle_exit(void) {
+    if (!clock_tickless) return;
+    if (smp_cpu_id() != 0) {
+        lapic_write(LAPIC_TIMER_ICR, ap_tick);
+        return;
+    }
+    clock_idle = 0;
+    clock_program(ktime_get());
+}
+
+
+/* clock_init
+   description: measure the tsc and the local APIC timer against the same pit interval, then let the local APIC timer take over the clock tick from the pit. the pit keeps counting, pit_udelay still polls it.
+   input: none
+   output: none
+   return value: none
+   side effect: masks the pit irq if the local APIC timer works
+*/
+void clock_init(void) {
+    unsigned long flags;
+    uint64_t start, cycles;
+    uint32_t counts = 0, rem;
+    cli_and_save(flags); // critical section begins
+    if (lapic != NULL) {
+        lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV16);
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASK | LAPIC_TIMER_ENTRY); // one-shot
+        lapic_write(LAPIC_TIMER_ICR, 0xFFFFFFFF);
+    }
+    start = rdtsc();
+    pit_udelay(CLOCK_CALIBRATE_US);
+    cycles = rdtsc() - start;
+    if (lapic != NULL) {
+        counts = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CCR);
+        lapic_write(LAPIC_TIMER_ICR, 0);
+    }
+
+    /* tsc_mult only fits 32 bits above 1 mhz */
+    tsc_khz = (uint32_t)div_u64_rem(cycles, CLOCK_CALIBRATE_US / 1000, &rem);
+    if (tsc_khz < 1000)
+        tsc_khz = 0;
+    else
+        tsc_mult = (uint32_t)div_u64_rem((uint64_t)NSEC_PER_MSEC << TSC_SHIFT, tsc_khz, &rem);
+    base_ns = (uint64_t)system_time.count_ms * NSEC_PER_MSEC;
+    tsc_base = rdtsc();
+
+    lapic_mult = (uint32_t)div_u64_rem((uint64_t)counts << LAPIC_SHIFT, CLOCK_CALIBRATE_US * NSEC_PER_USEC, &rem);
+    if (tsc_khz != 0 && lapic_mult != 0) {
+        next_tick = base_ns + NSEC_PER_MSEC;
+        lapic_timer_set_idt();
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_ENTRY);
+        disable_irq(PIT_IRQ_PIN);
+        clock_tickless = 1;
+        clock_program(base_ns);
+    }
+    restore_flags(flags); // critical section ends
+}
+
+
+/* clock_ap_init
+   description: start the local APIC timer of an application processor as a tick of one millisecond, counted with the
+                rate the boot cpu calibrated, since all local APIC timers run off the same bus clock. it is one-shot and
+                rearmed by clock_handler, so it stops while the cpu idles
+   input: none
+   output: none
+   return value: 0 if the timer ticks; -1 if the boot cpu does not use its local APIC timer either
+   side effect: none
+*/
+int32_t clock_ap_init(void) {
+    if (!clock_tickless) return -1;
+    lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_ENTRY); // one-shot
+    ap_tick = (uint32_t)(((uint64_t)NSEC_PER_MSEC * lapic_mult) >> LAPIC_SHIFT);
+    lapic_write(LAPIC_TIMER_ICR, ap_tick);
+    return 0;
+}
@@ -10,8 +10,10 @@
 #include <signal.h>
 #include <exception.h>
 #include <proc.h>
+#include <vm.h>
+#include <acct.h>
+#include <fpu.h>
 
-pcb_t * cur_proc_pcb; // declared in proc.h
 
 /// This jump table stores pointers to exception handlers.
 uint32_t exp_table [EXP_TABLE_SIZE];
@@ -22,6 +24,21 @@ void do_exp(struct regs *regs/*, int8_t * msg*/) {
     // printf(fault_msg, regs->orig_eax, msg);
     // info_printk();
 
+    acct_switch(ACCT_SYS);
+    uint32_t expno = regs->orig_eax & EXP_NUM_MASK;
+    uint32_t err_code = regs->orig_eax >> EXP_ERRCODE_SHIFT;
+    regs->orig_eax = expno; // later consumers only expect the exception number
+
+    /* the current process wants the fpu, which holds another process's state */
+    if (expno == EXP_DEVICE_NA) {
+        do_fpu_trap();
+        return;
+    }
+
+    /* a page fault on a not yet loaded user page is resolved here and the instruction restarted */
+    if (expno == EXP_PAGE_FAULT && vm_handle_fault(read_cr2(), err_code) == 0)
+        return;
+
     /* request a pending signal based on its exception number */
     if (regs->orig_eax == DIV_ZERO)
         request_signal(DIV_ZERO, cur_proc_pcb);
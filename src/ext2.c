@@ -10,8 +10,11 @@
 #include <lib.h>
 #include <bitmap.h>
 #include <mem.h>
+#include <spinlock.h>
 
 #define EXT2_SUPER_LBA  0x3F
+#define EXT2_BLOCK_SIZE 1024
+#define EXT2_MAP_BITS   (EXT2_BLOCK_SIZE * 8)
 
 #define ext2_sb \
     ((ext2_super_t *)(superblock.priv_data))
@@ -42,6 +45,10 @@ static int32_t file_fclose(file_t * self);
 static int32_t file_fseek(file_t * self, int32_t offset, int32_t whence);
 static int32_t file_getkey(file_t * self, uint8_t * key);
 static int32_t file_setkey(file_t * self, uint8_t * key);
+static int32_t file_freadv(file_t * self, const iovec_t * iov, uint32_t iovcnt);
+static int32_t file_fwritev(file_t * self, const iovec_t * iov, uint32_t iovcnt);
+static int32_t file_fpread(file_t * self, void * buf, uint32_t nbytes, uint32_t offset);
+static int32_t file_fpwrite(file_t * self, const void * buf, uint32_t nbytes, uint32_t offset);
 
 /// File operations for directories
 static int32_t dir_fread(file_t * self, void * buf, uint32_t nbytes);
@@ -64,7 +71,11 @@ static file_op_t ext2_file_fops = {
     .close = file_fclose,
     .seek = file_fseek,
     .getkey = file_getkey,
-    .setkey = file_setkey
+    .setkey = file_setkey,
+    .readv = file_freadv,
+    .writev = file_fwritev,
+    .pread = file_fpread,
+    .pwrite = file_fpwrite
 };
 
 static file_op_t ext2_dir_fops = {
@@ -91,6 +102,22 @@ static inode_op_t ext2_iops = {
 static ext2_inode_t cur_ext2_dir;
 static ext2_super_t ext2_super;
 
+/// In-memory copies of the block group's inode and block bitmaps.
+/// Searches run against these; every change is written through to disk.
+static uint32_t ino_map [EXT2_MAP_BITS / BITS_LONG];
+static uint32_t ino_summary [HBITMAP_SUMMARY_LONG(EXT2_MAP_BITS)];
+static uint32_t blk_map [EXT2_MAP_BITS / BITS_LONG];
+static uint32_t blk_summary [HBITMAP_SUMMARY_LONG(EXT2_MAP_BITS)];
+static hbitmap_t ino_hbitmap;
+static hbitmap_t blk_hbitmap;
+static uint32_t ino_map_blkno;
+static uint32_t blk_map_blkno;
+
+/// Guards both cached bitmaps. Only the bitmap update is done under it; the
+/// bitmap block is written out afterwards, and whichever write comes last
+/// carries every update made before it.
+static DEFINE_SPINLOCK(ext2_map_lock);
+
 /// --- EXT2 interface --- ///
 
 file_op_t * ext2_file_fop = &ext2_file_fops;
@@ -284,6 +311,39 @@ int32_t ext2_read_indirect(const ext2_inode_t *, uint32_t, void *, uint32_t);
 ///
 static int32_t ext2_write_direct(const ext2_inode_t *, uint32_t, const void *, uint32_t);
 
+///
+/// Reads or writes file data at given offset to or from a vector of buffers.
+/// Each data block is read from disk at most once, and written at most once,
+/// however many buffers it spans; a block a write covers entirely is not read.
+/// Reads stop at end of file. Writes must stay within the direct blocks, and
+/// the inode must already be large enough.
+///
+/// - arguments
+///     rw: 0 to read, 1 to write.
+///     inode: EXT2 inode of the file.
+///     offset: Offset in the file to start at.
+///     iov: Buffers, filled or drained in order.
+///     iovcnt: Number of buffers.
+///
+/// - return:
+///     -1 ~ failure
+///     n  ~ number of bytes read or written
+///
+static int32_t ext2_access_vector(uint32_t, const ext2_inode_t *, uint32_t, const iovec_t *, uint32_t);
+
+///
+/// Grows a file to hold data up to given size, then writes a vector of
+/// buffers at given offset. A file is never shrunk.
+///
+/// - return:
+///     -1 ~ failure, including data past the direct blocks
+///     n  ~ number of bytes written
+///
+/// - side effects:
+///     May allocate blocks and write the inode back to disk.
+///
+static int32_t ext2_write_vector(uint32_t, uint32_t, const iovec_t *, uint32_t);
+
 ///
 /// Read an EXT2 block into buffer.
 ///
@@ -466,6 +526,15 @@ static int32_t release_ino(uint32_t ino);
 
 static int32_t release_blkno(uint32_t blkno);
 
+///
+/// Loads the inode and block bitmaps of the block group into memory.
+///
+/// - return:
+///     -1 ~ failure
+///     0  ~ success
+///
+static int32_t ext2_load_bitmaps(void);
+
 ///
 /// Tells whether `that` is ancestor of `this`.
 ///
@@ -664,6 +733,53 @@ static int32_t file_fseek(file_t * self, int32_t offset, int32_t whence) {
     return 0;
 }
 
+static int32_t file_freadv(file_t * self, const iovec_t * iov, uint32_t iovcnt) {
+    int32_t length;
+    ext2_inode_t inode;
+
+    if ((self->f_dentry.d_inode.i_mode & EXT2_S_IFREG) == 0)
+        return -1;
+
+    ext2_read_inode(self->f_dentry.d_inode.i_ino, &inode);
+    length = ext2_access_vector(0, &inode, self->f_pos, iov, iovcnt);
+    if (length == -1)
+        return -1;
+
+    self->f_pos += length;
+    return length;
+}
+
+static int32_t file_fwritev(file_t * self, const iovec_t * iov, uint32_t iovcnt) {
+    int32_t length;
+
+    length = ext2_write_vector(self->f_dentry.d_inode.i_ino, self->f_pos, iov, iovcnt);
+    if (length == -1)
+        return -1;
+
+    self->f_pos += length;
+    return length;
+}
+
+static int32_t file_fpread(file_t * self, void * buf, uint32_t nbytes, uint32_t offset) {
+    iovec_t iov;
+    ext2_inode_t inode;
+
+    if ((self->f_dentry.d_inode.i_mode & EXT2_S_IFREG) == 0)
+        return -1;
+
+    iov.iov_base = buf;
+    iov.iov_len = nbytes;
+    ext2_read_inode(self->f_dentry.d_inode.i_ino, &inode);
+    return ext2_access_vector(0, &inode, offset, &iov, 1);
+}
+
+static int32_t file_fpwrite(file_t * self, const void * buf, uint32_t nbytes, uint32_t offset) {
+    iovec_t iov;
+    iov.iov_base = (void *)buf;
+    iov.iov_len = nbytes;
+    return ext2_write_vector(self->f_dentry.d_inode.i_ino, offset, &iov, 1);
+}
+
 int32_t file_getkey(file_t * self, uint8_t * key) {
     ext2_inode_t inode;
     ext2_read_inode(self->f_dentry.d_inode.i_ino, &inode);
@@ -837,6 +953,104 @@ static int32_t ext2_write_direct(const ext2_inode_t * inode, uint32_t offset, co
     }
 }
 
+static int32_t ext2_access_vector(uint32_t rw, const ext2_inode_t * inode, uint32_t offset, const iovec_t * iov, uint32_t iovcnt) {
+    uint32_t blocksize = superblock.s_blocksize;
+    uint32_t total; // bytes to move
+    uint32_t end; // offset in file to stop at
+    uint32_t blk_off; // offset inside the current block
+    uint32_t blk_len; // bytes of the current block to move
+    uint32_t pos; // bytes of the current block moved so far
+    uint32_t seg; // current buffer
+    uint32_t seg_off; // offset inside the current buffer
+    uint32_t cpy_len; // length to copy in each memcpy
+    uint32_t iblkno, blkno, i;
+    int32_t idr_loaded = 0;
+    uint8_t blk_buf [blocksize];
+    uint32_t idr_buf [blocksize / 4];
+
+    // Add up the buffers, and cut a read short at end of file.
+    total = 0;
+    for (i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+    if (rw == 0) {
+        if (offset >= inode->i_size)
+            return 0;
+        if (total > inode->i_size - offset)
+            total = inode->i_size - offset;
+    } else if (offset > blocksize * 12 || total > blocksize * 12 - offset) {
+        return -1;
+    }
+
+    end = offset + total;
+    seg = 0;
+    seg_off = 0;
+    while (offset < end) {
+        iblkno = offset / blocksize;
+        blk_off = offset % blocksize;
+        blk_len = blocksize - blk_off;
+        if (end - offset < blk_len)
+            blk_len = end - offset;
+
+        // Find the block on disk; the indirect block is read once.
+        if (iblkno < 12) {
+            blkno = inode->i_block[iblkno];
+        } else {
+            if (!idr_loaded) {
+                if (0 != ext2_read_block(inode->i_block[12], idr_buf))
+                    return -1;
+                idr_loaded = 1;
+            }
+            blkno = idr_buf[iblkno - 12];
+        }
+
+        // A write that covers the whole block does not need its old data.
+        if (rw == 0 || blk_len != blocksize) {
+            if (0 != ext2_read_block(blkno, blk_buf))
+                return -1;
+        }
+
+        // Scatter the block to, or gather it from, as many buffers as it spans.
+        for (pos = 0; pos < blk_len; pos += cpy_len) {
+            while (seg_off == iov[seg].iov_len) {
+                seg++;
+                seg_off = 0;
+            }
+            cpy_len = iov[seg].iov_len - seg_off;
+            if (blk_len - pos < cpy_len)
+                cpy_len = blk_len - pos;
+            if (rw == 0)
+                memcpy((uint8_t *)iov[seg].iov_base + seg_off, blk_buf + blk_off + pos, cpy_len);
+            else
+                memcpy(blk_buf + blk_off + pos, (uint8_t *)iov[seg].iov_base + seg_off, cpy_len);
+            seg_off += cpy_len;
+        }
+
+        if (rw == 1 && 0 != ext2_write_block(blkno, blk_buf))
+            return -1;
+        offset += blk_len;
+    }
+
+    return total;
+}
+
+static int32_t ext2_write_vector(uint32_t ino, uint32_t offset, const iovec_t * iov, uint32_t iovcnt) {
+    ext2_inode_t inode;
+    uint32_t total, i;
+
+    total = 0;
+    for (i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+    // Written apart so an offset near 4gb can not wrap past the check.
+    if (offset > superblock.s_blocksize * 12 || total > superblock.s_blocksize * 12 - offset)
+        return -1;
+
+    ext2_read_inode(ino, &inode);
+    if (offset + total > inode.i_size)
+        ext2_alloc_inode(ino, &inode, offset + total);
+
+    return ext2_access_vector(1, &inode, offset, iov, iovcnt);
+}
+
 int32_t ext2_read_indirect(const ext2_inode_t * inode, uint32_t offset, void * buf, uint32_t nbytes) {
     // 0-based actual block index among singly indirect data blocks.
     uint32_t iblkno;
@@ -1281,85 +1495,90 @@ static int32_t ext2_read_data(const ext2_inode_t * inode, uint32_t offset, void
 
 }
 
+static int32_t ext2_load_bitmaps(void) {
+    uint32_t nbits;
+
+    ext2_read_bitmap(ino_map, ino_map_blkno, bg_inode_bitmap);
+    nbits = ext2_sb->s_inodes_per_group;
+    if (nbits == 0 || nbits > EXT2_MAP_BITS)
+        nbits = EXT2_MAP_BITS;
+    hbitmap_init(&ino_hbitmap, ino_map, ino_summary, nbits);
+
+    ext2_read_bitmap(blk_map, blk_map_blkno, bg_block_bitmap);
+    nbits = ext2_sb->s_blocks_per_group;
+    if (nbits == 0 || nbits > EXT2_MAP_BITS)
+        nbits = EXT2_MAP_BITS;
+    hbitmap_init(&blk_hbitmap, blk_map, blk_summary, nbits);
+    return 0;
+}
+
 static int32_t next_free_ino(void) {
-    uint8_t blk_buf[superblock.s_blocksize];
-    uint32_t bitmap_blkno;
+    uint32_t flags;
     int32_t bit;
 
-    ext2_read_bitmap(blk_buf, bitmap_blkno, bg_inode_bitmap);
-
     // Find free inode from bitmap.
-    bit = find_free_region((uint32_t *)blk_buf, superblock.s_blocksize * 4, 0);
-    if (bit == -1)
+    spin_lock_irqsave(&ext2_map_lock, flags);
+    bit = hbitmap_alloc_bit(&ino_hbitmap);
+    spin_unlock_irqrestore(&ext2_map_lock, flags);
+    if (bit < 0)
         return -1;
 
-    bitmap_set_bit((uint32_t *)blk_buf, bit);
-    ext2_write_block(bitmap_blkno, blk_buf);
+    ext2_write_block(ino_map_blkno, ino_map);
     return bit + 1;
 }
 
 static int32_t next_free_blkno(void) {
-    uint8_t blk_buf[superblock.s_blocksize];
-    uint32_t bitmap_blkno;
+    uint32_t flags;
     int32_t bit;
 
-    ext2_read_bitmap(blk_buf, bitmap_blkno, bg_block_bitmap);
-
     // Find free data block from bitmap.
-    bit = find_free_region((uint32_t *)blk_buf, superblock.s_blocksize * 4, 0);
-    if (bit == -1)
+    spin_lock_irqsave(&ext2_map_lock, flags);
+    bit = hbitmap_alloc_bit(&blk_hbitmap);
+    spin_unlock_irqrestore(&ext2_map_lock, flags);
+    if (bit < 0)
         return -1;
 
-    bitmap_set_bit((uint32_t *)blk_buf, bit);
-    ext2_write_block(bitmap_blkno, blk_buf);
+    ext2_write_block(blk_map_blkno, blk_map);
     return bit + 1;
 }
 
 static int32_t ino_try_set(uint32_t ino) {
-    uint8_t blk_buf [superblock.s_blocksize];
-    uint32_t bitmap_blkno;
-
-    ext2_read_bitmap(blk_buf, bitmap_blkno, bg_inode_bitmap);
+    uint32_t flags;
 
     // Exist?
-    if (bitmap_query_bit((uint32_t *)blk_buf, ino - 1) != 0)
+    spin_lock_irqsave(&ext2_map_lock, flags);
+    if (bitmap_query_bit(ino_map, ino - 1) != 0) {
+        spin_unlock_irqrestore(&ext2_map_lock, flags);
         return 1;
-    bitmap_set_bit((uint32_t *)blk_buf, ino - 1);
-    ext2_write_block(bitmap_blkno, blk_buf);
+    }
+    hbitmap_set_bit(&ino_hbitmap, ino - 1);
+    spin_unlock_irqrestore(&ext2_map_lock, flags);
+    ext2_write_block(ino_map_blkno, ino_map);
     return 0;
 }
 
 static int32_t ino_exist(uint32_t ino) {
-    uint8_t blk_buf [superblock.s_blocksize];
-    uint32_t bitmap_blkno;
-
     if (ino == 0)
         return 0;
 
-    ext2_read_bitmap(blk_buf, bitmap_blkno, bg_inode_bitmap);
-
-    return bitmap_query_bit((uint32_t *)blk_buf, ino - 1);
+    return bitmap_query_bit(ino_map, ino - 1);
 }
 
 static int32_t release_ino(uint32_t ino) {
-    uint8_t blk_buf[superblock.s_blocksize];
-    uint32_t bitmap_blkno;
-
-    ext2_read_bitmap(blk_buf, bitmap_blkno, bg_inode_bitmap);
-
-    bitmap_set_bit((uint32_t *)blk_buf, ino - 1);
-    ext2_write_block(bitmap_blkno, blk_buf);
+    uint32_t flags;
+    spin_lock_irqsave(&ext2_map_lock, flags);
+    hbitmap_clear_bit(&ino_hbitmap, ino - 1);
+    spin_unlock_irqrestore(&ext2_map_lock, flags);
+    ext2_write_block(ino_map_blkno, ino_map);
     return 0;
 }
 
 static int32_t release_blkno(uint32_t blkno) {
-    uint8_t blk_buf[superblock.s_blocksize];
-    uint32_t bitmap_blkno;
-
-    ext2_read_bitmap(blk_buf, bitmap_blkno, bg_block_bitmap);
-
-    bitmap_set_bit((uint32_t *)blk_buf, blkno - 1);
-    ext2_write_block(bitmap_blkno, blk_buf);
+    uint32_t flags;
+    spin_lock_irqsave(&ext2_map_lock, flags);
+    hbitmap_clear_bit(&blk_hbitmap, blkno - 1);
+    spin_unlock_irqrestore(&ext2_map_lock, flags);
+    ext2_write_block(blk_map_blkno, blk_map);
     return 0;
 }
 
@@ -1379,20 +1598,27 @@ static int32_t ext2_is_ancestor(const ext2_inode_t * that, const ext2_inode_t *
     return 0;
 }
 
-void ext2_init(void) {
-    uint8_t buf [1024];
+int32_t ext2_init(void) {
+    uint8_t buf [EXT2_BLOCK_SIZE];
 
     // Set up block device.
-    superblock.s_blocksize = 1024;
+    superblock.s_blocksize = EXT2_BLOCK_SIZE;
     superblock.s_dev = ide_device;
 
     // Bootstrap to EXT2 super block.
-    ext2_read_block(1, buf);
+    if (0 != ext2_read_block(1, buf))
+        return -1;
     superblock.priv_data = &ext2_super;
     *ext2_sb = *((ext2_super_t *)buf);
 
+    // Cache allocation bitmaps. Without them the allocators would run on
+    // empty hbitmaps, so a failed read fails the mount.
+    if (0 != ext2_load_bitmaps())
+        return -1;
+
     // Bootstrap to root inode.
-    ext2_read_inode(EXT2_ROOT_INO, &cur_ext2_dir);
+    if (0 != ext2_read_inode(EXT2_ROOT_INO, &cur_ext2_dir))
+        return -1;
     superblock.s_root.d_inode.i_blocks = cur_ext2_dir.i_blocks;
     superblock.s_root.d_inode.i_size = cur_ext2_dir.i_size;
     superblock.s_root.d_inode.i_ino = EXT2_ROOT_INO;
@@ -1406,4 +1632,5 @@ void ext2_init(void) {
 
     // Set current directory.
     cur_dentry = superblock.s_root;
+    return 0;
 }
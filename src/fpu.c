@@ -0,0 +1,213 @@
+/* fpu.c - lazy x87/SSE context switching. the state of a process lives in its pcb while another process owns the fpu
+   registers; it is only saved and loaded when the #NM trap shows that a process other than the owner wants the fpu.
+   each cpu has its own owner. with more than one cpu online the owner's state is saved as soon as another process
+   runs, since the process may go on on another cpu; loading it back is still left to #NM.
+*/
+
+#include <fpu.h>
+#include <types.h>
+#include <lib.h>
+#include <proc.h>
+#include <smp.h>
+
+#define fpu_owner (this_cpu()->fpu_owner) // process whose state is in the fpu registers of this cpu; NULL if none
+
+static uint32_t kernel_fpu_flags; // interrupt flag saved by kernel_fpu_begin
+static uint32_t fpu_features; // CPUID_FXSR and CPUID_SSE, if the cpu has them
+
+/* fpu_init
+   description: turn on the fpu of the running cpu and arm lazy switching; no process owns the fpu yet. fxsave and SSE are only turned on if the cpu has them, otherwise the state is switched with fnsave and only x87 instructions work.
+   input: none
+   output: none
+   return value: none
+   side effect: sets CR0 and CR4
+*/
+void fpu_init(void) {
+    uint32_t eax, ebx, ecx, edx, cr4 = 0;
+    asm volatile ("cpuid\n" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    fpu_features = edx & (CPUID_FXSR | CPUID_SSE);
+    if (!(fpu_features & CPUID_FXSR))
+        fpu_features = 0; // SSE state can not be switched without fxsave
+    if (fpu_features & CPUID_FXSR)
+        cr4 |= CR4_OSFXSR;
+    if (fpu_features & CPUID_SSE)
+        cr4 |= CR4_OSXMMEXCPT;
+    asm volatile (
+        "movl %%cr0,%%eax\n"
+        "andl %1,%%eax\n"
+        "orl %2,%%eax\n"
+        "movl %%eax,%%cr0\n"
+        "movl %%cr4,%%eax\n"
+        "orl %0,%%eax\n"
+        "movl %%eax,%%cr4\n"
+        :
+        : "r" (cr4), "i" (~CR0_EM), "i" (CR0_MP | CR0_NE | CR0_TS)
+        : "eax"
+    );
+    fpu_owner = NULL;
+}
+
+
+/* fpu_save
+   description: save the fpu registers of a process. without fxsave the registers are reinitialized, so a caller that keeps using them loads them back.
+   input: pcb - pcb of the process whose state is in the registers
+   output: none
+   return value: none
+   side effect: none
+*/
+static void fpu_save(pcb_t* pcb) {
+    if (fpu_features & CPUID_FXSR)
+        fxsave(FPU_STATE(pcb));
+    else
+        fnsave(FPU_STATE(pcb));
+}
+
+
+/* fpu_restore
+   description: load the fpu registers of a process
+   input: pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+static void fpu_restore(pcb_t* pcb) {
+    if (fpu_features & CPUID_FXSR)
+        fxrstor(FPU_STATE(pcb));
+    else
+        frstor(FPU_STATE(pcb));
+}
+
+
+/* fpu_clean
+   description: put the fpu in its reset state, with SSE exceptions masked
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+static void fpu_clean(void) {
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    asm volatile ("fninit\n");
+    if (fpu_features & CPUID_SSE)
+        asm volatile ("ldmxcsr %0\n" : : "m" (mxcsr));
+}
+
+
+/* do_fpu_trap
+   description: #NM handler. hand the fpu to the current process: save the owner's state, and load the current process's, or a clean state on its first use
+   input: none
+   output: none
+   return value: none
+   side effect: clears CR0.TS
+*/
+void do_fpu_trap(void) {
+    uint32_t flags;
+    cli_and_save(flags); // critical section begins
+    clts();
+    if (fpu_owner != cur_proc_pcb) {
+        if (fpu_owner != NULL)
+            fpu_save(fpu_owner);
+        if (cur_proc_pcb->fpu_used)
+            fpu_restore(cur_proc_pcb);
+        else
+            fpu_clean();
+        cur_proc_pcb->fpu_used = 1;
+        fpu_owner = cur_proc_pcb;
+    }
+    restore_flags(flags); // critical section ends
+}
+
+
+/* fpu_switch
+   description: arm lazy switching for the process about to run. only the owner may use the fpu without trapping.
+   input: next - pcb of the process about to run
+   output: none
+   return value: none
+   side effect: sets or clears CR0.TS
+*/
+void fpu_switch(pcb_t* next) {
+    if (num_online > 1 && fpu_owner != NULL && fpu_owner != next) {
+        clts();
+        fpu_save(fpu_owner);
+        fpu_owner = NULL;
+    }
+    if (next == fpu_owner)
+        clts();
+    else
+        stts();
+}
+
+
+/* fpu_fork
+   description: give a child a copy of its parent's fpu state; the child loads it on its first fpu instruction
+   input: parent - parent pcb
+          child - child pcb
+   output: none
+   return value: none
+   side effect: none
+*/
+void fpu_fork(pcb_t* parent, pcb_t* child) {
+    uint32_t flags;
+    cli_and_save(flags); // critical section begins
+    if (parent == fpu_owner) { // the parent is running, so CR0.TS is clear
+        fpu_save(child);
+        if (!(fpu_features & CPUID_FXSR))
+            fpu_restore(child); // fnsave reset the parent's registers
+    }
+    else
+        memcpy(FPU_STATE(child), FPU_STATE(parent), FPU_AREA_SIZE);
+    child->fpu_used = parent->fpu_used;
+    restore_flags(flags); // critical section ends
+}
+
+
+/* fpu_release
+   description: forget the fpu state of a process that exits
+   input: pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+void fpu_release(pcb_t* pcb) {
+    uint32_t flags;
+    cli_and_save(flags); // critical section begins
+    if (fpu_owner == pcb) {
+        fpu_owner = NULL;
+        stts();
+    }
+    pcb->fpu_used = 0;
+    restore_flags(flags); // critical section ends
+}
+
+
+/* kernel_fpu_begin
+   description: let kernel code use fpu and SSE instructions. the owner's state is saved and the fpu is left without an owner, so the owner reloads it on its next fpu instruction.
+   input: none
+   output: none
+   return value: none
+   side effect: clears CR0.TS, turns interrupts off until kernel_fpu_end
+*/
+void kernel_fpu_begin(void) {
+    uint32_t flags;
+    cli_and_save(flags);
+    clts();
+    if (fpu_owner != NULL) {
+        fpu_save(fpu_owner);
+        fpu_owner = NULL;
+    }
+    fpu_clean();
+    kernel_fpu_flags = flags;
+}
+
+
+/* kernel_fpu_end
+   description: end a kernel fpu section; the next process to use the fpu reloads its own state
+   input: none
+   output: none
+   return value: none
+   side effect: sets CR0.TS, restores the interrupt flag
+*/
+void kernel_fpu_end(void) {
+    stts();
+    restore_flags(kernel_fpu_flags);
+}
@@ -0,0 +1,168 @@
+/* frame.c - physical page frame allocator. Every 4kb frame of physical memory up to MAX_PHYS_MEM has a bit
+   in a two-level bitmap; a set bit means the frame is in use or does not exist. Only ram reported as available by the
+   multiboot memory map and lying above the statically laid out region is ever handed out.
+*/
+
+#include <frame.h>
+#include <bitmap.h>
+#include <multiboot.h>
+#include <lib.h>
+#include <types.h>
+#include <system.h>
+#include <spinlock.h>
+
+#define CHECK_FLAG(flags, bit) ((flags) & (1 << (bit)))
+#define MBI_FLAG_MEM 0 // mem_lower and mem_upper are valid
+#define MBI_FLAG_MMAP 6 // mmap_addr and mmap_length are valid
+#define UPPER_MEM_BASE 0x100000 // mem_upper counts kilobytes starting at 1MB
+
+frame_info_t frame_info; // a global instance of the struct
+static uint32_t frame_map[NUM_FRAMES / BITS_LONG]; // one bit per frame
+static uint32_t frame_summary[HBITMAP_SUMMARY_LONG(NUM_FRAMES)];
+static hbitmap_t frame_hbitmap;
+static uint8_t frame_ref[NUM_FRAMES]; // number of mappings sharing each handed out frame
+static DEFINE_SPINLOCK(frame_lock); // guards the frame bitmap and reference counts
+
+/* frame_release_range
+   description: mark a physical range as available. frames only partially inside the range are left untouched.
+   input: base - starting physical address of the range
+          length - length of the range in bytes
+   output: none
+   return value: none
+   side effect: modify frame bitmap
+*/
+static void frame_release_range(uint32_t base, uint32_t length) {
+    uint32_t end = (length > MAX_PHYS_MEM - base) ? MAX_PHYS_MEM : base + length;
+    uint32_t idx = PHYS_TO_FRAME(base + FRAME_SIZE - 1); // round up to the first whole frame
+    for (; idx < PHYS_TO_FRAME(end); idx++) {
+        if (bitmap_query_bit(frame_map, idx)) {
+            bitmap_clear_bit(frame_map, idx);
+            frame_info.total++;
+        }
+    }
+}
+
+
+/* frame_release_ram
+   description: mark a range of ram reported by the bootloader as available, skipping the reserved region
+   input: base - starting physical address of the range
+          length - length of the range in bytes
+   output: none
+   return value: none
+   side effect: modify frame bitmap
+*/
+static void frame_release_ram(uint32_t base, uint32_t length) {
+    if (base >= MAX_PHYS_MEM) // range is not tracked
+        return;
+    if (base < FRAME_RESERVED_BOT) {
+        if (length <= FRAME_RESERVED_BOT - base) // range is entirely reserved
+            return;
+        length -= FRAME_RESERVED_BOT - base;
+        base = FRAME_RESERVED_BOT;
+    }
+    frame_release_range(base, length);
+}
+
+
+/* frame_init
+   description: seed the frame allocator from the multiboot memory map. without a memory map, mem_upper is used; without either, only the legacy 4mb heap region at HEAP_PHYS_TOP is made available.
+   input: mbi - multiboot info passed by the bootloader, may be NULL
+   output: none
+   return value: none
+   side effect: none
+*/
+void frame_init(multiboot_info_t* mbi) {
+    memory_map_t* mmap;
+    bitmap_set(frame_map, NUM_FRAMES); // nothing is available until the map says so
+    memset(frame_ref, 0, sizeof(frame_ref));
+    frame_info.total = frame_info.used = 0;
+
+    if (mbi != NULL && CHECK_FLAG(mbi->flags, MBI_FLAG_MMAP)) {
+        for (mmap = (memory_map_t* )mbi->mmap_addr;
+             (uint32_t)mmap < mbi->mmap_addr + mbi->mmap_length;
+             mmap = (memory_map_t* )((uint32_t)mmap + mmap->size + sizeof(mmap->size))) {
+            if (mmap->type != MMAP_AVAILABLE || mmap->base_addr_high != 0)
+                continue; // not ram, or beyond 4GB
+            frame_release_ram(mmap->base_addr_low, mmap->length_high ? MAX_PHYS_MEM : mmap->length_low);
+        }
+    }
+    else if (mbi != NULL && CHECK_FLAG(mbi->flags, MBI_FLAG_MEM))
+        frame_release_ram(UPPER_MEM_BASE, mbi->mem_upper * 1024);
+
+    /* the legacy heap region sits below the reserved line but has always belonged to the heap */
+    if (frame_info.total == 0)
+        frame_release_range(HEAP_PHYS_TOP, HEAP_PHYS_SIZE);
+    hbitmap_init(&frame_hbitmap, frame_map, frame_summary, NUM_FRAMES);
+}
+
+
+/* frame_alloc
+   description: allocate a physical frame with a reference count of one
+   input: none
+   output: none
+   return value: physical address of the frame if success; ENOMEM if out of memory
+   side effect: none
+*/
+uint32_t frame_alloc(void) {
+    uint32_t flags;
+    int idx;
+    spin_lock_irqsave(&frame_lock, flags);
+    idx = hbitmap_alloc_bit(&frame_hbitmap);
+    if (idx >= 0) {
+        frame_ref[idx] = 1;
+        frame_info.used++;
+    }
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return (idx < 0) ? ENOMEM : FRAME_TO_PHYS((uint32_t)idx);
+}
+
+
+/* frame_get
+   description: take another reference to a frame that is already handed out, e.g. when a page is shared by fork
+   input: phys_addr - physical address of the frame
+   output: none
+   return value: none
+   side effect: none
+*/
+void frame_get(uint32_t phys_addr) {
+    uint32_t flags;
+    uint32_t idx = PHYS_TO_FRAME(phys_addr);
+    if (idx >= NUM_FRAMES) return;
+    spin_lock_irqsave(&frame_lock, flags);
+    if (frame_ref[idx] > 0)
+        frame_ref[idx]++;
+    spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+
+/* frame_ref_count
+   description: get the number of references to a frame
+   input: phys_addr - physical address of the frame
+   output: none
+   return value: reference count; 0 if the frame is not handed out
+   side effect: none
+*/
+uint32_t frame_ref_count(uint32_t phys_addr) {
+    uint32_t idx = PHYS_TO_FRAME(phys_addr);
+    return (idx < NUM_FRAMES) ? frame_ref[idx] : 0;
+}
+
+
+/* frame_free
+   description: drop a reference to a physical frame; the frame goes back to the allocator with its last reference
+   input: phys_addr - physical address of the frame
+   output: none
+   return value: none
+   side effect: none
+*/
+void frame_free(uint32_t phys_addr) {
+    uint32_t flags;
+    uint32_t idx = PHYS_TO_FRAME(phys_addr);
+    if (idx >= NUM_FRAMES) return;
+    spin_lock_irqsave(&frame_lock, flags);
+    if (frame_ref[idx] > 0 && --frame_ref[idx] == 0) {
+        hbitmap_clear_bit(&frame_hbitmap, idx);
+        frame_info.used--;
+    }
+    spin_unlock_irqrestore(&frame_lock, flags);
+}
@@ -0,0 +1,276 @@
+/* heapinfo.c - kernel heap statistics. Counters are kept per size class (slab caches, then buddy orders) and per
+   call site of malloc/calloc/realloc, identified by return address. Everything, together with alloc_info and a
+   fragmentation index, can be read as text from the "heapinfo" file.
+*/
+
+#include <heapinfo.h>
+#include <mem.h>
+#include <slab.h>
+#include <vfs.h>
+#include <lib.h>
+#include <types.h>
+#include <system.h>
+
+alloc_stat_t alloc_stat; // a global instance of the struct
+static DEFINE_SPINLOCK(site_lock); // guards the call site table
+
+static int32_t heapinfo_fopen(file_t* self, const int8_t* filename);
+static int32_t heapinfo_fread(file_t* self, void* buf, uint32_t nbytes);
+static int32_t heapinfo_fwrite(file_t* self, const void* buf, uint32_t nbytes);
+static int32_t heapinfo_fclose(file_t* self);
+
+static file_op_t heapinfo_fops = {
+    .open = heapinfo_fopen,
+    .read = heapinfo_fread,
+    .write = heapinfo_fwrite,
+    .close = heapinfo_fclose
+};
+
+file_op_t* heapinfo_fop = &heapinfo_fops;
+
+static int8_t heapinfo_buf[HEAPINFO_BUF_SIZE]; // text snapshot handed out by read
+static uint32_t heapinfo_len; // length of the snapshot
+
+/* heapinfo_init
+   description: clear all heap statistics
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void heapinfo_init(void) {
+    memset(&alloc_stat, 0, sizeof(alloc_stat));
+}
+
+
+/* heapinfo_class_alloc
+   description: account an allocation of a size class
+   input: cls - size class index
+   output: none
+   return value: none
+   side effect: none
+*/
+void heapinfo_class_alloc(uint32_t cls) {
+    alloc_class_t* c = &alloc_stat.cls[cls];
+    c->allocs++;
+    if (++c->inuse > c->peak)
+        c->peak = c->inuse;
+}
+
+
+/* heapinfo_class_free
+   description: account a free of a size class
+   input: cls - size class index
+   output: none
+   return value: none
+   side effect: none
+*/
+void heapinfo_class_free(uint32_t cls) {
+    alloc_stat.cls[cls].inuse--;
+}
+
+
+/* heapinfo_site
+   description: account an allocation request to the call site it came from. sites are kept in a small open addressing table keyed by return address.
+   input: caller - return address of the allocation call
+          size - requested size in bytes
+          ptr - result of the allocation
+   output: none
+   return value: none
+   side effect: none
+*/
+void heapinfo_site(uint32_t caller, uint32_t size, void* ptr) {
+    uint32_t flags, i, slot;
+    alloc_site_t* site = NULL;
+    spin_lock_irqsave(&site_lock, flags);
+    for (i = 0, slot = (caller >> 2) % ALLOC_SITE_NUM; i < ALLOC_SITE_NUM; i++, slot = (slot + 1) % ALLOC_SITE_NUM) {
+        if (alloc_stat.site[slot].caller == caller || alloc_stat.site[slot].caller == 0) {
+            site = &alloc_stat.site[slot];
+            break;
+        }
+    }
+    if (site == NULL)
+        alloc_stat.site_overflow++;
+    else {
+        site->caller = caller;
+        if (ptr == NULL)
+            site->fails++;
+        else {
+            site->allocs++;
+            site->bytes += size;
+        }
+    }
+    spin_unlock_irqrestore(&site_lock, flags);
+}
+
+
+/* heap_largest_free_order
+   description: get the order of the largest free buddy block
+   input: none
+   output: none
+   return value: largest order with a free block; MAX_ORDER + 1 if the heap window is exhausted
+   side effect: none
+*/
+uint32_t heap_largest_free_order(void) {
+    int order;
+    for (order = MAX_ORDER; order >= 0; order--) {
+        if (free_area[order].nr_free)
+            return order;
+    }
+    return MAX_ORDER + 1;
+}
+
+
+/* heap_free_pages
+   description: get the number of free pages in the heap window
+   input: none
+   output: none
+   return value: number of free heap pages
+   side effect: none
+*/
+uint32_t heap_free_pages(void) {
+    uint32_t order, pages = 0;
+    for (order = 0; order <= MAX_ORDER; order++)
+        pages += free_area[order].nr_free << order;
+    return pages;
+}
+
+
+/* heap_frag_index
+   description: get the fragmentation index of the heap window: the share of free pages that are not part of a block of the largest free order. 0 means every free page can be handed out as part of the largest blocks; values close to FRAG_SCALE mean free memory is scattered in small blocks.
+   input: none
+   output: none
+   return value: fragmentation index in thousandths
+   side effect: none
+*/
+uint32_t heap_frag_index(void) {
+    uint32_t free_pages = heap_free_pages();
+    uint32_t order = heap_largest_free_order();
+    if (free_pages == 0)
+        return 0;
+    return FRAG_SCALE - FRAG_SCALE * (free_area[order].nr_free << order) / free_pages;
+}
+
+
+/* heapinfo_puts
+   description: append a string to the snapshot, truncating at the end of the buffer
+   input: s - string to append
+   output: none
+   return value: none
+   side effect: none
+*/
+static void heapinfo_puts(const int8_t* s) {
+    while (*s != '\0' && heapinfo_len < HEAPINFO_BUF_SIZE)
+        heapinfo_buf[heapinfo_len++] = *s++;
+}
+
+
+/* heapinfo_putn
+   description: append a number to the snapshot, followed by a separator
+   input: value - number to append
+          radix - 10 or 16
+          sep - separator appended after the number
+   output: none
+   return value: none
+   side effect: none
+*/
+static void heapinfo_putn(uint32_t value, int32_t radix, const int8_t* sep) {
+    int8_t num[BITS_LONG + 1];
+    if (radix == 16)
+        heapinfo_puts("0x");
+    heapinfo_puts(itoa(value, num, radix));
+    heapinfo_puts(sep);
+}
+
+
+/* heapinfo_snapshot
+   description: render all heap statistics as text
+   input: none
+   output: none
+   return value: none
+   side effect: overwrite heapinfo_buf
+*/
+static void heapinfo_snapshot(void) {
+    uint32_t i;
+    alloc_class_t* c;
+    alloc_site_t* s;
+    heapinfo_len = 0;
+
+    heapinfo_puts("pages ");
+    heapinfo_putn(alloc_info.page_alloc, 10, " peak ");
+    heapinfo_putn(alloc_info.page_peak, 10, "\nobjects ");
+    heapinfo_putn(alloc_info.obj_alloc, 10, " peak ");
+    heapinfo_putn(alloc_info.obj_peak, 10, "\nfailures ");
+    heapinfo_putn(alloc_info.fail_alloc, 10, "\nfree pages ");
+    heapinfo_putn(heap_free_pages(), 10, " largest order ");
+    heapinfo_putn(heap_largest_free_order(), 10, " fragmentation ");
+    heapinfo_putn(heap_frag_index(), 10, "/1000\n\nsize allocs inuse peak\n");
+
+    for (i = 0; i < ALLOC_CLASS_NUM; i++) {
+        c = &alloc_stat.cls[i];
+        heapinfo_putn((i < NUM_SLAB_CACHE) ? kmalloc_caches[i].obj_size : ORDER_TO_SIZE(i - NUM_SLAB_CACHE) * HEAP_PAGE_SIZE, 10, " ");
+        heapinfo_putn(c->allocs, 10, " ");
+        heapinfo_putn(c->inuse, 10, " ");
+        heapinfo_putn(c->peak, 10, "\n");
+    }
+
+    heapinfo_puts("\ncaller allocs bytes fails\n");
+    for (i = 0; i < ALLOC_SITE_NUM; i++) {
+        s = &alloc_stat.site[i];
+        if (s->caller == 0)
+            continue;
+        heapinfo_putn(s->caller, 16, " ");
+        heapinfo_putn(s->allocs, 10, " ");
+        heapinfo_putn(s->bytes, 10, " ");
+        heapinfo_putn(s->fails, 10, "\n");
+    }
+    heapinfo_puts("other ");
+    heapinfo_putn(alloc_stat.site_overflow, 10, "\n");
+}
+
+
+///
+/// File open operation for heapinfo.
+///
+static int32_t heapinfo_fopen(file_t* self, const int8_t* filename) {
+    self->f_dentry.d_inode.i_ino = 0;
+    self->f_pos = 0;
+    return 0;
+}
+
+
+///
+/// File read operation for heapinfo. A fresh snapshot is taken whenever
+/// reading starts from the beginning of the file.
+///
+static int32_t heapinfo_fread(file_t* self, void* buf, uint32_t nbytes) {
+    uint32_t flags;
+    if (self->f_pos == 0) {
+        ticket_lock_irqsave(&heap_lock, flags); // the free lists must not change while they are walked
+        heapinfo_snapshot();
+        ticket_unlock_irqrestore(&heap_lock, flags);
+    }
+    if (self->f_pos >= heapinfo_len)
+        return 0;
+    if (nbytes > heapinfo_len - self->f_pos)
+        nbytes = heapinfo_len - self->f_pos;
+    memcpy(buf, heapinfo_buf + self->f_pos, nbytes);
+    self->f_pos += nbytes;
+    return nbytes;
+}
+
+
+///
+/// heapinfo is read-only.
+///
+static int32_t heapinfo_fwrite(file_t* self, const void* buf, uint32_t nbytes) {
+    return -1;
+}
+
+
+///
+/// Auto success.
+///
+static int32_t heapinfo_fclose(file_t* self) {
+    return 0;
+}
@@ -5,10 +5,12 @@
 
 #include <i8259.h>
 #include <lib.h>
+#include <spinlock.h>
 
 /* Interrupt masks to determine which interrupts are enabled and disabled */
 uint8_t master_mask = IRQ_MASK_SET; /* IRQs 0-7  */
 uint8_t slave_mask = IRQ_MASK_SET;  /* IRQs 8-15 */
+static DEFINE_SPINLOCK(i8259_lock); /* guards both masks and the command sequences to the pics */
 
 
 /* i8259_init
@@ -20,7 +22,7 @@ uint8_t slave_mask = IRQ_MASK_SET;  /* IRQs 8-15 */
 */
 void i8259_init(void) {
     unsigned long flags;
-    cli_and_save(flags); // critical section begins
+    spin_lock_irqsave(&i8259_lock, flags);
     
     /* write ICW1 to command register of both pics */
     outb(ICW1, MASTER_PORT_CTRL);
@@ -42,8 +44,7 @@ void i8259_init(void) {
     outb(IRQ_MASK_SET, MASTER_PORT_DATA);
     outb(IRQ_MASK_SET, SLAVE_PORT_DATA);
     
-    sti();
-    restore_flags(flags); // critical section ends
+    spin_unlock_irqrestore(&i8259_lock, flags);
     enable_irq(IRQ_PIN); // enable cascading 
 }
 
@@ -60,6 +61,8 @@ void enable_irq(uint32_t irq_num) {
         return;
 
     uint8_t irq_mask; // irq mask
+    unsigned long flags;
+    spin_lock_irqsave(&i8259_lock, flags);
     
     /* if irq is in master pic */
     if (irq_num >= MASTER_IRQ_MIN && irq_num <= MASTER_IRQ_MAX) {
@@ -74,6 +77,7 @@ void enable_irq(uint32_t irq_num) {
         slave_mask &= irq_mask;
         outb(slave_mask, SLAVE_PORT_DATA);
     }
+    spin_unlock_irqrestore(&i8259_lock, flags);
 }
 
 
@@ -89,6 +93,8 @@ void disable_irq(uint32_t irq_num) {
         return;
 
     uint8_t irq_mask; // irq mask
+    unsigned long flags;
+    spin_lock_irqsave(&i8259_lock, flags);
         
     /* if irq is in master pic */
     if (irq_num >= MASTER_IRQ_MIN && irq_num <= MASTER_IRQ_MAX) {
@@ -103,6 +109,7 @@ void disable_irq(uint32_t irq_num) {
         slave_mask |= irq_mask;
         outb(slave_mask, SLAVE_PORT_DATA); // write OCW2 to IMR of slave pic
     }
+    spin_unlock_irqrestore(&i8259_lock, flags);
 }
 
 
@@ -9,8 +9,14 @@
 #include <interrupt.h>
 #include <exception.h>
 #include <syscall.h>
+#include <fpu.h>
+#include <smp.h>
 
 #define SYSCALL_ENTRY 0x80
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+#define CPUID_SEP 0x800 // CPUID.1:EDX, sysenter and sysexit
 #define IRQ_BASE 0x20
 
 /* idt_init
@@ -52,19 +58,79 @@ void exp_set_idt(void) {
         idt[i].present = 0x1;
         SET_IDT_ENTRY(idt[i], exp_table[i]);
     }
+    fpu_init(); // #NM now switches fpu state lazily instead of faulting
+}
+
+/* sysenter_init
+   description: point the sysenter MSRs of the running cpu at the fast system call entry. the ring 0 and ring 3 selectors follow from SYSENTER_CS by the gdt layout; SYSENTER_ESP is the tss of this cpu, from which the entry code loads esp0.
+   input: none
+   output: none
+   return value: none
+   side effect: without sysenter support, programs keep using int 0x80
+*/
+void sysenter_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile ("cpuid\n" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    if (!(edx & CPUID_SEP))
+        return;
+    if (((eax >> 8) & 0xF) == 6 && ((eax >> 4) & 0xF) < 3 && (eax & 0xF) < 3) // early pentium pro sets the bit without the instructions
+        return;
+    asm volatile ("wrmsr\n" : : "c" (MSR_SYSENTER_CS), "a" (KERNEL_CS), "d" (0));
+    asm volatile ("wrmsr\n" : : "c" (MSR_SYSENTER_ESP), "a" ((uint32_t)this_cpu()->tss), "d" (0));
+    asm volatile ("wrmsr\n" : : "c" (MSR_SYSENTER_EIP), "a" ((uint32_t)sysenter_handler), "d" (0));
 }
 
 ///
-/// Sets up IDT entry for system calls.
+/// Sets up IDT entry for system calls, and the sysenter entry next to it.
 ///
-/// - side effects: Modifies the IDT.
+/// - side effects: Modifies the IDT and the sysenter MSRs.
 ///
 void syscall_set_idt(void) {
     idt[SYSCALL_ENTRY].present = 0x1;
     idt[SYSCALL_ENTRY].dpl = 0x3;
     SET_IDT_ENTRY(idt[SYSCALL_ENTRY], syscall_handler);
+    sysenter_init();
+}
+
+/* yield_set_idt
+   description: sets idt table entry for the yield vector, which only the kernel may raise
+   input: none
+   output: none
+   return value: none
+   side effect: modifies the IDT
+*/
+void yield_set_idt(void) {
+    idt[YIELD_ENTRY].present = 0x1;
+    SET_IDT_ENTRY(idt[YIELD_ENTRY], int_yield);
+}
+
+
+/* spurious_set_idt
+   description: sets idt table entry for spurious local APIC interrupts, which need no end of interrupt
+   input: none
+   output: none
+   return value: none
+   side effect: modifies the IDT
+*/
+void spurious_set_idt(void) {
+    idt[SPURIOUS_ENTRY].present = 0x1;
+    SET_IDT_ENTRY(idt[SPURIOUS_ENTRY], int_spurious);
 }
 
+
+/* lapic_timer_set_idt
+   description: sets idt table entry for the local APIC timer
+   input: none
+   output: none
+   return value: none
+   side effect: modifies the IDT
+*/
+void lapic_timer_set_idt(void) {
+    idt[LAPIC_TIMER_ENTRY].present = 0x1;
+    SET_IDT_ENTRY(idt[LAPIC_TIMER_ENTRY], int_lapic_timer);
+}
+
+
 /* int_set_idt
    description: sets idt table entry for given irq pin
    input: irq - IRQ pin to set IDT
@@ -0,0 +1,59 @@
+/* acct.h - per-process cpu accounting. the time stamp counter is read each time the cpu enters or leaves the kernel
+   and at every context switch, and the cycles in between go to the running process, split by the mode they were
+   spent in.
+*/
+
+#ifndef _ACCT_H
+#define _ACCT_H
+#include <types.h>
+#include <regs.h>
+
+#define ACCT_USER 0 // running user code
+#define ACCT_SYS 1 // in the kernel on behalf of the process: system calls, page faults, sleeping on a wait queue
+#define ACCT_IRQ 2 // handling a device interrupt that arrived while the process ran
+#define ACCT_IDLE 3 // halted with nothing to run; not charged to any process
+#define NUM_ACCT_PROC 3 // modes counted per process
+
+extern uint64_t idle_cycles; // cycles the cpus spent halted
+
+/* rdtsc
+   description: read the time stamp counter
+   input: none
+   output: none
+   return value: cycles since reset
+   side effect: none
+*/
+static inline uint64_t rdtsc(void) {
+    uint64_t tsc;
+    asm volatile ("rdtsc\n" : "=A" (tsc));
+    return tsc;
+}
+
+/* acct_switch
+   description: charge the cycles since the last accounting point to the current process in the current mode, and go on in the given mode
+   input: mode - mode from now on
+   output: none
+   return value: none
+   side effect: none
+*/
+void acct_switch(uint8_t mode);
+
+/* acct_charge
+   description: charge the cycles since the last accounting point to the current process, and stay in the same mode. called right before the current process changes.
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void acct_charge(void);
+
+/* acct_exit
+   description: accounting point on the way out of the kernel; the cycles from here on count as user or system time depending on where the iret goes
+   input: regs - registers about to be restored
+   output: none
+   return value: none
+   side effect: none
+*/
+extern __attribute__((fastcall)) void acct_exit(struct regs* regs);
+
+#endif
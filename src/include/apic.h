@@ -0,0 +1,98 @@
+/* apic.h - Defines used in interactions with the local APIC of each cpu and the I/O APIC
+   external source: http://wiki.osdev.org/APIC, http://wiki.osdev.org/IOAPIC
+*/
+
+#ifndef _APIC_H
+#define _APIC_H
+
+#include <types.h>
+
+#define APIC_MMIO_BASE 0xFEC00000 // the 4mb page holding both the I/O APIC and the local APICs
+#define LAPIC_DEFAULT_ADDR 0xFEE00000 // local APIC registers, unless relocated
+#define IOAPIC_DEFAULT_ADDR 0xFEC00000 // first I/O APIC registers, unless the MP table says otherwise
+#define MSR_APIC_BASE 0x1B // IA32_APIC_BASE
+#define MSR_APIC_BASE_EN 0x800 // APIC global enable
+#define CPUID_APIC 0x200 // CPUID.1:EDX, on-chip APIC
+
+/* local APIC registers, as offsets from its base */
+#define LAPIC_ID 0x020 // APIC id in bits 31:24
+#define LAPIC_VER 0x030
+#define LAPIC_TPR 0x080 // task priority
+#define LAPIC_EOI 0x0B0
+#define LAPIC_SVR 0x0F0 // spurious interrupt vector
+#define LAPIC_ESR 0x280 // error status
+#define LAPIC_ICR_LO 0x300 // interrupt command
+#define LAPIC_ICR_HI 0x310 // destination APIC id in bits 31:24
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERR 0x370
+#define LAPIC_TIMER_ICR 0x380 // timer initial count
+#define LAPIC_TIMER_CCR 0x390 // timer current count
+#define LAPIC_TIMER_DCR 0x3E0 // timer divide configuration
+
+#define LAPIC_SVR_EN 0x100 // APIC software enable
+#define LAPIC_LVT_MASK 0x10000
+#define LAPIC_DM_NMI 0x400 // delivery mode NMI
+#define LAPIC_DM_EXTINT 0x700 // delivery mode ExtINT, i.e. the 8259 in virtual wire mode
+#define LAPIC_TIMER_DIV16 0x3 // timer counts at a 16th of the bus clock
+#define LAPIC_ICR_INIT 0x500
+#define LAPIC_ICR_STARTUP 0x600
+#define LAPIC_ICR_FIXED 0x000
+#define LAPIC_ICR_PENDING 0x1000 // delivery status
+#define LAPIC_ICR_ASSERT 0x4000
+#define LAPIC_ICR_LEVEL 0x8000
+
+/* I/O APIC registers, reached through an index and a data window */
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WIN 0x10
+#define IOAPIC_REG_VER 0x01 // max redirection entry in bits 23:16
+#define IOAPIC_REG_REDTBL 0x10 // two registers per redirection entry
+#define IOAPIC_RED_MASK 0x10000
+
+extern volatile uint32_t* lapic; // local APIC registers; NULL if the cpu has none
+
+/* lapic_read
+   description: read a local APIC register
+   input: reg - register offset
+   output: none
+   return value: register value
+   side effect: none
+*/
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg >> 2];
+}
+
+
+/* lapic_write
+   description: write a local APIC register, and read the id register back so the write has landed before returning
+   input: reg - register offset
+          val - value to write
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg >> 2] = val;
+    (void)lapic[LAPIC_ID >> 2];
+}
+
+
+/* lapic_id
+   description: get the APIC id of the running cpu
+   input: none
+   output: none
+   return value: APIC id; 0 if there is no local APIC
+   side effect: none
+*/
+static inline uint32_t lapic_id(void) {
+    return (lapic == NULL) ? 0 : lapic_read(LAPIC_ID) >> 24;
+}
+
+int32_t apic_detect(void);
+void lapic_init(int32_t is_bsp);
+void lapic_eoi(void);
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr);
+void ioapic_init(uint32_t addr);
+
+#endif /* _APIC_H */
@@ -11,6 +11,7 @@
 
 #define entry_offset(n) ((n) / BITS_LONG)
 #define BIT_OFFSET(n) ((n) % BITS_LONG)
+#define BITS_LONG_SHIFT 5 // log base 2 of BITS_LONG
 
 #define BITS_TO_LONG(n) \
     ((n + BITS_LONG - 1) / BITS_LONG)
@@ -21,6 +22,16 @@
         (1UL << ((nbits) % BITS_LONG)) - 1 : ~0UL   \
 )
 
+/* two-level bitmap. summary holds one bit per entry of map, set when that entry has no cleared bit, so a search for a free bit can skip 32 full entries with a single word test */
+typedef struct hbitmap_t {
+    uint32_t* map; // underlying bitmap
+    uint32_t* summary; // one bit per entry of map
+    uint32_t num_bits; // number of bits in map
+} hbitmap_t;
+
+#define HBITMAP_SUMMARY_LONG(nbits) \
+    BITS_TO_LONG(BITS_TO_LONG(nbits))
+
 void bitmap_set_bit(uint32_t* bitmap, uint32_t bit);
 void bitmap_clear_bit(uint32_t* bitmap, uint32_t bit);
 uint32_t bitmap_query_bit(const uint32_t* bitmap, uint32_t bit);
@@ -30,6 +41,15 @@ int bitmap_equal(const uint32_t* first, const uint32_t* second, uint32_t num_bit
 int find_free_region(uint32_t* bitmap, uint32_t num_bits, uint32_t order);
 void release_region(uint32_t* bitmap, uint32_t pos, uint32_t order);
 int allocate_region(uint32_t* bitmap, uint32_t pos, uint32_t order);
+uint32_t find_next_zero_bit(const uint32_t* bitmap, uint32_t num_bits, uint32_t start);
+uint32_t find_next_set_bit(const uint32_t* bitmap, uint32_t num_bits, uint32_t start);
+uint32_t find_next_zero_area(const uint32_t* bitmap, uint32_t num_bits, uint32_t start, uint32_t nr);
+void hbitmap_init(hbitmap_t* hb, uint32_t* map, uint32_t* summary, uint32_t num_bits);
+void hbitmap_set_bit(hbitmap_t* hb, uint32_t bit);
+void hbitmap_clear_bit(hbitmap_t* hb, uint32_t bit);
+uint32_t hbitmap_find_next_zero(const hbitmap_t* hb, uint32_t start);
+int hbitmap_alloc_bit(hbitmap_t* hb);
+uint32_t hbitmap_find_zero_area(const hbitmap_t* hb, uint32_t start, uint32_t nr);
 
 
 /* bitmap_clear
@@ -86,4 +106,17 @@ static inline void bitmap_copy(uint32_t* dest, const uint32_t* src, uint32_t num
     }
 }
 
+
+/* find_first_zero_bit
+   description: find the first cleared bit in a bitmap
+   input: bitmap - pointer to the bitmap
+          num_bits - number of bits in the bitmap
+   output: none
+   return value: index of the first cleared bit; num_bits if there is none
+   side effect: none
+*/
+static inline uint32_t find_first_zero_bit(const uint32_t* bitmap, uint32_t num_bits) {
+    return find_next_zero_bit(bitmap, num_bits, 0);
+}
+
 #endif
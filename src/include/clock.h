@@ -0,0 +1,51 @@
+/* clock.h - nanosecond clock from the time stamp counter, and the local APIC timer as a one-shot clock tick
+*/
+
+#ifndef _CLOCK_H
+#define _CLOCK_H
+#include <types.h>
+
+#define NSEC_PER_USEC 1000
+#define NSEC_PER_MSEC 1000000
+#define NSEC_PER_SEC 1000000000
+#define CLOCK_CALIBRATE_US 10000 // length of the pit interval the tsc and the local APIC timer are measured against
+#define TSC_SHIFT 22 // fraction bits of tsc_mult
+#define LAPIC_SHIFT 20 // fraction bits of lapic_mult
+#define CLOCK_REALTIME 0 // wall clock time; there is no source for it yet
+#define CLOCK_MONOTONIC 1 // time since boot
+
+/* time in seconds and nanoseconds, as sys_clock_gettime returns it */
+typedef struct timespec_t {
+    uint32_t tv_sec;
+    uint32_t tv_nsec; // below NSEC_PER_SEC
+} timespec_t;
+
+extern uint32_t tsc_khz; // tsc frequency in khz; 0 until calibrated
+
+/* div_u64_rem
+   description: divide a 64 bit number by a 32 bit one with two divl, since there is no libgcc to do 64 bit division
+   input: n - dividend
+          d - divisor
+          rem - receives the remainder
+   output: none
+   return value: quotient
+   side effect: none
+*/
+static inline uint64_t div_u64_rem(uint64_t n, uint32_t d, uint32_t* rem) {
+    uint32_t hi = (uint32_t)(n >> 32), lo = (uint32_t)n, q_lo, r;
+    uint32_t q_hi = hi / d;
+    r = hi % d; // below d, so the second divl can not overflow
+    asm ("divl %4\n" : "=a" (q_lo), "=d" (r) : "a" (lo), "d" (r), "rm" (d));
+    *rem = r;
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+uint64_t ktime_get(void);
+void ktime_to_timespec(uint64_t ns, timespec_t* ts);
+void clock_init(void);
+int32_t clock_ap_init(void);
+void clock_handler(void);
+void clock_idle_enter(void);
+void clock_idle_exit(void);
+
+#endif
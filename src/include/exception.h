@@ -5,6 +5,11 @@
 #include <idt.h>
 #include <regs.h>
 
+#define EXP_DEVICE_NA 7 // #NM, raised by the first fpu instruction after a switch to a process that does not own the fpu
+#define EXP_PAGE_FAULT 14
+#define EXP_NUM_MASK 0xFF // exceptions that keep their error code store it above the exception number in orig_eax
+#define EXP_ERRCODE_SHIFT 8
+
 typedef void exp_handler(void);
 
 /// This jump table stores pointers to exception handlers.
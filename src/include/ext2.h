@@ -192,7 +192,14 @@ static inline int32_t imode_to_ft(uint16_t i_mode) {
     }
 }
 
-extern void ext2_init(void);
+///
+/// Mounts the EXT2 file system on the IDE device.
+///
+/// - return:
+///     -1 ~ failure, a disk read failed
+///     0  ~ success
+///
+extern int32_t ext2_init(void);
 
 extern file_op_t * ext2_file_fop;
 extern file_op_t * ext2_dir_fop;
@@ -0,0 +1,129 @@
+/* fpu.h - lazy x87/SSE context switching. the fpu registers keep the state of one process, the owner; switching to
+   any other process sets CR0.TS, and that process's first fpu or SSE instruction raises #NM, whose handler saves the
+   owner's state and loads the new one. processes that never touch the fpu never pay for it.
+*/
+
+#ifndef _FPU_H
+#define _FPU_H
+#include <types.h>
+
+#define FPU_AREA_SIZE 512 // fxsave area size
+#define FPU_AREA_ALIGN 16 // fxsave area must be 16-byte aligned
+#define CR0_MP 0x00000002 // monitor coprocessor: wait instructions honour TS
+#define CR0_EM 0x00000004 // emulation: fpu instructions raise #NM unconditionally
+#define CR0_TS 0x00000008 // task switched: next fpu instruction raises #NM
+#define CR0_NE 0x00000020 // report x87 errors as #MF
+#define CR4_OSFXSR 0x00000200 // enable fxsave/fxrstor and SSE
+#define CR4_OSXMMEXCPT 0x00000400 // report unmasked SSE errors as #XF
+#define MXCSR_DEFAULT 0x1F80 // all SSE exceptions masked, round to nearest
+#define CPUID_FXSR 0x01000000 // CPUID.1:EDX, fxsave and fxrstor
+#define CPUID_SSE 0x02000000 // CPUID.1:EDX, SSE
+
+struct pcb_t;
+
+/* FPU_STATE - 16-byte aligned fxsave area inside a pcb */
+#define FPU_STATE(pcb) \
+    ((void* )(((uint32_t)(pcb)->fpu_area + FPU_AREA_ALIGN - 1) & ~(FPU_AREA_ALIGN - 1)))
+
+/* clear CR0.TS */
+static inline void clts(void) {
+    asm volatile ("clts\n");
+}
+
+/* set CR0.TS */
+static inline void stts(void) {
+    asm volatile (
+        "movl %%cr0,%%eax\n"
+        "orl %0,%%eax\n"
+        "movl %%eax,%%cr0\n"
+        :
+        : "i" (CR0_TS)
+        : "eax"
+    );
+}
+
+/* save the fpu and SSE registers to a 16-byte aligned area */
+static inline void fxsave(void* area) {
+    asm volatile ("fxsave (%0)\n" : : "r" (area) : "memory");
+}
+
+/* load the fpu and SSE registers from a 16-byte aligned area */
+static inline void fxrstor(void* area) {
+    asm volatile ("fxrstor (%0)\n" : : "r" (area) : "memory");
+}
+
+/* save the x87 registers, for cpus without fxsave; the fpu is reinitialized afterwards */
+static inline void fnsave(void* area) {
+    asm volatile ("fnsave (%0)\n" : : "r" (area) : "memory");
+}
+
+/* load the x87 registers saved by fnsave */
+static inline void frstor(void* area) {
+    asm volatile ("frstor (%0)\n" : : "r" (area) : "memory");
+}
+
+/* fpu_init
+   description: turn on the fpu, and SSE if the cpu has it, and arm lazy switching; no process owns the fpu yet
+   input: none
+   output: none
+   return value: none
+   side effect: sets CR0 and CR4
+*/
+void fpu_init(void);
+
+/* do_fpu_trap
+   description: #NM handler. hand the fpu to the current process: save the owner's state, and load the current process's, or a clean state on its first use
+   input: none
+   output: none
+   return value: none
+   side effect: clears CR0.TS
+*/
+void do_fpu_trap(void);
+
+/* fpu_switch
+   description: arm lazy switching for the process about to run. called whenever cur_proc_pcb changes.
+   input: next - pcb of the process about to run
+   output: none
+   return value: none
+   side effect: sets or clears CR0.TS
+*/
+void fpu_switch(struct pcb_t* next);
+
+/* fpu_fork
+   description: give a child a copy of its parent's fpu state
+   input: parent - parent pcb
+          child - child pcb
+   output: none
+   return value: none
+   side effect: none
+*/
+void fpu_fork(struct pcb_t* parent, struct pcb_t* child);
+
+/* fpu_release
+   description: forget the fpu state of a process that exits
+   input: pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+void fpu_release(struct pcb_t* pcb);
+
+/* kernel_fpu_begin
+   description: let kernel code use fpu and SSE instructions, e.g. for simd memcpy or aes. the owner's state is saved first. interrupts stay off until kernel_fpu_end, so the section must be short and must not sleep; sections do not nest.
+   input: none
+   output: none
+   return value: none
+   side effect: clears CR0.TS
+*/
+void kernel_fpu_begin(void);
+
+/* kernel_fpu_end
+   description: end a kernel fpu section; the next process to use the fpu reloads its own state
+   input: none
+   output: none
+   return value: none
+   side effect: sets CR0.TS
+*/
+void kernel_fpu_end(void);
+
+#endif
@@ -0,0 +1,33 @@
+/* frame.h - physical page frame allocator */
+
+#ifndef _FRAME_H
+#define _FRAME_H
+#include <types.h>
+#include <system.h>
+#include <multiboot.h>
+
+#define FRAME_SIZE 0x1000 // a physical frame is 4kb
+#define FRAME_SHIFT 12
+#define MAX_PHYS_MEM 0x20000000 // frames are tracked up to 512MB of physical memory
+#define NUM_FRAMES (MAX_PHYS_MEM / FRAME_SIZE)
+#define FRAME_RESERVED_BOT 0x2800000 // physical memory below 40MB is laid out statically (kernel, process pages, history page)
+#define MMAP_AVAILABLE 1 // memory map entry type for usable ram
+
+#define PHYS_TO_FRAME(addr) ((addr) >> FRAME_SHIFT)
+#define FRAME_TO_PHYS(idx) ((idx) << FRAME_SHIFT)
+
+/* struct for frame usage */
+typedef struct frame_info_t {
+    uint32_t total; // number of frames that can be handed out
+    uint32_t used; // number of frames handed out
+} frame_info_t;
+
+extern frame_info_t frame_info;
+
+void frame_init(multiboot_info_t* mbi);
+uint32_t frame_alloc(void);
+void frame_get(uint32_t phys_addr);
+uint32_t frame_ref_count(uint32_t phys_addr);
+void frame_free(uint32_t phys_addr);
+
+#endif
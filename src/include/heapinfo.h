@@ -0,0 +1,54 @@
+/* heapinfo.h - kernel heap statistics and the read-only "heapinfo" file */
+
+#ifndef _HEAPINFO_H
+#define _HEAPINFO_H
+#include <types.h>
+#include <vfs.h>
+#include <mem.h>
+#include <slab.h>
+
+#define ALLOC_SITE_NUM 32 // call sites tracked; allocations from further sites are only counted in site_overflow
+#define ALLOC_CLASS_NUM (NUM_SLAB_CACHE + MAX_ORDER + 1) // slab size classes first, then page orders 0 to MAX_ORDER
+#define HEAPINFO_BUF_SIZE 4096 // size of a text snapshot of the statistics
+#define FRAG_SCALE 1000 // fragmentation index is given in thousandths
+
+#define SLAB_CLASS(cache) \
+    ((uint32_t)((cache) - kmalloc_caches))
+
+#define ORDER_CLASS(order) \
+    (NUM_SLAB_CACHE + (order))
+
+/* allocation counters of one size class */
+typedef struct alloc_class_t {
+    uint32_t allocs; // allocations served so far
+    uint32_t inuse; // objects currently allocated
+    uint32_t peak; // high-water mark of inuse
+} alloc_class_t;
+
+/* allocation counters of one call site */
+typedef struct alloc_site_t {
+    uint32_t caller; // return address of the malloc, calloc or realloc call; 0 if the slot is unused
+    uint32_t allocs; // successful allocations
+    uint32_t fails; // failed allocations
+    uint32_t bytes; // bytes requested by successful allocations
+} alloc_site_t;
+
+/* heap statistics beyond alloc_info */
+typedef struct alloc_stat_t {
+    alloc_class_t cls[ALLOC_CLASS_NUM];
+    alloc_site_t site[ALLOC_SITE_NUM];
+    uint32_t site_overflow; // allocations from call sites that did not fit the table
+} alloc_stat_t;
+
+extern alloc_stat_t alloc_stat;
+extern file_op_t* heapinfo_fop;
+
+void heapinfo_init(void);
+void heapinfo_class_alloc(uint32_t cls);
+void heapinfo_class_free(uint32_t cls);
+void heapinfo_site(uint32_t caller, uint32_t size, void* ptr);
+uint32_t heap_largest_free_order(void);
+uint32_t heap_free_pages(void);
+uint32_t heap_frag_index(void);
+
+#endif
@@ -5,8 +5,15 @@ extern void idt_init(void);
 extern void exp_set_idt(void);
 extern void int_set_idt(int irq);
 extern void syscall_set_idt(void);
+extern void yield_set_idt(void);
+extern void spurious_set_idt(void);
+extern void lapic_timer_set_idt(void);
+extern void sysenter_init(void);
 
 #define INT_TABLE_SIZE 16
 #define EXP_TABLE_SIZE 20
+#define YIELD_ENTRY 0x81 // kernel-only vector a process raises to give up the cpu
+#define SPURIOUS_ENTRY 0xFF // vector the local APICs deliver spurious interrupts on
+#define LAPIC_TIMER_ENTRY 0xF0 // vector of the local APIC timer
 
 #endif /* idt.h */
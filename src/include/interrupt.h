@@ -9,6 +9,15 @@
 /// This table stores pointers to interrupt handlers.
 extern uint32_t int_table [INT_TABLE_SIZE];
 
+/// Entry of the yield vector. Goes through the same path as device interrupts.
+extern void int_yield(void);
+
+/// Entry of the local APIC timer vector.
+extern void int_lapic_timer(void);
+
+/// Entry of the spurious local APIC vector.
+extern void int_spurious(void);
+
 /// Handles an interrupt. Uses fastcall calling convention.
 extern __attribute__((fastcall)) void do_irq(struct regs *regs);
 
@@ -6,23 +6,38 @@
 #define _MEM_H
 #include <types.h>
 #include <system.h>
+#include <list.h>
+#include <spinlock.h>
 
-#define HEAP_ENTRY 1024 // there are 1024 entries in the 4mb heap page
-#define HEAP_BITMAP_ENTRY (HEAP_ENTRY / BITS_LONG) // bitmap for heap has 32 entries
+#define HEAP_ENTRY (HEAP_SIZE / HEAP_PAGE_SIZE) // one entry per 4kb page of the heap window
 #define HEAP_PAGE_SIZE 0x1000 // heap page size is 4kb
-#define MAX_HEAP_ENTRY 32 // at most 32 contiguous pages can be allocated for a object
+#define MAX_HEAP_ENTRY ORDER_TO_SIZE(MAX_ORDER) // at most 1024 contiguous pages (4mb) can be allocated for a object
 #define HEAP_HEADER_SIZE LONG_SIZE // heap header size is 4 bytes
-#define HEAP_PHYS_BOT (HEAP_PHYS_TOP + HEAP_SIZE) // heap physical bottom address
+#define HEAP_PHYS_BOT (HEAP_PHYS_TOP + HEAP_PHYS_SIZE) // legacy heap physical bottom address
 #define HEAP_VIRT_BOT (HEAP_VIRT_TOP + HEAP_SIZE) // heap virtual bottom address
+#define MAX_ORDER 10 // largest buddy block is 1024 pages, one page table. HEAP_ENTRY must be a multiple of it
+#define BUDDY_NOT_FREE 0xFF // page does not start a free buddy block
 
 /* struct for heap management  */
 typedef struct alloc_t {
     uint32_t page_alloc; // number of pages allocated
     uint32_t obj_alloc; // number of objects allocated
+    uint32_t page_peak; // high-water mark of page_alloc
+    uint32_t obj_peak; // high-water mark of obj_alloc
+    uint32_t fail_alloc; // number of allocations that ran out of memory
 } __attribute__((packed)) alloc_t;
 
+/* free list of buddy blocks of one order */
+typedef struct free_area_t {
+    list_head free_list; // free blocks of this order
+    uint32_t nr_free; // number of blocks on the list
+} free_area_t;
+
 extern alloc_t alloc_info; // a global instance of the struct
-extern uint32_t heap_map[HEAP_BITMAP_ENTRY]; // heap bitmap
+extern free_area_t free_area[MAX_ORDER + 1];
+extern list_head buddy_node[HEAP_ENTRY];
+extern uint8_t buddy_order[HEAP_ENTRY];
+extern ticketlock_t heap_lock; // guards the buddy free lists and the page counts
 
 #define REQ_PAGE_NUM(size) ((size) / HEAP_PAGE_SIZE)
 #define REQ_SIZE_OFFSET(size) ((size) % HEAP_PAGE_SIZE)
@@ -31,9 +46,6 @@ extern uint32_t heap_map[HEAP_BITMAP_ENTRY]; // heap bitmap
 #define HEAP_VIRT_ADDR(idx) \
     (HEAP_VIRT_TOP + (idx) * HEAP_PAGE_SIZE)
 
-#define HEAP_PHYS_ADDR(idx) \
-    (HEAP_PHYS_TOP + (idx) * HEAP_PAGE_SIZE)
-
 #define HEAP_PAGE_TO_DATA(addr) \
     ((addr) + LONG_SIZE)
 
@@ -43,19 +55,27 @@ extern uint32_t heap_map[HEAP_BITMAP_ENTRY]; // heap bitmap
 #define PAGE_PTR_TO_IDX(addr) \
     (((addr) - HEAP_VIRT_TOP) / HEAP_PAGE_SIZE)
 
+#define BUDDY_NODE_TO_IDX(node) \
+    ((uint32_t)((node) - buddy_node))
+
 /* private functions vibsible to this file */
 int alloc_request_order(uint32_t size);
 uint32_t create_heap_pages(int start_idx, int num_pages);
-void destroy_heap_pagess(int start_idx, int num_pages);
+void destroy_heap_pages(int start_idx, int num_pages);
+int buddy_alloc(uint32_t order);
+void buddy_free(uint32_t idx, uint32_t order);
 uint32_t alloc_request_pages(uint32_t size);
 void free_request_pages(uint32_t start_idx, uint32_t size);
 void* __alloc(uint32_t size);
+extern void* alloc_pages(uint32_t order);
+extern void free_pages(void* addr, uint32_t order);
 void __free(void* ptr);
 extern void* malloc(uint32_t size);
 extern void* calloc(uint32_t size);
 extern void* realloc(void* ptr, uint32_t size);
 extern void free(void* ptr);
 extern uint32_t malloc_info(void* ptr);
+extern uint32_t malloc_usable_size(void* ptr);
 extern void heap_init(void);
 
 /* request_size_raw
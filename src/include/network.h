@@ -80,6 +80,8 @@
 #define RCTL_BSIZE_8192                 ((2 << 16) | (1 << 25))
 #define RCTL_BSIZE_16384                ((1 << 16) | (1 << 25))
 
+#define PACKAGE_BUF_SIZE                2048        // received frames are at most one RCTL_BSIZE_2048 buffer
+
 
 // Transmit Command
 
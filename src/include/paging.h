@@ -9,6 +9,7 @@
 
 #include <types.h>
 #include <system.h>
+#include <smp.h>
 
 #define NUM_PDE 1024
 #define NUM_PTE 1024
@@ -17,9 +18,27 @@
 #define EN_P 0x00000001 // set present flag, bit 0, indicates page is loaded in physical memory
 #define EN_RW 0x00000002 // set read/write flag, bit 1, specifies read-write privileges
 #define EN_US 0x00000004 // set user/supervisor flag, bit 2, specifies user privilege level
+#define EN_PWT 0x00000008 // page-level write-through flag, bit 3
+#define EN_PCD 0x00000010 // page-level cache disable flag, bit 4, for memory-mapped device registers
 #define EN_PS 0x00000080 // page size flag, bit 7, set 4mb page
 #define EN_A 0x00000020 // set accessed flag, bit 5
+#define EN_G 0x00000100 // set global flag, bit 8, entry is kept in the tlb across cr3 reloads
+#define TLB_BATCH_MAX 16 // past this many pages a batch does one full flush instead of invlpg per page
+#define EN_COW 0x00000200 // available bit 9, a read-only user page that is shared copy-on-write
 #define UTIL_ADDR 0x0 // utility page uses 0x0
+#define KMAP_ADDR 0x3FF000 // scratch page used to fill frames that have no kernel mapping
+#define HEAP_PDE_NUM (HEAP_SIZE / PROG_PAGE_SIZE) // number of page tables covering the heap window
+
+#define HEAP_TABLE_IDX(virt) \
+    (((virt) - HEAP_VIRT_TOP) >> 22)
+
+/* pending tlb invalidations */
+typedef struct tlb_batch_t {
+    uint32_t depth; // nesting level of tlb_batch_begin
+    uint32_t flags; // interrupt flags saved by the outermost tlb_batch_begin
+    uint32_t nr; // number of addresses recorded
+    uint32_t addr[TLB_BATCH_MAX]; // virtual addresses to invalidate
+} tlb_batch_t;
 
 /// The page directory.
 extern uint32_t page_directory [NUM_PDE];
@@ -27,13 +46,26 @@ extern uint32_t page_directory [NUM_PDE];
 /// The page table that covers the first 4MB of memory.
 extern uint32_t first_page_table [NUM_PTE];
 
+/// The page directory currently loaded in CR3 of the running cpu.
+#define cur_pgdir (this_cpu()->pgdir)
+
 extern void map_virtual_4mb(uint32_t phys_start, uint32_t virt_start);
+extern void map_mmio_4mb(uint32_t phys_start);
 extern void map_virtual_4kb_first(uint32_t phys_start, uint32_t virt_start);
-extern void map_virtual_4kb_prog(uint32_t phys_start, uint32_t virt_start);
+extern void map_virtual_4kb_prog(uint32_t pid, uint32_t phys_start, uint32_t virt_start);
+extern void pgdir_init(uint32_t pid);
+extern void switch_pgdir(uint32_t pid);
+extern void switch_kernel_pgdir(void);
+extern void load_pgdir(uint32_t pgdir_phys);
 extern void set_virtual_4mb_heap(uint32_t virt_start);
 extern void set_virtual_4kb_heap(uint32_t phys_start, uint32_t virt_start);
 extern void free_virtual_4kb_heap(uint32_t virt_start);
+extern uint32_t heap_virt_to_phys(uint32_t virt_addr);
 extern void flush_tlb(void);
+extern void flush_tlb_global(void);
+extern void tlb_batch_begin(void);
+extern void tlb_batch_add(uint32_t virt_addr);
+extern void tlb_batch_flush(void);
 extern void setup_utility_page(void);
 
 /// Fills the first page table such that all flags of all PTEs are cleared,
@@ -59,4 +91,15 @@ extern void setup_modex_page(void);
 /// Setup paging
 extern void setup_paging(void);
 
+/* invlpg
+   description: invalidate the tlb entry of a single page
+   input: virt_addr - virtual address within the page
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void invlpg(uint32_t virt_addr) {
+    asm volatile ("invlpg (%0)" : : "r" (virt_addr) : "memory");
+}
+
 #endif
@@ -18,9 +18,11 @@
 #define PIT_MIN_FREQ 18 // min frequency
 #define PIT_MIN_DIV 65535 // min divisor is 65535
 #define MS_FREQ 1000 // frequency for a per-milisecond ticking is 1000
+#define MS_DIV (PIT_MAX_FREQ / MS_FREQ) // channel 0 counts down from this every millisecond
 
 uint16_t pit_read_freq(void);
 void pit_set_freq(uint32_t freq);
+void pit_udelay(uint32_t us);
 extern void pit_init(void);
 extern void pit_handler(void);
 
@@ -5,22 +5,33 @@
 #include <vfs.h>
 #include <list.h>
 #include <system.h>
+#include <time.h>
+#include <acct.h>
+#include <fpu.h>
+#include <spinlock.h>
+#include <smp.h>
 
 #define SIG_COUNT 6 // only 5 signals are supported
 #define MAX_OPEN_FILES 8
 #define KSTACK_SIZE 0x2000 // kernel stack for each program is 8kb
-#define NUM_PROC 6 // support 6 processes
+#define KSTACK_ORDER 1 // a kernel stack is a block of 2 heap pages, aligned to its size
+#define NUM_PROC 64 // size of the pid space; pcbs, kernel stacks and page tables are allocated as processes are created
 #define PCB_MASK 0xFFFFE000 // filters out lower 13 bits
 #define KERNEL_BOT (KERNEL_TOP + KERNEL_SIZE) // end of kernel page
 #define CMD_WORD_SIZE 4 // command word size for both file specifier and entry point is 4
 #define ENTRY_POINT_POS 24
 #define ARG_WORD_SIZE 128 // keyboard buffer has size 128
 
-#define INACTIVE 0 // the session is not initialized
-#define ACTIVE 1 // the session is currently active
-#define DAEMON 2 // the session is switched to background
-#define PENDING 3 // the session is initialized as a placeholder
-#define IDLE 4 // the session is not active
+#define INACTIVE 0 // the pcb is not in use
+#define ACTIVE 1 // the process is running
+#define RUNNABLE 2 // the process waits in the run queue
+#define PENDING 3 // the shell of a session awaits loading; waits in the run queue like a runnable process
+#define BLOCKED 4 // the process waits on something other than the cpu, e.g. a parent on its child or a reader on a wait queue
+#define ZOMBIE 5 // the process has exited; its pid, pcb and kernel stack are released once nothing runs on that stack
+#define NUM_PROC_STATE 6
+
+#define STATE_QUEUED(state) \
+    ((state) == RUNNABLE || (state) == PENDING)
 
 typedef struct sa_hand {
     uint32_t sa_handler;
@@ -33,7 +44,7 @@ typedef struct pcb_t {
     uint32_t parent_pid; // pid for its parent process
     file_t fd_array[MAX_OPEN_FILES]; // process-specific file descriptor
     uint32_t fd_bitmap; // Indicates which files are available (0 for available).
-    uint32_t parent_esp; // esp for parent process
+    uint32_t parent_esp; // esp for parent process; 0 for a forked process, whose parent does not wait on it
     uint32_t kernel_esp; // kernel esp loadpoint for current process
     uint32_t kernel_ebp; // kernel ebp loadpoint for current process
     int8_t command[ARG_WORD_SIZE]; // command field relative to this process
@@ -41,18 +52,39 @@ typedef struct pcb_t {
     uint32_t uptime; // uptime of this process
     uint32_t active_sess; // active session id;
     uint32_t prog_break; // program break
+    inode_t prog_inode; // inode of the program image, pages are read from it on demand
+    uint32_t mmap_map[USER_MMAP_PAGES / BITS_LONG]; // pages taken by anonymous mappings, counted down from the stack
     struct sa_hand sighand[SIG_COUNT]; // signal handler descriptor
     struct list_head sigpending; // a list of pending signals
+    struct list_head run_node; // link in the run queue while runnable or pending, in the zombie list once exited
+    struct list_head wait_node; // link in a wait queue while sleeping on one; points to itself otherwise
+    uint32_t* pgdir; // page directory of the process
+    uint32_t* user_table; // page table of the user region, filled in on demand
+    uint32_t* prog_table; // page table of the video memory pages
+    timer_t alarm; // raises ALARM at the process when it fires, see sys_alarm
+    uint8_t nice; // base priority level, see sys_setpriority; the process never runs above it
+    uint8_t level; // current priority level, from nice down to the lowest
+    uint32_t slice; // time left in the current time slice in ms
+    uint64_t acct[NUM_ACCT_PROC]; // cycles spent in user, system and interrupt mode, see acct.h
+    uint8_t fpu_used; // whether fpu_area holds a state; a process starts with a clean fpu on its first fpu instruction
+    uint8_t fpu_area[FPU_AREA_SIZE + FPU_AREA_ALIGN - 1]; // fpu and SSE state while another process owns the fpu, see FPU_STATE
+    uint32_t ring; // user address of the submission and completion rings, see ring.h; 0 if none
+    uint32_t ring_entries; // length of each ring queue
+    uint32_t cpu; // cpu whose run queue the process waits in; the one it runs or last ran on
+    uint32_t lock_depth; // kernel lock nesting of its cpu while it is switched out, see lock_kernel
 } __attribute__((packed)) pcb_t;
 
 /* NOTE: the memory occupied by a union will be large enough to hold the largest member of the union, so struct has size 0x2000 aka. 8kb */
 typedef union proc_stack {
     pcb_t pcb; // pcb struct stays at the top
-    uint32_t stack[KSTACK_SIZE]; // kernel stack space builds bottom-up
+    uint8_t stack[KSTACK_SIZE]; // kernel stack space builds bottom-up
 } proc_stack;
 
-extern pcb_t* cur_proc_pcb; // pointer to pcb of the current process
+#define cur_proc_pcb (this_cpu()->cur_pcb) // pointer to pcb of the process running on this cpu
+extern pcb_t* proc_table[NUM_PROC]; // pcb of each pid; NULL while the pid is free
 extern uint8_t proc_status[NUM_PROC]; // status for each process
+extern uint32_t proc_state_cnt[NUM_PROC_STATE]; // number of processes in each state
+extern rwlock_t proc_lock; // guards proc_table, pids, process states and the run queues
 
 /* functions private to this file */
 
@@ -75,11 +107,29 @@ void file_io_init(int8_t * fin, int8_t * fout);
    description: return pcb pointer of a process specified by its pid.
    input: pid - pid of the process
    output: none
-   return value: target pcb pointer
+   return value: target pcb pointer; NULL if no process has that pid
    side effect: none
 */
 pcb_t* get_pcb_by_pid(uint32_t pid);
 
+/* proc_alloc
+   description: create a process: take a free pid, and allocate its pcb and kernel stack and its paging structures
+   input: none
+   output: none
+   return value: pcb of the process, in state INACTIVE; NULL if out of pids or memory
+   side effect: releases exited processes first
+*/
+pcb_t* proc_alloc(void);
+
+/* proc_reap
+   description: release every exited process that is no longer running on its kernel stack
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void proc_reap(void);
+
 /* get_esp0_by_pid
    description: return starting esp (esp0) for a given pid; used by tss
    input: pid - pid of the process
@@ -89,6 +139,15 @@ pcb_t* get_pcb_by_pid(uint32_t pid);
 */
 uint32_t get_esp0_by_pid(uint32_t pid);
 
+/* proc_vidmap_update
+   description: point a process's video memory page at the screen if its session is the active one, or at its session's cached video memory otherwise
+   input: cur_pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: Modifies the process's page table
+*/
+void proc_vidmap_update(pcb_t* cur_pcb);
+
 /* get_cur_pcb
    description: get current pcb based on its %esp, since each process has a ordered stack layout in kernel stack.
    input: none
@@ -107,15 +166,6 @@ pcb_t* get_cur_pcb(void);
 */
 pcb_t* get_parent_pcb(pcb_t* cur_pcb);
 
-/* get_phys_addr_by_pid
-   description: get physical address of a process by its pid; processes are loaded in memory by after kernel space (4mb - 8mb) by pid
-   input: pid - pid of the porcess
-   output: none
-   return value: starting physical address
-   side effect: none
-*/
-uint32_t get_phys_addr_by_pid(uint32_t pid);
-
 /* parse_cmd
    description: parse the command and output it
    input: src - command passed into the function
@@ -149,6 +199,35 @@ void parse_arg(const int8_t* src, pcb_t* cur_pcb, int8_t * fout, uint32_t start_
 ///
 void fd_array_init(void);
 
+/* fd_array_dup
+   description: give a child a copy of its parent's file descriptors
+   input: parent_pcb - parent pcb pointer
+          child_pcb - child pcb pointer
+   output: none
+   return value: 0 if success; -1 if out of memory
+   side effect: none
+*/
+int32_t fd_array_dup(pcb_t* parent_pcb, pcb_t* child_pcb);
+
+/* fd_array_close
+   description: close every file a process has open
+   input: pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+void fd_array_close(pcb_t* pcb);
+
+/* proc_set_state
+   description: move a process to a new state, keeping the run queue and the per-state counts in step
+   input: pcb - pcb of the process
+          state - new runtime status of the process
+   output: none
+   return value: none
+   side effect: may add the process to or remove it from the run queue
+*/
+void proc_set_state(pcb_t* pcb, uint8_t state);
+
 /* query_proc_status
    description: query how many process have the specified status
    input: status - runtime status of the process
@@ -156,17 +235,20 @@ void fd_array_init(void);
    return value: number of processes with the given status
    side effect: none
 */
-uint32_t query_proc_status(uint8_t status);
+static inline uint32_t query_proc_status(uint8_t status) {
+    return proc_state_cnt[status];
+}
 
-/* get_next_pid
-   description: get next process's pid given current pid and status of target process
-   input: cur_pid - current pid
-          status - runtime status of the process
+/* proc_running
+   description: check whether a process is the current process of its cpu, whose kernel stack is then in use
+   input: pcb - pcb of the process
    output: none
-   return value: next available process's pid
+   return value: 1 if it is; 0 otherwise
    side effect: none
 */
-uint32_t get_next_pid(uint32_t cur_pid, uint8_t status);
+static inline int32_t proc_running(pcb_t* pcb) {
+    return cpus[pcb->cpu].cur_pcb == pcb;
+}
 
 /* child_pcb_init
    description: initialize a child pcb given its parent pcb pointer. 
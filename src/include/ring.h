@@ -0,0 +1,59 @@
+/* ring.h - submission and completion rings shared between a process and the kernel, so a batch of file operations
+   costs one system call instead of one each. Layout of the shared region, at the address sys_ring_setup returns:
++-------------+---------------------+---------------------+
+| ring_t      | ring_sqe_t[entries] | ring_cqe_t[entries] |
++-------------+---------------------+---------------------+
+   head and tail count up forever and are masked with entries - 1 to index a queue. The program fills submissions at
+   sq_tail and takes completions at cq_head; the kernel takes submissions at sq_head and fills completions at cq_tail.
+*/
+
+#ifndef _RING_H
+#define _RING_H
+#include <types.h>
+
+#define RING_MAX_ENTRIES 256 // longest queue a process may ask for
+#define RING_OP_NOP 0 // completes with 0, to test the ring
+#define RING_OP_READ 1 // sys_read(fd, addr, len)
+#define RING_OP_WRITE 2 // sys_write(fd, addr, len)
+#define RING_OP_OPEN 3 // sys_open(addr), the completion holds the fd
+#define RING_OP_CLOSE 4 // sys_close(fd)
+#define RING_OP_SEEK 5 // sys_seek(fd, len, whence)
+
+/* a file operation submitted by the program */
+typedef struct ring_sqe_t {
+    uint32_t opcode; // RING_OP_*
+    uint32_t fd;
+    uint32_t addr; // buffer, or file name for RING_OP_OPEN
+    uint32_t len; // number of bytes, or offset for RING_OP_SEEK
+    uint32_t whence; // for RING_OP_SEEK
+    uint32_t user_data; // handed back in the completion
+} ring_sqe_t;
+
+/* result of a submitted operation, in the order they were taken */
+typedef struct ring_cqe_t {
+    uint32_t user_data; // user_data of the submission
+    int32_t res; // what the system call would have returned
+} ring_cqe_t;
+
+/* header of the shared region */
+typedef struct ring_t {
+    volatile uint32_t sq_head; // written by the kernel
+    volatile uint32_t sq_tail; // written by the program
+    volatile uint32_t cq_head; // written by the program
+    volatile uint32_t cq_tail; // written by the kernel
+    uint32_t entries; // length of each queue, a power of two; only informative, the kernel keeps its own copy
+} ring_t;
+
+#define RING_SQES(ring) \
+    ((ring_sqe_t* )((ring) + 1))
+
+#define RING_CQES(ring, entries) \
+    ((ring_cqe_t* )(RING_SQES(ring) + (entries)))
+
+#define RING_SIZE(entries) \
+    (sizeof(ring_t) + (entries) * (sizeof(ring_sqe_t) + sizeof(ring_cqe_t)))
+
+int32_t ring_setup(uint32_t entries);
+int32_t ring_enter(uint32_t to_submit);
+
+#endif
@@ -5,10 +5,82 @@
 #ifndef _SCHED_H
 #define _SCHED_H
 #include <types.h>
+#include <list.h>
+#include <proc.h>
+#include <idt.h>
+#include <bitops.h>
+#include <smp.h>
 
-#define TIME_QUANTUM 30 // time quantum is 20 ms
+#define SCHED_LEVELS 4 // number of priority levels, 0 is the highest; run_queue in sched.c has one entry per level
+#define SCHED_BASE_SLICE 10 // time slice at the highest level in ms
+#define SCHED_SLICE(level) (SCHED_BASE_SLICE << (level)) // each level gets twice the time slice of the one above
+#define SCHED_BOOST_PERIOD 1000 // every this many ms all processes go back to their base level, so none starves
+#define SCHED_BALANCE_PERIOD 100 // every this many ms a cpu pulls a process from a cpu with a longer run queue
+
+extern list_head run_queue[MAX_CPUS][SCHED_LEVELS]; // runnable and pending processes of each cpu and level, in the order they will run
+extern uint32_t run_map[MAX_CPUS]; // bit i of entry c is set while run_queue[c][i] is not empty
+extern uint32_t run_count[MAX_CPUS]; // number of processes in the run queues of each cpu
 
 uint32_t load_shell_img(uint32_t cur_pid);
 extern void do_sched(void);
+void sched_idle(void);
+void sched_tick(void);
+void sched_set_level(pcb_t* pcb, uint8_t level);
+void sched_ap_loop(void);
+
+/* sched_enqueue
+   description: put a process at the back of the run queue of its level on its cpu, and wake that cpu up if it idles
+   input: pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void sched_enqueue(pcb_t* pcb) {
+    list_insert_before(&(pcb->run_node), &run_queue[pcb->cpu][pcb->level]);
+    run_map[pcb->cpu] |= 1 << pcb->level;
+    run_count[pcb->cpu]++;
+    smp_kick(pcb->cpu);
+}
+
+
+/* sched_first
+   description: find the process at the head of the highest non-empty level of the running cpu
+   input: none
+   output: none
+   return value: pcb of the process; NULL if no process can run
+   side effect: none
+*/
+static inline pcb_t* sched_first(void) {
+    uint32_t cpu = smp_cpu_id();
+    if (run_map[cpu] == 0) return NULL;
+    return LIST_FIRST_ENTRY(&run_queue[cpu][ffs(run_map[cpu]) - 1], pcb_t, run_node);
+}
+
+
+/* sched_yield
+   description: give up the cpu to the process at the head of the run queue. it goes through the yield vector, so the current process is saved like a preempted one and resumes here; if nothing else can run, it returns right away.
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void sched_yield(void) {
+    asm volatile ("int %0" : : "i"(YIELD_ENTRY) : "memory");
+}
+
+
+/* sched_dequeue
+   description: take a process out of the run queue of its level on its cpu
+   input: pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void sched_dequeue(pcb_t* pcb) {
+    list_delete(&(pcb->run_node));
+    if (list_is_empty(&run_queue[pcb->cpu][pcb->level]))
+        run_map[pcb->cpu] &= ~(1 << pcb->level);
+    run_count[pcb->cpu]--;
+}
 
 #endif
@@ -76,6 +76,16 @@ void handle_signal(ksignal* ksig, struct regs* regs);
 extern __attribute__((fastcall)) void do_signal(struct regs *regs);
 extern void proc_signal_init(pcb_t* cur_pcb);
 
+/**
+ * signal_pending - test whether a process has signals waiting to be handled
+ * @param pcb - pcb of the process
+ * @return - 1 if a signal is pending; 0 if not
+ */
+static inline int signal_pending(pcb_t* pcb) {
+    return !list_is_empty(&(pcb->sigpending));
+}
+
+
 /**
  * sig_enqueue - enqueue a pending signal handler
  * @param node - sigaction node to insert
@@ -0,0 +1,56 @@
+/* slab.h - size-class object caches layered on top of the heap page allocator */
+
+#ifndef _SLAB_H
+#define _SLAB_H
+#include <types.h>
+#include <list.h>
+#include <mem.h>
+#include <spinlock.h>
+
+#define SLAB_MIN_SHIFT 4 // smallest size class is 16 bytes
+#define SLAB_MAX_SHIFT 11 // largest size class is 2kb
+#define SLAB_MIN_SIZE (1 << SLAB_MIN_SHIFT)
+#define SLAB_MAX_SIZE (1 << SLAB_MAX_SHIFT)
+#define NUM_SLAB_CACHE (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1) // 16, 32, ..., 2048 bytes
+#define SLAB_PAGE_MASK (~(HEAP_PAGE_SIZE - 1))
+
+/* descriptor of a single heap page carved into equally sized objects. descriptors live off-page, indexed by heap page index, so the whole page is usable for objects */
+typedef struct slab_t {
+    struct kmem_cache_t* cache; // owning cache; NULL if this heap page is not a slab
+    void* free_list; // singly linked list of free objects, link is stored in the object itself
+    uint32_t inuse; // number of objects handed out from this slab
+    list_head node; // link in the owning cache's partial list
+} slab_t;
+
+/* a cache of objects of one size class */
+typedef struct kmem_cache_t {
+    uint32_t obj_size; // size of each object in bytes
+    uint32_t obj_per_slab; // number of objects in a slab page
+    uint32_t num_slabs; // number of slab pages currently owned
+    list_head partial; // slabs with at least one free object
+    spinlock_t lock; // guards the partial list and the slabs of the cache
+} kmem_cache_t;
+
+extern kmem_cache_t kmalloc_caches[NUM_SLAB_CACHE];
+extern slab_t slab_desc[HEAP_ENTRY];
+
+void slab_init(void);
+kmem_cache_t* kmem_cache_select(uint32_t size);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(void* obj);
+uint32_t kmem_cache_obj_size(void* obj);
+
+
+/* virt_to_slab
+   description: get the slab descriptor that owns a heap address
+   input: obj - pointer into the heap
+   output: none
+   return value: slab descriptor if the page is a slab; NULL otherwise
+   side effect: none
+*/
+static inline slab_t* virt_to_slab(void* obj) {
+    slab_t* slab = &slab_desc[PAGE_PTR_TO_IDX((uint32_t)obj & SLAB_PAGE_MASK)];
+    return (slab->cache != NULL) ? slab : NULL;
+}
+
+#endif
@@ -0,0 +1,143 @@
+/* smp.h - Defines used to find and start the application processors, and the per-cpu data
+   external source: Intel MultiProcessor Specification 1.4, http://wiki.osdev.org/SMP
+*/
+
+#ifndef _SMP_H
+#define _SMP_H
+
+#define MAX_CPUS 8 // cpus beyond this many are left in reset
+#define AP_TRAMPOLINE_ADDR 0x7000 // page the application processors start in, below 1mb and 4kb aligned
+#define AP_STACK_SIZE 4096 // kernel stack of each application processor
+#define GDT_ENTRIES 8 // descriptors in the gdt of x86_desc.S, the last one is KERNEL_LDT
+#define AP_TSS_SEL(idx) ((GDT_ENTRIES + (idx)) << 3) // tss selector of an application processor, past the shared entries
+
+#ifndef ASM
+
+#include <types.h>
+#include <x86_desc.h>
+
+#define MP_FPS_SIG 0x5F504D5F // "_MP_"
+#define MP_CONF_SIG 0x504D4350 // "PCMP"
+#define EBDA_SEG_PTR 0x40E // bios data area word holding the segment of the extended bios data area
+#define BASE_MEM_TOP 0x9FC00 // last kb of base memory, searched when there is no ebda
+#define BIOS_ROM_BASE 0xF0000 // bios rom, searched last
+#define BIOS_ROM_TOP 0x100000
+#define MP_ENT_PROC 0 // processor entry, 20 bytes
+#define MP_ENT_IOAPIC 2 // I/O APIC entry, 8 bytes
+#define MP_ENT_SIZE 8 // size of every entry other than a processor entry
+#define MP_PROC_EN 0x1 // processor is usable
+#define MP_PROC_BSP 0x2 // processor is the boot processor
+#define INIT_DELAY_US 10000 // wait after the INIT IPI
+#define SIPI_DELAY_US 200 // wait after each startup IPI
+#define AP_BOOT_TIMEOUT_US 100000 // give up on an AP that is not online by then
+
+/* MP floating pointer structure */
+typedef struct mp_fps_t {
+    uint32_t sig; // "_MP_"
+    uint32_t conf; // physical address of the configuration table
+    uint8_t length; // in 16 byte units
+    uint8_t rev;
+    uint8_t checksum; // all bytes sum to 0
+    uint8_t feature[5];
+} __attribute__((packed)) mp_fps_t;
+
+/* MP configuration table header, followed by count entries */
+typedef struct mp_conf_t {
+    uint32_t sig; // "PCMP"
+    uint16_t length; // base table length, header included
+    uint8_t rev;
+    uint8_t checksum; // all bytes of the base table sum to 0
+    char oem[8];
+    char product[12];
+    uint32_t oem_table;
+    uint16_t oem_length;
+    uint16_t count; // number of entries
+    uint32_t lapic_addr; // physical address of the local APICs
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__((packed)) mp_conf_t;
+
+/* MP configuration table processor entry */
+typedef struct mp_proc_t {
+    uint8_t type; // MP_ENT_PROC
+    uint8_t apic_id;
+    uint8_t apic_ver;
+    uint8_t flags; // MP_PROC_EN, MP_PROC_BSP
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__((packed)) mp_proc_t;
+
+/* MP configuration table I/O APIC entry */
+typedef struct mp_ioapic_t {
+    uint8_t type; // MP_ENT_IOAPIC
+    uint8_t apic_id;
+    uint8_t apic_ver;
+    uint8_t flags;
+    uint32_t addr; // physical address of its registers
+} __attribute__((packed)) mp_ioapic_t;
+
+struct pcb_t;
+
+/* per-cpu data. only its own cpu writes an entry; other cpus read online, idle and cur_pcb */
+typedef struct cpu_t {
+    uint32_t apic_id;
+    volatile uint32_t online; // set by the cpu itself once it runs kernel code
+    uint32_t stack; // top of its kernel stack; 0 on the boot processor, which keeps its boot stack
+    struct pcb_t* cur_pcb; // process running on this cpu, see cur_proc_pcb; NULL while an AP has not run one yet
+    tss_t* tss; // its esp0 is the kernel stack of cur_pcb; the boot processor uses the tss of x86_desc.S
+    struct pcb_t* fpu_owner; // process whose state is in the fpu registers of this cpu; NULL if none
+    uint64_t acct_stamp; // time stamp counter at the last accounting point, see acct.c
+    uint8_t acct_mode; // where the cycles since acct_stamp go
+    uint32_t lock_depth; // kernel entries the cpu is nested in while it holds the kernel lock
+    uint32_t* pgdir; // page directory loaded in its CR3, see cur_pgdir
+    uint32_t tlb_gen; // tlb_gen at the last full flush of this cpu's tlb
+    volatile uint32_t idle; // halted with nothing to run; a process queued here has to wake it up
+    uint64_t tsc_offset; // added, modulo 2^64, to its time stamp counter to read the boot processor's, see tsc_sync_ap
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+extern uint32_t num_cpus; // cpus found; cpus[0] is the boot processor
+extern uint32_t num_online; // cpus running kernel code
+extern volatile uint32_t tlb_gen; // bumped whenever a mapping other cpus may have cached changes
+extern uint32_t ap_trampoline_start[], ap_trampoline_end[];
+extern uint32_t ap_tramp_gdtr[], ap_tramp_stack[], ap_tramp_entry[];
+
+void smp_init(void);
+void smp_kick(uint32_t idx);
+void smp_kick_idle(void);
+void lock_kernel(void);
+void unlock_kernel(void);
+uint32_t release_kernel_lock(void);
+void reacquire_kernel_lock(uint32_t depth);
+
+/* smp_cpu_id
+   description: get the index of the running cpu in cpus. each cpu has its own tss, so the task register tells them
+                apart without going to the local APIC
+   input: none
+   output: none
+   return value: index of the running cpu; 0 on the boot processor
+   side effect: none
+*/
+static inline uint32_t smp_cpu_id(void) {
+    uint16_t sel;
+    asm volatile ("str %0\n" : "=r" (sel));
+    return (sel > KERNEL_LDT) ? (sel >> 3) - GDT_ENTRIES : 0;
+}
+
+
+/* this_cpu
+   description: get the per-cpu data of the running cpu
+   input: none
+   output: none
+   return value: entry of the running cpu in cpus
+   side effect: none
+*/
+static inline cpu_t* this_cpu(void) {
+    return &cpus[smp_cpu_id()];
+}
+
+#endif /* ASM */
+
+#endif /* _SMP_H */
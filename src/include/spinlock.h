@@ -0,0 +1,266 @@
+/* spinlock.h - spinlocks, ticket locks and reader-writer locks. the _irqsave forms also disable interrupts on the
+   local cpu, which is what a lock shared with an interrupt handler needs; on one cpu that is also all the exclusion
+   there is, the spin itself never waits. with LOCK_DEBUG defined every acquire and release is checked against the
+   order locks have been taken in before, see spinlock.c.
+   external source: http://elixir.free-electrons.com/linux/v3.0/source/arch/x86/include/asm/spinlock.h
+*/
+
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+#include <types.h>
+#include <lib.h>
+
+#define RW_LOCK_BIAS 0x01000000 // count of an rwlock nobody holds; each reader takes 1, a writer takes all of it
+
+/* lock ordering state of one lock, kept with LOCK_DEBUG only */
+typedef struct lock_dep_t {
+    const char* name; // locks initialized from the same place share a name, and a class
+    uint32_t class; // class index + 1; 0 until first acquired
+} lock_dep_t;
+
+typedef struct spinlock_t {
+    volatile uint32_t locked;
+#ifdef LOCK_DEBUG
+    lock_dep_t dep;
+#endif
+} spinlock_t;
+
+/* a fair spinlock: cpus get the lock in the order they asked for it */
+typedef struct ticketlock_t {
+    union {
+        volatile uint32_t ticket; // both halves, so one xadd draws a ticket and reads the one being served
+        struct {
+            volatile uint16_t owner; // ticket being served
+            volatile uint16_t next; // next ticket to hand out
+        } half;
+    };
+#ifdef LOCK_DEBUG
+    lock_dep_t dep;
+#endif
+} ticketlock_t;
+
+typedef struct rwlock_t {
+    volatile int32_t count; // RW_LOCK_BIAS less the number of readers, or 0 with a writer
+#ifdef LOCK_DEBUG
+    lock_dep_t dep;
+#endif
+} rwlock_t;
+
+#ifdef LOCK_DEBUG
+#define LOCK_DEP_INIT(name) , { #name, 0 }
+#define lock_dep_init(dep, lname) do { (dep)->name = (lname); (dep)->class = 0; } while (0)
+extern void lock_acquire(lock_dep_t* dep, int32_t read);
+extern void lock_release(lock_dep_t* dep);
+#else
+#define LOCK_DEP_INIT(name)
+#define lock_dep_init(dep, lname) do {} while (0)
+#define lock_acquire(dep, read) do {} while (0)
+#define lock_release(dep) do {} while (0)
+#endif
+
+#define SPINLOCK_INIT(name) { 0 LOCK_DEP_INIT(name) }
+#define TICKETLOCK_INIT(name) { { 0 } LOCK_DEP_INIT(name) }
+#define RWLOCK_INIT(name) { RW_LOCK_BIAS LOCK_DEP_INIT(name) }
+#define DEFINE_SPINLOCK(name) spinlock_t name = SPINLOCK_INIT(name)
+#define DEFINE_TICKETLOCK(name) ticketlock_t name = TICKETLOCK_INIT(name)
+#define DEFINE_RWLOCK(name) rwlock_t name = RWLOCK_INIT(name)
+
+#define spin_lock_init(lock) \
+    do { (lock)->locked = 0; lock_dep_init(&(lock)->dep, #lock); } while (0)
+#define ticket_lock_init(lock) \
+    do { (lock)->ticket = 0; lock_dep_init(&(lock)->dep, #lock); } while (0)
+#define rwlock_init(lock) \
+    do { (lock)->count = RW_LOCK_BIAS; lock_dep_init(&(lock)->dep, #lock); } while (0)
+
+/* cpu_relax
+   description: tell the cpu it is in a spin-wait loop, which saves power and lets a hyperthread sibling run
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void cpu_relax(void) {
+    asm volatile ("pause\n" : : : "memory");
+}
+
+
+/* xchg
+   description: atomically swap a word with memory
+   input: addr - word in memory
+          val - new value
+   output: none
+   return value: old value
+   side effect: none
+*/
+static inline uint32_t xchg(volatile uint32_t* addr, uint32_t val) {
+    asm volatile ("xchgl %0, %1\n" : "+r" (val), "+m" (*addr) : : "memory"); // xchg with memory is always locked
+    return val;
+}
+
+
+/* xadd
+   description: atomically add to a word in memory
+   input: addr - word in memory
+          val - value to add
+   output: none
+   return value: old value
+   side effect: none
+*/
+static inline uint32_t xadd(volatile uint32_t* addr, uint32_t val) {
+    asm volatile ("lock; xaddl %0, %1\n" : "+r" (val), "+m" (*addr) : : "memory");
+    return val;
+}
+
+
+/* spin_trylock
+   description: take a spinlock if it is free
+   input: lock - the lock
+   output: none
+   return value: 1 if taken; 0 otherwise
+   side effect: none
+*/
+static inline int32_t spin_trylock(spinlock_t* lock) {
+    if (xchg(&lock->locked, 1) != 0)
+        return 0;
+    lock_acquire(&lock->dep, 0);
+    return 1;
+}
+
+
+/* spin_lock
+   description: take a spinlock, spinning on a plain read until it looks free so the bus is not locked meanwhile
+   input: lock - the lock
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void spin_lock(spinlock_t* lock) {
+    lock_acquire(&lock->dep, 0);
+    while (xchg(&lock->locked, 1) != 0) {
+        while (lock->locked)
+            cpu_relax();
+    }
+}
+
+
+/* spin_unlock
+   description: release a spinlock; a plain store is enough since x86 does not move stores before earlier accesses
+   input: lock - the lock
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void spin_unlock(spinlock_t* lock) {
+    lock_release(&lock->dep);
+    asm volatile ("" : : : "memory");
+    lock->locked = 0;
+}
+
+
+/* ticket_lock
+   description: take a ticket lock: draw the next ticket and wait until it is served
+   input: lock - the lock
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void ticket_lock(ticketlock_t* lock) {
+    uint32_t ticket;
+    lock_acquire(&lock->dep, 0);
+    ticket = xadd(&lock->ticket, 0x10000) >> 16;
+    while (lock->half.owner != ticket)
+        cpu_relax();
+}
+
+
+/* ticket_unlock
+   description: release a ticket lock by serving the next ticket; only the holder writes owner
+   input: lock - the lock
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void ticket_unlock(ticketlock_t* lock) {
+    lock_release(&lock->dep);
+    asm volatile ("lock; incw %0\n" : "+m" (lock->half.owner) : : "memory");
+}
+
+
+/* read_lock
+   description: take a reader-writer lock for reading; any number of readers may hold it at once
+   input: lock - the lock
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void read_lock(rwlock_t* lock) {
+    lock_acquire(&lock->dep, 1);
+    while ((int32_t)xadd((volatile uint32_t* )&lock->count, -1) <= 0) { // a writer holds it
+        xadd((volatile uint32_t* )&lock->count, 1);
+        while (lock->count <= 0)
+            cpu_relax();
+    }
+}
+
+
+/* read_unlock
+   description: release a reader-writer lock held for reading
+   input: lock - the lock
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void read_unlock(rwlock_t* lock) {
+    lock_release(&lock->dep);
+    xadd((volatile uint32_t* )&lock->count, 1);
+}
+
+
+/* write_lock
+   description: take a reader-writer lock for writing, which excludes readers and other writers
+   input: lock - the lock
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void write_lock(rwlock_t* lock) {
+    lock_acquire(&lock->dep, 0);
+    while (xadd((volatile uint32_t* )&lock->count, -RW_LOCK_BIAS) != RW_LOCK_BIAS) {
+        xadd((volatile uint32_t* )&lock->count, RW_LOCK_BIAS);
+        while (lock->count != RW_LOCK_BIAS)
+            cpu_relax();
+    }
+}
+
+
+/* write_unlock
+   description: release a reader-writer lock held for writing
+   input: lock - the lock
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void write_unlock(rwlock_t* lock) {
+    lock_release(&lock->dep);
+    xadd((volatile uint32_t* )&lock->count, RW_LOCK_BIAS);
+}
+
+/* forms that also keep interrupts off on the local cpu while the lock is held */
+#define spin_lock_irqsave(lock, flags) \
+    do { cli_and_save(flags); spin_lock(lock); } while (0)
+#define spin_unlock_irqrestore(lock, flags) \
+    do { spin_unlock(lock); restore_flags(flags); } while (0)
+#define ticket_lock_irqsave(lock, flags) \
+    do { cli_and_save(flags); ticket_lock(lock); } while (0)
+#define ticket_unlock_irqrestore(lock, flags) \
+    do { ticket_unlock(lock); restore_flags(flags); } while (0)
+#define read_lock_irqsave(lock, flags) \
+    do { cli_and_save(flags); read_lock(lock); } while (0)
+#define read_unlock_irqrestore(lock, flags) \
+    do { read_unlock(lock); restore_flags(flags); } while (0)
+#define write_lock_irqsave(lock, flags) \
+    do { cli_and_save(flags); write_lock(lock); } while (0)
+#define write_unlock_irqrestore(lock, flags) \
+    do { write_unlock(lock); restore_flags(flags); } while (0)
+
+#endif /* _SPINLOCK_H */
@@ -7,24 +7,30 @@
 #include <types.h>
 #include <syscall_num.h>
 #include <proc.h>
+#include <clock.h>
 
-#define MAX_PID 5
+#define MAX_PID (NUM_PROC - 1)
 
 typedef struct proc_info {
     int8_t cmd[ARG_WORD_SIZE];
     uint32_t status;
-    uint32_t uptime;
+    uint32_t uptime; // ms the process has been running, sampled at each pit tick
+    uint64_t user_cycles; // cycles spent running user code
+    uint64_t sys_cycles; // cycles spent in the kernel on behalf of the process
+    uint64_t irq_cycles; // cycles spent on device interrupts that arrived while the process ran
 } __attribute__((packed)) proc_info;
 
 typedef struct system_info {
     uint32_t num_active;
     uint32_t num_idle;
     uint32_t uptime;
+    uint64_t idle_cycles; // cycles the cpu spent halted with nothing to run
 } __attribute__((packed)) system_info;
 
 
 
 extern int32_t syscall_handler(void);
+extern void sysenter_handler(void);
 
 extern int32_t sys_halt(int32_t status);
 extern int32_t sys_execute(const int8_t * command);
@@ -57,5 +63,19 @@ extern int32_t sys_textcolor(uint8_t attr);
 extern int32_t sys_map_modex(uint8_t** screen_start);
 extern int32_t sys_ipconfig(void *buf);
 extern int32_t sys_getip(void);
+extern int32_t sys_fork(void);
+extern int32_t sys_brk(void* addr);
+extern int32_t sys_mmap(uint32_t length);
+extern int32_t sys_munmap(void* addr, uint32_t length);
+extern int32_t sys_sleep(uint32_t ms);
+extern int32_t sys_alarm(uint32_t ms);
+extern int32_t sys_setpriority(uint32_t pid, uint32_t nice);
+extern int32_t sys_clock_gettime(uint32_t clock_id, timespec_t* ts);
+extern int32_t sys_ring_setup(uint32_t entries);
+extern int32_t sys_ring_enter(uint32_t to_submit);
+extern int32_t sys_readv(uint32_t fd, const iovec_t * iov, uint32_t iovcnt);
+extern int32_t sys_writev(uint32_t fd, const iovec_t * iov, uint32_t iovcnt);
+extern int32_t sys_pread(uint32_t fd, void * buf, uint32_t nbytes, uint32_t offset);
+extern int32_t sys_pwrite(uint32_t fd, const void * buf, uint32_t nbytes, uint32_t offset);
 
 #endif /* _SYSCALL_H */
@@ -34,7 +34,21 @@
 #define SYS_MAP_MODEX   29
 #define SYS_IPCONFIG    30
 #define SYS_GETIP		    31
+#define SYS_FORK        32
+#define SYS_BRK         33
+#define SYS_MMAP        34
+#define SYS_MUNMAP      35
+#define SYS_SLEEP       36
+#define SYS_ALARM       37
+#define SYS_SETPRIORITY 38
+#define SYS_CLOCK_GETTIME 39
+#define SYS_RING_SETUP  40
+#define SYS_RING_ENTER  41
+#define SYS_READV       42
+#define SYS_WRITEV      43
+#define SYS_PREAD       44
+#define SYS_PWRITE      45
 
-#define SYS_MAX         31
+#define SYS_MAX         45
 
 #endif /* _SYSCALL_NUM_H */
@@ -12,8 +12,9 @@
 #define MODEX_PAGE_NUM 16 // modex uses 16 consecutive pages
 #define KERNEL_TOP 0x400000 // start of kernel page
 #define KERNEL_SIZE 0x400000 // kernel page size is 4mb
-#define HEAP_SIZE 0x400000 // heap size in total is 4mb
-#define HEAP_PHYS_TOP 0x2000000 // heap physical address top is 32MB
+#define HEAP_SIZE 0x1C00000 // heap virtual window is 28mb, from 8MB up to the history page at 36MB
+#define HEAP_PHYS_TOP 0x2000000 // legacy heap physical address top is 32MB
+#define HEAP_PHYS_SIZE 0x400000 // legacy heap physical region is 4mb, used when no memory map is available
 #define HEAP_VIRT_TOP 0x800000 // heap virtual address top is 8MB
 #define USER_VIRT_TOP 0x8000000 // user virtual memory address starts at 128MB
 #define USER_VIRT_BOT 0x8400000 // user virtual memory address ends at 132MB
@@ -22,6 +23,7 @@
 #define MODEX_VIRT_START (VMEM_VIRT_START + MODEX_PAGE_SIZE) // modex mode virtual start address
 #define USER_STACK_TOP 0x8200000 // user stack section starts here
 #define USER_HEAP_BOT USER_STACK_TOP // user heap section ends here
+#define USER_MMAP_PAGES ((USER_HEAP_BOT - USER_VIRT_TOP) / 0x1000) // pages between user space start and the stack that anonymous mappings can take
 
 #define ENOMEM 12 // out of memory
 #define	EBUSY 16 // device or resource busy
@@ -76,9 +78,11 @@
  * @param addr - address to align
  * @return - next aligned address
  */
+#ifndef ASM
 static inline uint32_t align_addr_long(uint32_t addr) {
     if (!(addr % BITS_LONG)) return addr;
     return (addr + BITS_LONG - addr % BITS_LONG);
 }
+#endif
 
 #endif
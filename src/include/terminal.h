@@ -2,6 +2,8 @@
 #define _TERMINAL_H
 #include <types.h>
 #include <proc.h>
+#include <wait.h>
+#include <spinlock.h>
 
 #define KEY_BUF_SIZE 128 // keyboard buffer size is 128s
 #define VIDMEM_SIZE 0x1000 // video memory size is 4kb
@@ -18,7 +20,9 @@ typedef struct sess_t {
     uint32_t vid_x; // x position of video memory
     uint32_t vid_y; // y position of video memory
     uint32_t cached_vidmem; // cached video memory starting address
+    spinlock_t cmd_lock; // guards cmd_buf and cmd_available, which the keyboard handler fills
     volatile int cmd_available; // determine whether 'ENTER' is pressed and so a new command is available
+    wait_queue_t cmd_wait; // readers waiting for a new command
     uint32_t kbd_buf_idx; // keyboard buffer index
     uint8_t kbd_buf[KEY_BUF_SIZE]; // keyboard buffer
     uint8_t cmd_buf[KEY_BUF_SIZE]; // session-specific command buffer
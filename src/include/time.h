@@ -4,19 +4,64 @@
 #ifndef _TIME_H
 #define _TIME_H
 #include <types.h>
+#include <list.h>
+#include <wait.h>
 
 #define TIME_MS 1
 #define TIME_SEC 1000
 #define TIME_MIN (TIME_SEC * 60)
 #define TIME_HR (TIME_MIN * 60)
+#define TIMER_WHEEL_SIZE 256 // number of slots in the timer wheel, one per millisecond
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
 
 /* time struct for PIT */
 typedef struct time_t {
     uint32_t count_ms; // time count in milisecond
 } time_t;
 
+/* struct for a kernel timer */
+typedef struct timer_t {
+    struct list_head node; // link in its wheel slot while pending; points to itself otherwise
+    uint32_t expires; // system time in ms at which the timer fires
+    void (*func)(uint32_t data); // called from the pit interrupt when the timer fires
+    uint32_t data; // argument passed to func
+} timer_t;
+
 extern volatile time_t system_time; // an instance of the time struct
 
+/* timer_init
+   description: initialize a timer that is not pending
+   input: timer - timer to initialize
+          func - function to call when the timer fires
+          data - argument passed to func
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void timer_init(timer_t* timer, void (*func)(uint32_t data), uint32_t data) {
+    init_list_head(&(timer->node));
+    timer->func = func;
+    timer->data = data;
+}
+
+/* timer_pending
+   description: test whether a timer is waiting to fire
+   input: timer - timer to test
+   output: none
+   return value: 1 if pending, 0 otherwise
+   side effect: none
+*/
+static inline int timer_pending(const timer_t* timer) {
+    return !list_is_empty(&(timer->node));
+}
+
+void timer_add(timer_t* timer, uint32_t expires);
+void timer_del(timer_t* timer);
+void run_timers(void);
+uint32_t timer_next(void);
+uint32_t sleep_on_timeout(wait_queue_t* wq, uint32_t ms);
+uint32_t msleep(uint32_t ms);
+
 void count_start(uint32_t* time_var);
 uint32_t count_end(uint32_t* time_var);
 extern void sleep(int ms);
@@ -15,6 +15,8 @@
 #define SEEK_CUR 2
 #define SEEK_END 3
 
+#define IOV_MAX 16 /* most buffers readv and writev take in one call */
+
 struct super_block;
 struct file;
 struct inode;
@@ -89,6 +91,12 @@ typedef struct super_op {
 
 struct file_op;
 
+/// One buffer of a vectored read or write.
+typedef struct iovec {
+    void * iov_base;
+    uint32_t iov_len;
+} iovec_t;
+
 typedef struct file {
     struct dentry f_dentry;
     struct file_op * f_op;
@@ -104,12 +112,20 @@ typedef struct file_op {
     int32_t (*seek)(struct file * self, int32_t offset, int32_t whence);
     int32_t (*getkey)(struct file * self, uint8_t * key);
     int32_t (*setkey)(struct file * self, uint8_t * key);
+    /// Optional. Without readv or writev, each buffer takes its own read or
+    /// write; without pread or pwrite, the file can not be accessed at an
+    /// explicit offset. None of them moves f_pos except readv and writev.
+    int32_t (*readv)(struct file * self, const iovec_t * iov, uint32_t iovcnt);
+    int32_t (*writev)(struct file * self, const iovec_t * iov, uint32_t iovcnt);
+    int32_t (*pread)(struct file * self, void * buf, uint32_t nbytes, uint32_t offset);
+    int32_t (*pwrite)(struct file * self, const void * buf, uint32_t nbytes, uint32_t offset);
 } file_op_t;
 
 /// VFS functions
 
 extern int32_t parse_path(const int8_t * path, struct dentry * parent, struct dentry * node);
 extern void free_dentry(struct dentry * dentry);
+extern struct dentry * dup_dentry(struct dentry * dentry);
 
 /// Extern variables
 
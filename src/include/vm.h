@@ -0,0 +1,50 @@
+/* vm.h - demand-paged user address space */
+
+#ifndef _VM_H
+#define _VM_H
+#include <types.h>
+#include <system.h>
+#include <paging.h>
+#include <proc.h>
+
+#define PF_PRESENT 0x1 // page fault error code: fault on a present page (protection violation)
+#define PF_WRITE 0x2 // page fault error code: fault caused by a write
+#define PF_USER 0x4 // page fault error code: fault raised in user mode
+#define USER_PAGE_MASK 0xFFFFF000
+
+#define USER_PTE_IDX(addr) \
+    (((addr) - USER_VIRT_TOP) >> 12)
+
+#define PAGE_ALIGN_UP(addr) \
+    (((addr) + PAGE_SIZE - 1) & USER_PAGE_MASK)
+
+/* anonymous mappings are handed out top-down from the stack, bit 0 of mmap_map is the page right below USER_HEAP_BOT */
+#define MMAP_IDX(addr) \
+    ((USER_HEAP_BOT - PAGE_SIZE - (addr)) >> 12)
+
+#define MMAP_ADDR(idx) \
+    (USER_HEAP_BOT - PAGE_SIZE - ((idx) << 12))
+
+void vm_proc_init(pcb_t* pcb, const inode_t* prog_inode);
+void vm_release(uint32_t pid);
+void vm_fork(pcb_t* parent, pcb_t* child);
+int32_t vm_handle_fault(uint32_t fault_addr, uint32_t err_code);
+int32_t vm_brk(uint32_t addr);
+int32_t vm_mmap(uint32_t length);
+int32_t vm_munmap(uint32_t addr, uint32_t length);
+
+
+/* read_cr2
+   description: read the faulting linear address of the last page fault
+   input: none
+   output: none
+   return value: value of cr2
+   side effect: none
+*/
+static inline uint32_t read_cr2(void) {
+    uint32_t cr2;
+    asm volatile ("movl %%cr2,%0" : "=r" (cr2));
+    return cr2;
+}
+
+#endif
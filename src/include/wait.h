@@ -0,0 +1,77 @@
+/* wait.h - wait queues. a process that can not go on until some event happens sleeps on a wait queue, off the run
+   queue, and the code that makes the event happen, usually an interrupt handler, wakes the queue up.
+*/
+
+#ifndef _WAIT_H
+#define _WAIT_H
+#include <types.h>
+#include <list.h>
+#include <lib.h>
+
+/* struct for a wait queue */
+typedef struct wait_queue_t {
+    struct list_head task_list; // sleeping processes, linked through their wait_node
+} wait_queue_t;
+
+#define DECLARE_WAIT_QUEUE(name) \
+    wait_queue_t (name) = {{&(name).task_list, &(name).task_list}}
+
+/* wait_event - sleep on wq until cond holds. cond is tested with interrupts off, so a wake up that comes between the
+   test and the sleep is not lost */
+#define wait_event(wq, cond) do {   \
+    uint32_t __flags;               \
+    cli_and_save(__flags);          \
+    while (!(cond))                 \
+        sleep_on(wq);               \
+    restore_flags(__flags);         \
+} while (0)
+
+/* init_wait_queue
+   description: initialize an empty wait queue
+   input: wq - wait queue
+   output: none
+   return value: none
+   side effect: none
+*/
+static inline void init_wait_queue(wait_queue_t* wq) {
+    init_list_head(&(wq->task_list));
+}
+
+/* sleep_on
+   description: block the current process on a wait queue until it is woken up. callers test their wait condition with interrupts off and call this without turning them back on, see wait_event.
+   input: wq - wait queue
+   output: none
+   return value: none
+   side effect: gives up the cpu
+*/
+void sleep_on(wait_queue_t* wq);
+
+/* wake_up
+   description: make every process sleeping on a wait queue runnable
+   input: wq - wait queue
+   output: none
+   return value: none
+   side effect: none
+*/
+void wake_up(wait_queue_t* wq);
+
+/* wake_up_process
+   description: make a process that sleeps on a wait queue runnable, whatever the queue; other BLOCKED processes are left alone
+   input: pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+struct pcb_t;
+void wake_up_process(struct pcb_t* pcb);
+
+/* wake_up_boost
+   description: make every process sleeping on a wait queue runnable at its base priority level. for input a user is waiting on, such as a command line, so that interactive processes run ahead of cpu-bound ones.
+   input: wq - wait queue
+   output: none
+   return value: none
+   side effect: none
+*/
+void wake_up_boost(wait_queue_t* wq);
+
+#endif
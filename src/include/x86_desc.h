@@ -20,6 +20,7 @@
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
+#define TSS_ESP0    4   /* offset of esp0 in the TSS */
 
 /* Number of vectors in the interrupt descriptor table (IDT) */
 #define NUM_VEC     256
@@ -14,8 +14,10 @@
 #include <interrupt.h>
 #include <panic.h>
 #include <system.h>
+#include <acct.h>
+#include <apic.h>
+#include <clock.h>
 
-pcb_t * cur_proc_pcb; // declared in proc.h
 #include <network.h>
 ///
 /// Handles an interrupt for specific irq number.
@@ -28,6 +30,7 @@ pcb_t * cur_proc_pcb; // declared in proc.h
 __attribute__((fastcall))
 void do_irq(struct regs *regs) {
     int irq = ~(regs->orig_eax);
+    acct_switch((irq == YIELD_ENTRY) ? ACCT_SYS : ACCT_IRQ); // giving up the cpu is the process's own kernel work
     switch (irq) {
 
         // Case where interrupt is from keyboard.
@@ -57,11 +60,28 @@ void do_irq(struct regs *regs) {
             send_eoi(PIT_IRQ_PIN);
             return;
 
+        // Case where the clock tick comes from the local APIC timer. It is
+        // acknowledged first, since the handler may switch processes.
+        case LAPIC_TIMER_ENTRY:
+        #ifndef RUN_TESTS
+            if (cur_proc_pcb != NULL)
+                cur_proc_pcb->kernel_esp = (uint32_t)regs;
+        #endif
+            lapic_eoi();
+            clock_handler();
+            return;
+
         // Case where interrupt is from mouse.
         case MOUSE_IRQ_PIN:
             mouse_handler();
             send_eoi(MOUSE_IRQ_PIN);
             return;
+
+        // Case where the current process gives up the cpu.
+        case YIELD_ENTRY:
+            cur_proc_pcb->kernel_esp = (uint32_t)regs;
+            do_sched();
+            return;
         default:
             break;
     }
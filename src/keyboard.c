@@ -184,7 +184,10 @@ void keyboard_handler(void) {
             set_vidmem_param(VIDEO);
             set_newline();
             update_cursor(cur_sess_id);
+            spin_lock(&sess_desc[cur_sess_id].cmd_lock);
             sess_desc[cur_sess_id].cmd_available = 1;
+            spin_unlock(&sess_desc[cur_sess_id].cmd_lock);
+            wake_up_boost(&sess_desc[cur_sess_id].cmd_wait);
             set_vidmem_param(prev);
             break;
 
@@ -261,12 +264,15 @@ void print_regular_key(uint8_t keycode) {
         set_vidmem_param(VIDEO);
         clear_screen(cur_sess_id);
         set_vidmem_param(prev);
+        spin_lock(&sess_desc[cur_sess_id].cmd_lock);
         for (i = 0; i < KEY_BUF_SIZE; i++) { // clear keyboard buffer
             sess_desc[cur_sess_id].kbd_buf[i] = 0x00;
             sess_desc[cur_sess_id].cmd_buf[0] = 0x00;
         }
         sess_desc[cur_sess_id].kbd_buf_idx = 0;
         sess_desc[cur_sess_id].cmd_available = 1;
+        spin_unlock(&sess_desc[cur_sess_id].cmd_lock);
+        wake_up_boost(&sess_desc[cur_sess_id].cmd_wait);
         return;
     }
     if (key_info.ctrl_en && key == 'c') { // if ctrl+c is pressed, kill the process
@@ -341,5 +347,7 @@ void set_newline(void) {
    side effect: changes video memory
 */
 void cmd_cached_store(void) {
+    spin_lock(&sess_desc[cur_sess_id].cmd_lock); // interrupts are already off in the keyboard handler
     strncpy((int8_t *)sess_desc[cur_sess_id].cmd_buf, (int8_t *)sess_desc[cur_sess_id].kbd_buf, KEY_BUF_SIZE);
+    spin_unlock(&sess_desc[cur_sess_id].cmd_lock);
 }
@@ -9,15 +9,21 @@
 */
 
 #include <mem.h>
-#include <bitmap.h>
+#include <list.h>
 #include <lib.h>
 #include <types.h>
 #include <paging.h>
 #include <bitops.h>
 #include <system.h>
+#include <slab.h>
+#include <frame.h>
+#include <heapinfo.h>
 
 alloc_t alloc_info; // a global instance of the struct
-uint32_t heap_map[HEAP_BITMAP_ENTRY]; // heap bitmap
+free_area_t free_area[MAX_ORDER + 1]; // free lists of buddy blocks, one per order
+list_head buddy_node[HEAP_ENTRY]; // free list node of a block, indexed by its first page. heap pages are unmapped while free, so nodes cannot live in the pages
+DEFINE_TICKETLOCK(heap_lock); // declared in mem.h
+uint8_t buddy_order[HEAP_ENTRY]; // order of the free block starting at this page; BUDDY_NOT_FREE if the page does not start a free block
 
 /* alloc_request_order
    description: get the order of pages to allocate
@@ -35,23 +41,32 @@ int alloc_request_order(uint32_t size) {
 
 
 /* create_heap_pages
-   description: create heap page(s) contiguously within heap block.
+   description: create heap page(s) contiguously within heap block. each page is backed by a frame from the frame allocator, so the block is only virtually contiguous.
    input: start_idx - starting index of page to create
           num_pages - number of pages to create
    output: none
-   return value: starting address of the first page
+   return value: starting address of the first page; ENOMEM if out of physical frames
    side effect: none
 */
 uint32_t create_heap_pages(int start_idx, int num_pages) {
     int i = 0, idx = start_idx; // loop iterators
-    for (; i < num_pages; i++, idx++) // setup each 4kb page
-        set_virtual_4kb_heap(HEAP_PHYS_ADDR(idx), HEAP_VIRT_ADDR(idx));
+    uint32_t phys_addr;
+    tlb_batch_begin();
+    for (; i < num_pages; i++, idx++) { // setup each 4kb page
+        if ((phys_addr = frame_alloc()) == ENOMEM) {
+            destroy_heap_pages(start_idx, i); // roll back pages already created
+            tlb_batch_flush();
+            return ENOMEM;
+        }
+        set_virtual_4kb_heap(phys_addr, HEAP_VIRT_ADDR(idx));
+    }
+    tlb_batch_flush();
     return (uint32_t)(HEAP_VIRT_ADDR(start_idx));
 }
 
 
 /* destroy_heap_pages
-   description: destroy heap page(s) contiguously within heap block.
+   description: destroy heap page(s) contiguously within heap block, and return their frames.
    input: start_idx - starting index of page to create
           num_pages - number of pages to create
    output: none
@@ -60,26 +75,185 @@ uint32_t create_heap_pages(int start_idx, int num_pages) {
 */
 void destroy_heap_pages(int start_idx, int num_pages) {
     int i = 0; // loop iterator
-    for (; i < num_pages; i++, start_idx++) // clear each 4kb page
+    uint32_t phys_addr;
+    tlb_batch_begin(); // one invalidation pass for the whole block
+    for (; i < num_pages; i++, start_idx++) { // clear each 4kb page
+        phys_addr = heap_virt_to_phys(HEAP_VIRT_ADDR(start_idx));
         free_virtual_4kb_heap(HEAP_VIRT_ADDR(start_idx));
+        frame_free(phys_addr);
+    }
+    tlb_batch_flush();
+}
+
+
+/* buddy_add_free
+   description: put a free block on the free list of its order
+   input: idx - index of first page of the block
+          order - order of the block
+   output: none
+   return value: none
+   side effect: none
+*/
+static void buddy_add_free(uint32_t idx, uint32_t order) {
+    list_insert_after(&buddy_node[idx], &(free_area[order].free_list));
+    buddy_order[idx] = order;
+    free_area[order].nr_free++;
+}
+
+
+/* buddy_del_free
+   description: take a free block off the free list of its order
+   input: idx - index of first page of the block
+          order - order of the block
+   output: none
+   return value: none
+   side effect: none
+*/
+static void buddy_del_free(uint32_t idx, uint32_t order) {
+    list_delete(&buddy_node[idx]);
+    buddy_order[idx] = BUDDY_NOT_FREE;
+    free_area[order].nr_free--;
+}
+
+
+/* buddy_alloc
+   description: allocate a block of pages. the smallest free block that is large enough is taken, and split in halves until it is of the requested order; the upper halves go back to the free lists.
+   input: order - order of the block to allocate
+   output: none
+   return value: index of first page of the block; -ENOMEM if out of memory
+   side effect: none
+*/
+int buddy_alloc(uint32_t order) {
+    uint32_t cur_order = order, idx;
+    while (cur_order <= MAX_ORDER && list_is_empty(&(free_area[cur_order].free_list)))
+        cur_order++;
+    if (cur_order > MAX_ORDER) // if no block is large enough
+        return -ENOMEM;
+    idx = BUDDY_NODE_TO_IDX(free_area[cur_order].free_list.next);
+    buddy_del_free(idx, cur_order);
+    while (cur_order > order) { // split and release the upper half
+        cur_order--;
+        buddy_add_free(idx + ORDER_TO_SIZE(cur_order), cur_order);
+    }
+    return (int)idx;
+}
+
+
+/* buddy_free
+   description: release a block of pages. the block is merged with its buddy for as long as the buddy is free and of the same order.
+   input: idx - index of first page of the block
+          order - order of the block
+   output: none
+   return value: none
+   side effect: none
+*/
+void buddy_free(uint32_t idx, uint32_t order) {
+    uint32_t buddy_idx;
+    for (; order < MAX_ORDER; order++) {
+        buddy_idx = idx ^ ORDER_TO_SIZE(order);
+        if (buddy_order[buddy_idx] != order) // buddy is in use or split
+            break;
+        buddy_del_free(buddy_idx, order);
+        idx &= buddy_idx; // merged block starts at the lower of the two
+    }
+    buddy_add_free(idx, order);
+}
+
+
+/* buddy_grow
+   description: grow an allocated block in place by taking over its free upper buddies, one order at a time. only possible if the block is the lower half at every order on the way.
+   input: idx - index of first page of the block
+          order - current order of the block
+          new_order - order to grow the block to
+   output: none
+   return value: 0 if success; -1 if new_order is past MAX_ORDER, a buddy is not free or out of physical frames
+   side effect: maps the pages taken over
+*/
+static int buddy_grow(uint32_t idx, uint32_t order, uint32_t new_order) {
+    uint32_t cur_order, buddy_idx;
+    if (new_order > MAX_ORDER) // free_area and the heapinfo classes stop there
+        return -1;
+    for (cur_order = order; cur_order < new_order; cur_order++) {
+        buddy_idx = idx + ORDER_TO_SIZE(cur_order);
+        if ((idx & ORDER_TO_SIZE(cur_order)) || buddy_order[buddy_idx] != cur_order)
+            return -1;
+    }
+    for (cur_order = order; cur_order < new_order; cur_order++) {
+        buddy_idx = idx + ORDER_TO_SIZE(cur_order);
+        buddy_del_free(buddy_idx, cur_order);
+        if (create_heap_pages(buddy_idx, ORDER_TO_SIZE(cur_order)) == ENOMEM) { // give back what was taken so far
+            buddy_free(buddy_idx, cur_order);
+            while (cur_order-- > order) {
+                buddy_idx = idx + ORDER_TO_SIZE(cur_order);
+                destroy_heap_pages(buddy_idx, ORDER_TO_SIZE(cur_order));
+                buddy_free(buddy_idx, cur_order);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/* buddy_shrink
+   description: shrink an allocated block in place; the upper halves that are cut off go back to the free lists
+   input: idx - index of first page of the block
+          order - current order of the block
+          new_order - order to shrink the block to
+   output: none
+   return value: none
+   side effect: unmaps the pages given back
+*/
+static void buddy_shrink(uint32_t idx, uint32_t order, uint32_t new_order) {
+    uint32_t buddy_idx;
+    while (order > new_order) {
+        order--;
+        buddy_idx = idx + ORDER_TO_SIZE(order);
+        destroy_heap_pages(buddy_idx, ORDER_TO_SIZE(order));
+        buddy_free(buddy_idx, order);
+    }
+}
+
+
+/* alloc_obj_inc
+   description: count a newly allocated object and track the high-water mark
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+static void alloc_obj_inc(void) {
+    if (++alloc_info.obj_alloc > alloc_info.obj_peak)
+        alloc_info.obj_peak = alloc_info.obj_alloc;
 }
 
 
 /* alloc_request_page
-   description: find free region within heap bitmap and allocate the page(s), update usage info
+   description: allocate a buddy block of heap page(s) and map them, update usage info
    input: size - size to allocate (header + data object size)
    output: none
    return value: starting address of the first page
    side effect: none
 */
 uint32_t alloc_request_pages(uint32_t size) {
+    uint32_t flags, start_addr;
     int order = alloc_request_order(size);
     int num_pages = ORDER_TO_SIZE(order); // number of pages to set
-    int start_idx = find_free_region(heap_map, HEAP_ENTRY, order); // find free pages and set in bitmap
-    if (start_idx == -ENOMEM) return ENOMEM; // if out of memory, return
-    uint32_t start_addr = create_heap_pages(start_idx, num_pages); // create heap pages, get starting page address
-    alloc_info.page_alloc += num_pages; // set number of pages allocated
-    alloc_info.obj_alloc++; // set number of objects allocated
+    ticket_lock_irqsave(&heap_lock, flags);
+    int start_idx = buddy_alloc(order); // take a free block off the free lists
+    if (start_idx == -ENOMEM) { // if out of memory, return
+        ticket_unlock_irqrestore(&heap_lock, flags);
+        return ENOMEM;
+    }
+    start_addr = create_heap_pages(start_idx, num_pages); // create heap pages, get starting page address
+    if (start_addr == ENOMEM) // if out of physical frames, give the block back
+        buddy_free(start_idx, order);
+    else {
+        alloc_info.page_alloc += num_pages; // set number of pages allocated
+        if (alloc_info.page_alloc > alloc_info.page_peak)
+            alloc_info.page_peak = alloc_info.page_alloc;
+    }
+    ticket_unlock_irqrestore(&heap_lock, flags);
     return start_addr;
 }
 
@@ -93,17 +267,51 @@ uint32_t alloc_request_pages(uint32_t size) {
    side effect: none
 */
 void free_request_pages(uint32_t start_idx, uint32_t size) {
+    uint32_t flags;
     int order = alloc_request_order(size);
     int num_pages = ORDER_TO_SIZE(order); // number of pages to set
-    release_region(heap_map, start_idx, order); // find free pages and set in bitmap
+    ticket_lock_irqsave(&heap_lock, flags);
     destroy_heap_pages(start_idx, num_pages); // destroy heap pages
+    buddy_free(start_idx, order); // give the block back, coalescing with free buddies
     alloc_info.page_alloc -= num_pages; // clear number of pages allocated
-    alloc_info.obj_alloc--; // clear number of objects allocated
+    ticket_unlock_irqrestore(&heap_lock, flags);
+}
+
+
+/* alloc_pages
+   description: allocate a block of heap pages without an object header. a block of order n is aligned to 2^n pages, since the heap window starts on a 4mb boundary.
+   input: order - order of the block
+   output: none
+   return value: starting address of the block; NULL if out of memory
+   side effect: none
+*/
+void* alloc_pages(uint32_t order) {
+    uint32_t page_ptr = alloc_request_pages(ORDER_TO_SIZE(order) * HEAP_PAGE_SIZE);
+    if (page_ptr == ENOMEM)
+        alloc_info.fail_alloc++;
+    else
+        heapinfo_class_alloc(ORDER_CLASS(order));
+    return (page_ptr == ENOMEM) ? NULL : (void* )page_ptr;
+}
+
+
+/* free_pages
+   description: free a block allocated by alloc_pages
+   input: addr - starting address of the block; NULL is ignored
+          order - order of the block
+   output: none
+   return value: none
+   side effect: none
+*/
+void free_pages(void* addr, uint32_t order) {
+    if (addr == NULL) return;
+    heapinfo_class_free(ORDER_CLASS(order));
+    free_request_pages(PAGE_PTR_TO_IDX((uint32_t)addr), ORDER_TO_SIZE(order) * HEAP_PAGE_SIZE);
 }
 
 
 /* __alloc
-   description: given the size of a object, dynamically allocate a heap space for it.
+   description: given the size of a object, dynamically allocate a heap space for it. objects up to SLAB_MAX_SIZE come from the size-class caches, larger ones get their own page(s).
    input: size - size of the object to allocate
    output: none
    return value: pointer to the object if success; null if fail
@@ -116,11 +324,29 @@ void* __alloc(uint32_t size) {
     if (size == 0 || REQ_PAGE_NUM(size) > MAX_HEAP_ENTRY)
         return NULL;
 
+    /* small objects are served from the slab caches */
+    if (size <= SLAB_MAX_SIZE) {
+        kmem_cache_t* cache = kmem_cache_select(size);
+        void* obj = kmem_cache_alloc(cache);
+        if (obj == NULL) {
+            alloc_info.fail_alloc++;
+            return NULL;
+        }
+        alloc_obj_inc(); // set number of objects allocated
+        heapinfo_class_alloc(SLAB_CLASS(cache));
+        return obj;
+    }
+
     /* request page(s) for object and obtain the pointer. if success, load size of the object in the header field */
 
     uint32_t page_ptr = alloc_request_pages(total_size);
-    if (page_ptr == ENOMEM) return NULL; // if out of memory
+    if (page_ptr == ENOMEM) { // if out of memory
+        alloc_info.fail_alloc++;
+        return NULL;
+    }
     *((uint32_t* )page_ptr) = total_size; // load total size into header
+    alloc_obj_inc(); // set number of objects allocated
+    heapinfo_class_alloc(ORDER_CLASS(alloc_request_order(total_size)));
 
     /* return the data pointer */
     return (void*)(HEAP_PAGE_TO_DATA(page_ptr));
@@ -136,9 +362,17 @@ void* __alloc(uint32_t size) {
 */
 void __free(void* ptr) {
     if (ptr == NULL) return; // if pointer is invalid
+    alloc_info.obj_alloc--; // clear number of objects allocated
+    slab_t* slab = virt_to_slab(ptr);
+    if (slab != NULL) { // object lives in a slab page
+        heapinfo_class_free(SLAB_CLASS(slab->cache));
+        kmem_cache_free(ptr);
+        return;
+    }
     /* destroy page(s) for object */
     uint32_t total_size = malloc_info(ptr); // read total size of the object
     uint32_t start_idx = get_alloc_idx(ptr); // get starting index from pointer
+    heapinfo_class_free(ORDER_CLASS(alloc_request_order(total_size)));
     free_request_pages(start_idx, total_size);
 }
 
@@ -149,7 +383,9 @@ void __free(void* ptr) {
  * @return - void pointer to the object if success; null if fail
  */
 void* malloc(uint32_t size) {
-    return __alloc(size);
+    void* mem_ptr = __alloc(size);
+    heapinfo_site((uint32_t)__builtin_return_address(0), size, mem_ptr);
+    return mem_ptr;
 }
 
 
@@ -160,25 +396,74 @@ void* malloc(uint32_t size) {
  */
 void* calloc(uint32_t size) {
     void* mem_ptr = __alloc(size);
+    heapinfo_site((uint32_t)__builtin_return_address(0), size, mem_ptr);
     if (mem_ptr == NULL) return mem_ptr;
     memset(mem_ptr, 0L, size);
     return mem_ptr;
 }
 
 
+/* realloc_in_place
+   description: try to resize an object without moving it. a slab object keeps its slot as long as the new size fits its size class; a page block is shrunk to the order the new size needs, or grown into its free buddies.
+   input: ptr - object pointer
+          size - new size of the object
+   output: none
+   return value: 0 if the object now has room for size bytes; -1 if it has to move
+   side effect: none
+*/
+static int realloc_in_place(void* ptr, uint32_t size) {
+    uint32_t flags, idx, total_size = HEAP_HEADER_SIZE + size;
+    int order, new_order, retval = 0;
+    slab_t* slab = virt_to_slab(ptr);
+    if (slab != NULL)
+        return (size <= slab->cache->obj_size) ? 0 : -1;
+    if (REQ_PAGE_NUM(size) > MAX_HEAP_ENTRY)
+        return -1;
+    new_order = alloc_request_order(total_size);
+    if (new_order > MAX_ORDER) // the header pushes a size just under 4mb past the largest block
+        return -1;
+
+    idx = get_alloc_idx(ptr);
+    order = alloc_request_order(malloc_info(ptr));
+    ticket_lock_irqsave(&heap_lock, flags);
+    if (new_order > order)
+        retval = buddy_grow(idx, order, new_order);
+    else if (new_order < order)
+        buddy_shrink(idx, order, new_order);
+    if (retval == 0) {
+        *((uint32_t* )HEAP_DATA_TO_PAGE((uint32_t)ptr)) = total_size; // load new total size into header
+        alloc_info.page_alloc += ORDER_TO_SIZE(new_order);
+        alloc_info.page_alloc -= ORDER_TO_SIZE(order);
+        if (alloc_info.page_alloc > alloc_info.page_peak)
+            alloc_info.page_peak = alloc_info.page_alloc;
+        heapinfo_class_free(ORDER_CLASS(order));
+        heapinfo_class_alloc(ORDER_CLASS(new_order));
+    }
+    ticket_unlock_irqrestore(&heap_lock, flags);
+    return retval;
+}
+
+
 /**
- * realloc - reallocate a previously allocated object
+ * realloc - reallocate a previously allocated object. the object is resized in place when possible, which neither allocates nor copies
  * @param ptr - pointer to the object allocated
  * @param size - size of the object to reallocate
  * @return - void pointer to the object if success; null if fail
  */
 void* realloc(void* ptr, uint32_t size) {
-    void* new_ptr = __alloc(size);
-    if (new_ptr == NULL) return new_ptr;
-    uint32_t old_data_size = malloc_info(ptr) - HEAP_HEADER_SIZE;
-    uint32_t cpysize = (old_data_size < size) ? old_data_size : size;
-    memcpy(new_ptr, ptr, cpysize);
-    __free(ptr);
+    void* new_ptr;
+    if (ptr != NULL && size != 0 && realloc_in_place(ptr, size) == 0)
+        new_ptr = ptr;
+    else {
+        new_ptr = __alloc(size);
+        if (ptr != NULL && new_ptr != NULL) {
+            uint32_t old_data_size = malloc_usable_size(ptr);
+            uint32_t cpysize = (old_data_size < size) ? old_data_size : size;
+            memcpy(new_ptr, ptr, cpysize);
+            __free(ptr);
+        }
+    }
+    heapinfo_site((uint32_t)__builtin_return_address(0), size, new_ptr);
     return new_ptr;
 }
 
@@ -196,24 +481,48 @@ void free(void* ptr) {
    description: obtain the info relative to the specified object
    input: ptr - object pointer
    output: none
-   return value: header packed in a uint32_t format
+   return value: header packed in a uint32_t format. slab objects have no header, so the size class plus header size is reported instead
    side effect: none
 */
 uint32_t malloc_info(void* ptr) {
+    uint32_t obj_size = kmem_cache_obj_size(ptr);
+    if (obj_size) return obj_size + HEAP_HEADER_SIZE;
     uint32_t* header_ptr = (uint32_t* )HEAP_DATA_TO_PAGE((uint32_t)ptr);
     return *(header_ptr);
 }
 
 
+/**
+ * malloc_usable_size - get number of bytes usable in an allocated object
+ * @param ptr - object pointer
+ * @return - usable size in bytes; 0 if ptr is null
+ */
+uint32_t malloc_usable_size(void* ptr) {
+    if (ptr == NULL) return 0;
+    return malloc_info(ptr) - HEAP_HEADER_SIZE;
+}
+
+
 /* heap_init
-   description: initialize heap page initial sequence
+   description: initialize heap page initial sequence. frame_init should run first; if it has not, the frame allocator is seeded with the legacy heap region.
    input: none
    output: none
    return value: none
    side effect: none
 */
 void heap_init(void) {
-    bitmap_clear(heap_map, HEAP_ENTRY); // clear heap bitmap
-    alloc_info.page_alloc = alloc_info.obj_alloc = 0; // clear heap struct
-    set_virtual_4mb_heap(HEAP_VIRT_TOP); // setup page for heap
+    int i;
+    if (frame_info.total == 0) // frame allocator not seeded yet
+        frame_init(NULL);
+    for (i = 0; i <= MAX_ORDER; i++) { // clear free lists
+        init_list_head(&(free_area[i].free_list));
+        free_area[i].nr_free = 0;
+    }
+    memset(buddy_order, BUDDY_NOT_FREE, sizeof(buddy_order));
+    for (i = 0; i < HEAP_ENTRY; i += ORDER_TO_SIZE(MAX_ORDER)) // whole heap starts out as free blocks of maximum order
+        buddy_add_free(i, MAX_ORDER);
+    memset(&alloc_info, 0, sizeof(alloc_info)); // clear heap struct
+    heapinfo_init();
+    set_virtual_4mb_heap(HEAP_VIRT_TOP); // setup first page table for heap, the rest are installed as the heap grows
+    slab_init(); // setup size-class caches
 }
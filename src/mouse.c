@@ -12,11 +12,13 @@
 #include <terminal.h>
 #include <syscall.h>
 #include <system.h>
+#include <spinlock.h>
 
 mouse_info mouse_i;
 static int x_pos;
 static int y_pos;
 static uint8_t old_char;
+static DEFINE_SPINLOCK(mouse_lock); // guards the cursor position and mouse_i
 
 static uint8_t read_port(void);
 static void command_ready(void);
@@ -107,11 +109,10 @@ void mouse_init(void){
 */
 void mouse_handler(void){
     unsigned long flags;
-    cli_and_save(flags); // critical section begins
     uint8_t packet[3];
+    spin_lock_irqsave(&mouse_lock, flags);
     if(!(inb(0x64) & 0x20)){
-      sti();
-      restore_flags(flags); // critical section ends
+      spin_unlock_irqrestore(&mouse_lock, flags);
       clear_port();
       return;
     }
@@ -119,8 +120,7 @@ void mouse_handler(void){
     packet[0] = read_port();  
     //check for overflow and always1, if they are set, discard the entire packet
     if((packet[0] & 0xc0) || !(packet[0] & 0x08) || (packet[0] & 0x07)){
-      sti();
-      restore_flags(flags); // critical section ends
+      spin_unlock_irqrestore(&mouse_lock, flags);
       clear_port();
       return;
     }
@@ -159,8 +159,7 @@ void mouse_handler(void){
     }
     //TODO: left or right button
 
-    sti();
-    restore_flags(flags); // critical section ends
+    spin_unlock_irqrestore(&mouse_lock, flags);
     clear_port();
 }
 
@@ -16,6 +16,7 @@
 #include <debug.h>
 #include <mem.h>
 #include <time.h>
+#include <wait.h>
 
 
 // inspire by http://wiki.osdev.org/Intel_Ethernet_i217;
@@ -31,6 +32,7 @@ static uint8_t * package_buf;
 static uint32_t package_len = 0;
 static uint32_t ip [4];
 static volatile uint32_t SEND_DHCP = 0;
+static DECLARE_WAIT_QUEUE(net_rx_wait); // processes waiting for packets to arrive
 
 //MMIOutils struct function
 
@@ -185,15 +187,15 @@ int32_t get_package(void * buf, uint32_t nbytes) {
     return nbytes;
 }
 int32_t get_ip(){
+	uint32_t flags, left = 1000;
 	SEND_DHCP=0;
 	send_dhcp_discover();
-	sti();
-	uint32_t ms = system_time.count_ms;
-	while (SEND_DHCP == 0) {
-		if (system_time.count_ms - ms > 1000)
-			return -1;
-	}
-	return 0;
+	// sleep until the receive path has answered the offer, for a second at most
+	cli_and_save(flags);
+	while (SEND_DHCP == 0 && left > 0)
+		left = sleep_on_timeout(&net_rx_wait, left);
+	restore_flags(flags);
+	return (SEND_DHCP == 0) ? -1 : 0;
 }
 int32_t get_ipconfig(void*buf){
 	int i =0;
@@ -425,7 +427,7 @@ void printMac(){
 uint32_t net_start ()
 {
 	int i;
-	package_buf = (uint8_t *)malloc(1024);
+	package_buf = (uint8_t *)malloc(PACKAGE_BUF_SIZE); // every received frame fits, so realloc in handleReceive stays in place
     detectEEProm (pointer);
     if (! readMACAddress()) return FALSE;
     //startLink();  ////////startlink
@@ -519,6 +521,8 @@ void handleReceive()
             pointer->rx_cur = (pointer->rx_cur + 1) % E1000_NUM_RX_DESC;
             writeCommand(REG_RXDESCTAIL, old_cur );
     }
+    if (got_packet)
+        wake_up(&net_rx_wait);
    // printf("here");
 }
 
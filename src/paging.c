@@ -6,6 +6,8 @@
 
 #include <paging.h>
 #include <system.h>
+#include <lib.h>
+#include <proc.h>
 
 #define VIDEO 0xB8000
 
@@ -19,11 +21,110 @@ uint32_t page_directory [NUM_PDE] __attribute__((aligned(PAGE_SIZE)));
 /// multiples of a page size (4kB)
 uint32_t first_page_table [NUM_PTE] __attribute__((aligned(PAGE_SIZE)));
 
-// program page table; used to house 4kb pages
-uint32_t prog_page_table[NUM_PTE] __attribute__((aligned(PAGE_SIZE)));
+/// Each process has its own page directory, allocated along with its pcb.
+/// Kernel entries are copied from page_directory and kept in sync by
+/// set_kernel_pde; the user page table and the video page table are
+/// private to the process.
+
+// heap page tables; one per 4mb of the heap window, installed in the page directory as the heap grows
+uint32_t heap_page_table[HEAP_PDE_NUM][NUM_PTE] __attribute__((aligned(PAGE_SIZE)));
+
+static tlb_batch_t tlb_batch; // invalidations deferred by the current batch
+
+/* table_phys
+   description: get the physical address of a page directory or page table. tables of processes come from the heap; the master tables are part of the kernel image, which is mapped one-to-one.
+   input: table - virtual address of the table
+   output: none
+   return value: physical address of the table
+   side effect: none
+*/
+static uint32_t table_phys(uint32_t* table) {
+    uint32_t addr = (uint32_t)table;
+    if (addr >= HEAP_VIRT_TOP && addr < HEAP_VIRT_TOP + HEAP_SIZE)
+        return heap_virt_to_phys(addr);
+    return addr;
+}
+
+
+/* tlb_batch_begin
+   description: start deferring tlb invalidations. interrupts stay off until the outermost batch is flushed, so a context switch cannot observe stale entries of a batch in flight.
+   input: none
+   output: none
+   return value: none
+   side effect: disables interrupts
+*/
+void tlb_batch_begin(void) {
+    uint32_t flags;
+    cli_and_save(flags);
+    if (tlb_batch.depth++ == 0) {
+        tlb_batch.flags = flags;
+        tlb_batch.nr = 0;
+    }
+}
+
+
+/* tlb_batch_add
+   description: invalidate the tlb entry of a page whose mapping changed. inside a batch the address is only recorded. only heap pages are mapped on every cpu; the others belong to the process running here.
+   input: virt_addr - virtual address of the page
+   output: none
+   return value: none
+   side effect: none
+*/
+void tlb_batch_add(uint32_t virt_addr) {
+    if (virt_addr >= HEAP_VIRT_TOP && virt_addr < HEAP_VIRT_TOP + HEAP_SIZE)
+        tlb_gen++; // other cpus may cache it too; they flush before they next run kernel code, see lock_kernel
+    if (tlb_batch.depth == 0) {
+        invlpg(virt_addr);
+        return;
+    }
+    if (tlb_batch.nr < TLB_BATCH_MAX)
+        tlb_batch.addr[tlb_batch.nr] = virt_addr;
+    tlb_batch.nr++;
+}
+
+
+/* tlb_batch_flush
+   description: end a batch. recorded pages are invalidated one by one, or all at once if the batch overflowed.
+   input: none
+   output: none
+   return value: none
+   side effect: restores interrupt flags once the outermost batch ends
+*/
+void tlb_batch_flush(void) {
+    uint32_t i;
+    if (tlb_batch.depth == 0 || --tlb_batch.depth > 0)
+        return;
+    if (tlb_batch.nr > TLB_BATCH_MAX)
+        flush_tlb_global(); // heap pages are global, a cr3 reload would miss them
+    else {
+        for (i = 0; i < tlb_batch.nr; i++)
+            invlpg(tlb_batch.addr[i]);
+    }
+    tlb_batch.nr = 0;
+    restore_flags(tlb_batch.flags);
+}
+
+
+/* set_kernel_pde
+   description: set a kernel page directory entry in the master directory and in every process directory. proc_lock keeps proc_table still meanwhile: a directory is not freed under it, and one copied from the master directory is published in the same write section as the copy, see proc_alloc
+   input: pde_idx - index of the page directory entry
+          pde - value of the entry
+   output: none
+   return value: none
+   side effect: Modifies all page directories
+*/
+static void set_kernel_pde(uint32_t pde_idx, uint32_t pde) {
+    uint32_t flags;
+    int i;
+    read_lock_irqsave(&proc_lock, flags);
+    page_directory[pde_idx] = pde;
+    for (i = 0; i < NUM_PROC; i++) {
+        if (proc_table[i] != NULL)
+            proc_table[i]->pgdir[pde_idx] = pde;
+    }
+    read_unlock_irqrestore(&proc_lock, flags);
+}
 
-// heap page table; 1024 4kb pages are assigned for malloc
-uint32_t heap_page_table[NUM_PTE] __attribute__((aligned(PAGE_SIZE)));
 
 /* map_virtual_4mb
    description: map a physical 4mb page to virtual page
@@ -37,8 +138,22 @@ uint32_t heap_page_table[NUM_PTE] __attribute__((aligned(PAGE_SIZE)));
 void map_virtual_4mb(uint32_t phys_start, uint32_t virt_start) {
     uint32_t pde_idx = virt_start >> 22;
     /* enable P flag, R/W flag, U/S flag, PS flag for the page */
-    page_directory[pde_idx] = (phys_start & 0xFFC00000 & ~EN_A) | EN_P | EN_RW | EN_US | EN_PS;
-    flush_tlb();
+    set_kernel_pde(pde_idx, (phys_start & 0xFFC00000 & ~EN_A) | EN_P | EN_RW | EN_US | EN_PS);
+    tlb_batch_add(virt_start);
+}
+
+
+/* map_mmio_4mb
+   description: identity map a physical 4mb page of device registers, uncached and for the kernel only
+   input: phys_start - starting address of physical 4mb page
+   output: none
+   return value: none
+   side effect: Modifies the page directory
+*/
+void map_mmio_4mb(uint32_t phys_start) {
+    uint32_t pde_idx = phys_start >> 22;
+    set_kernel_pde(pde_idx, (phys_start & 0xFFC00000 & ~EN_A) | EN_P | EN_RW | EN_PWT | EN_PCD | EN_PS);
+    tlb_batch_add(phys_start);
 }
 
 
@@ -55,35 +170,93 @@ void map_virtual_4kb_first(uint32_t phys_start, uint32_t virt_start) {
     uint32_t pde_idx = virt_start >> 22;
     uint32_t pte_idx = (virt_start << 10) >> 22;
     /* enable P flag, R/W flag, U/S flag, PS flag for the page */
-    page_directory[pde_idx] = ((uint32_t)first_page_table & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW;
-    first_page_table[pte_idx] = (phys_start & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW;
-    flush_tlb();
+    set_kernel_pde(pde_idx, ((uint32_t)first_page_table & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW);
+    first_page_table[pte_idx] = (phys_start & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW | EN_G;
+    tlb_batch_add(virt_start);
 }
 
 
 /* map_virtual_4kb_prog
-   description: map a physical 4kb page to virtual page, whose page table entry resides in prog_page_table
-   input: phys_start - starting address of physical 4mb page
+   description: map a physical 4kb page to virtual page of a process, whose page table entry resides in the process's video page table
+   input: pid - pid of the process
+          phys_start - starting address of physical 4mb page
           virt_start - starting address of virtual 4mb page
    output: none
    return value: none
-   side effect: Modifies the page directory and page table
+   side effect: Modifies the page directory and page table of the process
    author: Kexuan Zou
 */
-void map_virtual_4kb_prog(uint32_t phys_start, uint32_t virt_start) {
+void map_virtual_4kb_prog(uint32_t pid, uint32_t phys_start, uint32_t virt_start) {
     uint32_t pde_idx = virt_start >> 22;
     uint32_t pte_idx = (virt_start << 10) >> 22;
+    pcb_t* pcb = get_pcb_by_pid(pid);
     /* enable P flag, R/W flag, U/S flag, PS flag for the page */
-    page_directory[pde_idx] = ((uint32_t)prog_page_table & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW | EN_US;
-    prog_page_table[pte_idx] = (phys_start & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW | EN_US;
-    flush_tlb();
+    pcb->pgdir[pde_idx] = (table_phys(pcb->prog_table) & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW | EN_US;
+    pcb->prog_table[pte_idx] = (phys_start & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW | EN_US;
+    if (cur_pgdir == pcb->pgdir) // other directories are not loaded here, nothing is cached for them
+        tlb_batch_add(virt_start);
+    else if (proc_running(pcb)) // loaded on another cpu, which flushes on its next way into the kernel
+        tlb_gen++;
+}
+
+
+/* pgdir_init
+   description: set up a fresh page directory for a process. kernel entries are shared, the user region is covered by the given 4kb page table whose entries are filled in on demand, and the video page table starts out empty.
+   input: pid - pid of the process
+   output: none
+   return value: none
+   side effect: Modifies the page directory of the process
+*/
+void pgdir_init(uint32_t pid) {
+    uint32_t flags;
+    pcb_t* pcb = get_pcb_by_pid(pid);
+    uint32_t* pgdir = pcb->pgdir;
+    write_lock_irqsave(&proc_lock, flags); // the directory is published, so a set_kernel_pde must not land in the middle of the copy
+    memcpy(pgdir, page_directory, sizeof(page_directory));
+    write_unlock_irqrestore(&proc_lock, flags);
+    memset(pcb->prog_table, 0, PAGE_SIZE);
+    /* enable P flag, R/W flag, U/S flag for the page table */
+    pgdir[USER_VIRT_TOP >> 22] = (table_phys(pcb->user_table) & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW | EN_US;
+    pgdir[VMEM_VIRT_START >> 22] = 0;
+    if (cur_pgdir == pgdir) // directory is live, drop the previous program's entries
+        flush_tlb();
+}
+
+
+/* switch_pgdir
+   description: switch to the address space of a process by loading its page directory. kernel pages are global and stay cached.
+   input: pid - pid of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+void switch_pgdir(uint32_t pid) {
+    uint32_t* pgdir = get_pcb_by_pid(pid)->pgdir;
+    if (cur_pgdir == pgdir)
+        return;
+    cur_pgdir = pgdir;
+    load_pgdir(table_phys(pgdir));
+}
+
+
+/* switch_kernel_pgdir
+   description: switch to the master page directory, which maps the kernel only. used by a process that is tearing down its own address space.
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void switch_kernel_pgdir(void) {
+    if (cur_pgdir == page_directory)
+        return;
+    cur_pgdir = page_directory;
+    load_pgdir(table_phys(page_directory));
 }
 
 
 /* set_virtual_4mb_heap
-   description: set page directory entry for heap
-   input: phys_start - starting address of physical 4mb page
-          virt_start - starting address of virtual 4mb page
+   description: set page directory entry for the heap page table that covers an address
+   input: virt_start - virtual address within the heap
    output: none
    return value: none
    side effect: Modifies the page directory and page table
@@ -91,14 +264,15 @@ void map_virtual_4kb_prog(uint32_t phys_start, uint32_t virt_start) {
 */
 void set_virtual_4mb_heap(uint32_t virt_start) {
     uint32_t pde_idx = virt_start >> 22;
-    /* enable P flag, R/W flag, U/S flag, PS flag for the page */
-    page_directory[pde_idx] = ((uint32_t)heap_page_table & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW | EN_US;
-    flush_tlb();
+    uint32_t* table = heap_page_table[HEAP_TABLE_IDX(virt_start)];
+    /* enable P flag, R/W flag for the page table. supervisor only: pcbs, kernel stacks and page tables live in the heap */
+    set_kernel_pde(pde_idx, ((uint32_t)table & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW);
+    tlb_batch_add(virt_start);
 }
 
 
 /* set_virtual_4kb_heap
-   description: set a physical 4kb page to virtual page, whose page table entry resides in heap_page_table
+   description: set a physical 4kb page to virtual page, whose page table entry resides in heap_page_table. the page table is installed first if this is the first page mapped in its 4mb. a not-present entry is never cached, so the tlb is only touched when an existing mapping is replaced.
    input: phys_start - starting address of physical 4mb page
           virt_start - starting address of virtual 4mb page
    output: none
@@ -108,9 +282,14 @@ void set_virtual_4mb_heap(uint32_t virt_start) {
 */
 void set_virtual_4kb_heap(uint32_t phys_start, uint32_t virt_start) {
     uint32_t pte_idx = (virt_start << 10) >> 22;
-    /* enable P flag, R/W flag, U/S flag, PS flag for the page */
-    heap_page_table[pte_idx] = (phys_start & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW | EN_US;
-    flush_tlb();
+    uint32_t* pte;
+    if (!(page_directory[virt_start >> 22] & EN_P)) // grow heap by one page table
+        set_virtual_4mb_heap(virt_start);
+    pte = &heap_page_table[HEAP_TABLE_IDX(virt_start)][pte_idx];
+    if (*pte & EN_P) // replacing a live mapping
+        tlb_batch_add(virt_start);
+    /* enable P flag, R/W flag, G flag for the page; supervisor only, like the page table */
+    *pte = (phys_start & 0xFFFFF000 & ~EN_A) | EN_P | EN_RW | EN_G;
 }
 
 
@@ -125,8 +304,22 @@ void set_virtual_4kb_heap(uint32_t phys_start, uint32_t virt_start) {
 */
 void free_virtual_4kb_heap(uint32_t virt_start) {
     uint32_t pte_idx = (virt_start << 10) >> 22;
-    heap_page_table[pte_idx] &= ~EN_P;
-    flush_tlb();
+    heap_page_table[HEAP_TABLE_IDX(virt_start)][pte_idx] &= ~EN_P;
+    tlb_batch_add(virt_start);
+}
+
+
+/* heap_virt_to_phys
+   description: translate a heap virtual address to the physical address backing it
+   input: virt_addr - virtual address within the heap
+   output: none
+   return value: physical address; 0 if the page is not mapped
+   side effect: none
+*/
+uint32_t heap_virt_to_phys(uint32_t virt_addr) {
+    uint32_t pte = heap_page_table[HEAP_TABLE_IDX(virt_addr)][(virt_addr << 10) >> 22];
+    if (!(pte & EN_P)) return 0;
+    return (pte & 0xFFFFF000) | (virt_addr & (PAGE_SIZE - 1));
 }
 
 
@@ -162,7 +355,7 @@ void setup_first_page_table(void) {
     // Set PDE pointing to this table
     // Set bit 0 (present flag) of corresponding PDE.
     // Set bit 1 (R/W flag) of corresponding PDE.
-    page_directory[0] = (uint32_t)first_page_table | EN_P | EN_RW;
+    set_kernel_pde(0, (uint32_t)first_page_table | EN_P | EN_RW);
 }
 
 ///
@@ -177,7 +370,8 @@ void setup_kernel_page(void) {
     // Set bit 0 (present flag) of the kernel page.
     // Set bit 1 (R/W flag) of the kernel page.
     // Set bit 7 (4MB page flag) of the kernel page.
-    page_directory[1] = 0x00400000 | EN_P | EN_RW | EN_PS;
+    // Set bit 8 (global flag) so the kernel page survives CR3 reloads.
+    set_kernel_pde(1, 0x00400000 | EN_P | EN_RW | EN_PS | EN_G);
 }
 
 ///
@@ -195,7 +389,8 @@ void setup_video_page(void) {
     i = (VIDEO >> 12) & 0x3FF;
 
     // Set bit 0 (present flag) and bit 1 (R/W flag) of video memory page.
-    first_page_table[i] = VIDEO | EN_P | EN_RW;
+    // Set bit 8 (global flag), video memory is mapped the same for everyone.
+    first_page_table[i] = VIDEO | EN_P | EN_RW | EN_G;
 }
 
 
@@ -226,7 +421,8 @@ void setup_history_page(void) {
     // Set bit 0 (present flag) of the kernel page.
     // Set bit 1 (R/W flag) of the kernel page.
     // Set bit 7 (4MB page flag) of the kernel page.
-    page_directory[9] = 0x02400000 | EN_P | EN_RW | EN_PS;
+    // Set bit 8 (global flag) of the kernel page.
+    set_kernel_pde(9, 0x02400000 | EN_P | EN_RW | EN_PS | EN_G);
 }
 
 ///
@@ -16,8 +16,10 @@
 #include <sched.h>
 #include <debug.h>
 #include <proc.h>
+#include <spinlock.h>
 
 volatile time_t system_time;
+static DEFINE_SPINLOCK(pit_lock); // a command and the data bytes that follow it must not be interleaved
 
 /* pit_read_freq
    description: reads current frequency from PIT
@@ -28,8 +30,8 @@ volatile time_t system_time;
 */
 uint16_t pit_read_freq(void) {
     unsigned long flags;
-    cli_and_save(flags); // critical section begins
     uint16_t ret_val;
+    spin_lock_irqsave(&pit_lock, flags);
     outb(LATCH_READ_CMD, PIT_CMD_PORT); // set latch read command
     asm volatile (
         "inb %1, %%al\n"
@@ -41,8 +43,7 @@ uint16_t pit_read_freq(void) {
         : "g" (CH0_DATA_PORT)// input operands
         : "%eax" // clobber list
     );
-    sti();
-    restore_flags(flags); // critical section ends
+    spin_unlock_irqrestore(&pit_lock, flags);
     return (uint16_t)(PIT_MAX_FREQ / ret_val);
 }
 
@@ -55,8 +56,7 @@ uint16_t pit_read_freq(void) {
    side effect: change PIT rate of interrupt
 */
 void pit_set_freq(uint32_t freq) {
-//    unsigned long flags;
-//    cli_and_save(flags); // critical section begins
+    unsigned long flags;
 
     /* normalize frequency */
     uint16_t divisor;
@@ -65,11 +65,49 @@ void pit_set_freq(uint32_t freq) {
     else divisor = (uint16_t)(PIT_MAX_FREQ / (uint16_t)freq);
 
     /* write command to prots */
+    spin_lock_irqsave(&pit_lock, flags);
     outb(CH0_RATE_CMD, PIT_CMD_PORT); // write command
     outb(divisor & 0xFF, CH0_DATA_PORT); // write low byte of PIT reload value
     outb(divisor >> 8, CH0_DATA_PORT); // write high byte of PIT reload value
-//    sti();
-//    restore_flags(flags); // critical section ends
+    spin_unlock_irqrestore(&pit_lock, flags);
+}
+
+
+/* pit_read_count
+   description: latch and read the current count of channel 0
+   input: none
+   output: none
+   return value: current count
+   side effect: none
+*/
+static uint32_t pit_read_count(void) {
+    unsigned long flags;
+    uint32_t count;
+    spin_lock_irqsave(&pit_lock, flags);
+    outb(LATCH_READ_CMD, PIT_CMD_PORT);
+    count = inb(CH0_DATA_PORT);
+    count |= inb(CH0_DATA_PORT) << 8;
+    spin_unlock_irqrestore(&pit_lock, flags);
+    return count;
+}
+
+
+/* pit_udelay
+   description: busy wait by polling the channel 0 counter, so it works with interrupts off and before any process
+                exists. the pit must already tick at MS_FREQ
+   input: us - microseconds to wait
+   output: none
+   return value: none
+   side effect: none
+*/
+void pit_udelay(uint32_t us) {
+    uint32_t need = us * (PIT_MAX_FREQ / 1000) / 1000;
+    uint32_t elapsed = 0, last = pit_read_count(), now;
+    while (elapsed < need) {
+        now = pit_read_count();
+        elapsed += (last >= now) ? last - now : last + MS_DIV - now; // the counter reloads at MS_DIV
+        last = now;
+    }
 }
 
 
@@ -82,13 +120,14 @@ void pit_set_freq(uint32_t freq) {
 */
 void pit_init(void) {
     int_set_idt(PIT_IRQ_PIN); // set idt entry for pit
+    yield_set_idt(); // processes also enter the scheduler on their own through the yield vector
     pit_set_freq(MS_FREQ); // set PIT ticking frequency
     enable_irq(PIT_IRQ_PIN); // enable irq for pit
 }
 
 
 /* pit_handler
-   description: increment time counter
+   description: increment time counter, fire due timers, and charge the running process for the tick
    input: none
    output: none
    return value: none
@@ -96,8 +135,8 @@ void pit_init(void) {
 */
 void pit_handler(void) {
     system_time.count_ms++;
+    run_timers();
 #ifndef RUN_TESTS
-    if (!(system_time.count_ms % TIME_QUANTUM) && cur_proc_pcb != NULL)
-        do_sched();
+    sched_tick();
 #endif
 }
@@ -8,6 +8,7 @@
 #include <types.h>
 #include <proc.h>
 #include <paging.h>
+#include <vm.h>
 #include <terminal.h>
 #include <lib.h>
 #include <terminal.h>
@@ -15,19 +16,31 @@
 #include <x86_desc.h>
 #include <system.h>
 #include <mem.h>
+#include <sched.h>
+#include <bitmap.h>
+#include <signal.h>
+#include <time.h>
+#include <fpu.h>
 
-pcb_t* cur_proc_pcb = NULL; // declared in proc.h
+pcb_t* proc_table[NUM_PROC]; // declared in proc.h
 uint8_t proc_status[NUM_PROC]; // declared in proc.h
+uint32_t proc_state_cnt[NUM_PROC_STATE] = { NUM_PROC }; // declared in proc.h; every pcb starts out inactive
+static uint32_t pid_map[BITS_TO_LONG(NUM_PROC)]; // one bit per pid, set while the pid is taken
+static uint32_t last_pid = NUM_PROC - 1; // pids are handed out round robin, starting after the last one taken
+static LIST_HEAD(zombie_list); // exited processes whose pcb is not released yet
+DEFINE_RWLOCK(proc_lock); // declared in proc.h
+
+static void __proc_set_state(pcb_t* pcb, uint8_t state);
 
 /* get_pcb_by_pid
    description: return pcb pointer of a process specified by its pid.
    input: pid - pid of the process
    output: none
-   return value: target pcb pointer
+   return value: target pcb pointer; NULL if no process has that pid
    side effect: none
 */
 pcb_t* get_pcb_by_pid(uint32_t pid) {
-    return (pcb_t* ) (KERNEL_BOT - KSTACK_SIZE * (pid + 1));
+    return (pid < NUM_PROC) ? proc_table[pid] : NULL;
 }
 
 
@@ -39,19 +52,152 @@ pcb_t* get_pcb_by_pid(uint32_t pid) {
    side effect: none
 */
 uint32_t get_esp0_by_pid(uint32_t pid) {
-    return (uint32_t) (KERNEL_BOT - KSTACK_SIZE * pid - 4);
+    return (uint32_t)get_pcb_by_pid(pid) + KSTACK_SIZE - 4;
+}
+
+
+/* pid_alloc
+   description: take the next free pid after the last one handed out, so a pid is not reused right after it is freed
+   input: none
+   output: none
+   return value: pid; -1 if every pid is taken
+   side effect: none
+*/
+static int32_t pid_alloc(void) {
+    uint32_t pid = find_next_zero_bit(pid_map, NUM_PROC, last_pid + 1);
+    if (pid >= NUM_PROC)
+        pid = find_first_zero_bit(pid_map, NUM_PROC);
+    if (pid >= NUM_PROC)
+        return -1;
+    bitmap_set_bit(pid_map, pid);
+    last_pid = pid;
+    return (int32_t)pid;
+}
+
+
+/* proc_free
+   description: release the pcb, kernel stack and paging structures of a process whose pid has been released
+   input: pcb - pcb of the process; must not be running on its kernel stack
+   output: none
+   return value: none
+   side effect: none
+*/
+static void proc_free(pcb_t* pcb) {
+    free_pages(pcb->pgdir, 0);
+    free_pages(pcb->user_table, 0);
+    free_pages(pcb->prog_table, 0);
+    free_pages(pcb, KSTACK_ORDER);
+}
+
+
+/* alarm_timeout
+   description: timer function of a process's alarm; raises ALARM at the process
+   input: data - pcb of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+static void alarm_timeout(uint32_t data) {
+    request_signal(ALARM, (pcb_t* )data);
+}
+
+
+/* proc_alloc
+   description: create a process: take a free pid, and allocate its pcb and kernel stack and its paging structures. the pcb sits at the bottom of the kernel stack block, which is aligned to KSTACK_SIZE, so get_cur_pcb still finds it from %esp.
+   input: none
+   output: none
+   return value: pcb of the process, in state INACTIVE; NULL if out of pids or memory
+   side effect: releases exited processes first
+*/
+pcb_t* proc_alloc(void) {
+    uint32_t flags;
+    int32_t pid;
+    pcb_t* pcb;
+    uint32_t* tables[3]; // page directory, user page table, video page table
+    int i;
+
+    proc_reap();
+    write_lock_irqsave(&proc_lock, flags);
+    pid = pid_alloc();
+    write_unlock_irqrestore(&proc_lock, flags);
+    if (pid == -1)
+        return NULL;
+    pcb = (pcb_t* )alloc_pages(KSTACK_ORDER);
+    for (i = 0; i < 3; i++)
+        tables[i] = (uint32_t* )alloc_pages(0);
+    if (pcb == NULL || tables[0] == NULL || tables[1] == NULL || tables[2] == NULL) { // give back whatever was allocated
+        free_pages(pcb, KSTACK_ORDER);
+        for (i = 0; i < 3; i++)
+            free_pages(tables[i], 0);
+        write_lock_irqsave(&proc_lock, flags);
+        bitmap_clear_bit(pid_map, pid);
+        write_unlock_irqrestore(&proc_lock, flags);
+        return NULL;
+    }
+
+    memset(pcb, 0, sizeof(pcb_t));
+    pcb->pid = pid;
+    pcb->pgdir = tables[0];
+    pcb->user_table = tables[1];
+    pcb->prog_table = tables[2];
+    init_list_head(&(pcb->wait_node));
+    timer_init(&(pcb->alarm), alarm_timeout, (uint32_t)pcb);
+    pcb->slice = SCHED_SLICE(0);
+    memset(pcb->user_table, 0, PAGE_SIZE);
+    memset(pcb->prog_table, 0, PAGE_SIZE);
+    /* copy the kernel entries and publish the directory at once, so set_kernel_pde either ran before the copy or sees it */
+    write_lock_irqsave(&proc_lock, flags);
+    memcpy(pcb->pgdir, page_directory, sizeof(page_directory));
+    proc_table[pid] = pcb;
+    write_unlock_irqrestore(&proc_lock, flags);
+    return pcb;
 }
 
 
-/* get_phys_addr_by_pid
-   description: get physical address of a process by its pid; processes are loaded in memory by after kernel space (4mb - 8mb) by pid
-   input: pid - pid of the porcess
+/* proc_reap
+   description: release every exited process that no cpu is running on its kernel stack any more. their pids are released under proc_lock, and their memory once it is dropped.
+   input: none
    output: none
-   return value: starting physical address
+   return value: none
    side effect: none
 */
-uint32_t get_phys_addr_by_pid(uint32_t pid) {
-    return KERNEL_BOT + pid * PROG_PAGE_SIZE;
+void proc_reap(void) {
+    uint32_t flags;
+    struct list_head* node;
+    pcb_t* pcb, * running = get_cur_pcb();
+    LIST_HEAD(reaped);
+    write_lock_irqsave(&proc_lock, flags);
+    for (node = zombie_list.next; node != &zombie_list; ) {
+        pcb = LIST_ENTRY(node, pcb_t, run_node);
+        node = node->next;
+        if (pcb != running && !proc_running(pcb)) {
+            __proc_set_state(pcb, INACTIVE);
+            proc_table[pcb->pid] = NULL;
+            bitmap_clear_bit(pid_map, pcb->pid);
+            list_insert_before(&(pcb->run_node), &reaped);
+        }
+    }
+    write_unlock_irqrestore(&proc_lock, flags);
+    while (!list_is_empty(&reaped)) {
+        pcb = LIST_ENTRY(reaped.next, pcb_t, run_node);
+        list_delete(&(pcb->run_node));
+        proc_free(pcb);
+    }
+}
+
+
+/* proc_vidmap_update
+   description: point a process's video memory page at the screen if its session is the active one, or at its session's cached video memory otherwise
+   input: cur_pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: Modifies the process's page table
+*/
+void proc_vidmap_update(pcb_t* cur_pcb) {
+    if (cur_pcb->active_sess == cur_sess_id)
+        map_virtual_4kb_prog(cur_pcb->pid, VIDEO, VMEM_VIRT_START);
+    else
+        map_virtual_4kb_prog(cur_pcb->pid, sess_desc[cur_pcb->active_sess].cached_vidmem, VMEM_VIRT_START);
 }
 
 
@@ -180,39 +326,99 @@ void fd_array_init(void) {
 }
 
 
-/* query_proc_status
-   description: query how many process have the specified status
-   input: status - runtime status of the process
+/* fd_array_dup
+   description: give a child a copy of its parent's file descriptors. ext2 files get their own dentry chain so either side can close them.
+   input: parent_pcb - parent pcb pointer
+          child_pcb - child pcb pointer
    output: none
-   return value: number of processes with the given status
+   return value: 0 if success; -1 if out of memory, the child is then left with no files open
    side effect: none
 */
-uint32_t query_proc_status(uint8_t status) {
-    uint32_t i, retval;
-    for (i = 0, retval = 0; i < NUM_PROC; i++) {
-        if (proc_status[i] == status) retval++;
+int32_t fd_array_dup(pcb_t* parent_pcb, pcb_t* child_pcb) {
+    int i;
+    file_t* file;
+    dentry_t* parent;
+    child_pcb->fd_bitmap = 0;
+    for (i = 0; i < MAX_OPEN_FILES; i++) {
+        file = child_pcb->fd_array + i;
+        *file = parent_pcb->fd_array[i];
+        if (!(parent_pcb->fd_bitmap & (1 << i)))
+            continue;
+        if (file->f_op == ext2_file_fop || file->f_op == ext2_dir_fop) {
+            if ((parent = dup_dentry(file->f_dentry.d_parent)) == NULL) {
+                fd_array_close(child_pcb);
+                return -1;
+            }
+            file->f_dentry.d_parent = parent;
+        }
+        child_pcb->fd_bitmap |= 1 << i;
     }
-    return retval;
+    return 0;
 }
 
 
-/* get_next_pid
-   description: get next process's pid given current pid and status of target process
-   input: cur_pid - current pid
-          status - runtime status of the process
+/* fd_array_close
+   description: close every file a process has open, releasing what the open files hold
+   input: pcb - pcb of the process
    output: none
-   return value: next available process's pid
+   return value: none
    side effect: none
 */
-uint32_t get_next_pid(uint32_t cur_pid, uint8_t status) {
-    uint32_t i = cur_pid + 1; // loop iterator
-    for (; i < NUM_PROC; i++) {
-        if (proc_status[i] == status) return i;
+void fd_array_close(pcb_t* pcb) {
+    int i;
+    file_t* file;
+    for (i = 0; i < MAX_OPEN_FILES; i++) {
+        if (!(pcb->fd_bitmap & (1 << i)))
+            continue;
+        file = pcb->fd_array + i;
+        file->f_op->close(file);
     }
-    for (i = 0; i < cur_pid; i++) {
-        if (proc_status[i] == status) return i;
+    pcb->fd_bitmap = 0;
+}
+
+
+/* proc_set_state
+   description: move a process to a new state, keeping the run queue and the per-state counts in step. a process joins the back of the run queue when it becomes runnable or pending, and leaves it for any other state; an exited process waits in the zombie list until it is reaped. a blocked process leaves the wait queue it sleeps on, if any, once it is woken up or killed.
+   input: pcb - pcb of the process, pid must be set
+          state - new runtime status of the process
+   output: none
+   return value: none
+   side effect: may add the process to or remove it from the run queue
+*/
+void proc_set_state(pcb_t* pcb, uint8_t state) {
+    uint32_t flags;
+    write_lock_irqsave(&proc_lock, flags);
+    __proc_set_state(pcb, state);
+    write_unlock_irqrestore(&proc_lock, flags);
+}
+
+
+/* __proc_set_state
+   description: proc_set_state for a caller that holds proc_lock for writing
+   input: pcb - pcb of the process, pid must be set
+          state - new runtime status of the process
+   output: none
+   return value: none
+   side effect: may add the process to or remove it from the run queue
+*/
+static void __proc_set_state(pcb_t* pcb, uint8_t state) {
+    uint8_t old_state;
+    old_state = proc_status[pcb->pid];
+    if (STATE_QUEUED(old_state) && !STATE_QUEUED(state))
+        sched_dequeue(pcb);
+    else if (old_state == ZOMBIE)
+        list_delete(&(pcb->run_node));
+    else if (old_state == BLOCKED && !list_is_empty(&(pcb->wait_node))) {
+        list_delete(&(pcb->wait_node));
+        init_list_head(&(pcb->wait_node));
     }
-    return NUM_PROC;
+    if (!STATE_QUEUED(old_state) && STATE_QUEUED(state))
+        sched_enqueue(pcb);
+    else if (state == ZOMBIE)
+        list_insert_before(&(pcb->run_node), &zombie_list);
+    proc_state_cnt[old_state]--;
+    proc_state_cnt[state]++;
+    proc_status[pcb->pid] = state;
 }
 
 
@@ -225,38 +431,29 @@ uint32_t get_next_pid(uint32_t cur_pid, uint8_t status) {
    side effect: none
 */
 pcb_t* child_pcb_init(pcb_t* parent_pcb) {
-    uint32_t child_pid; // child pid
     pcb_t* child_pcb;
-    int i; // loop iterator
-
-    /* if the process does not have a parent it is a startup process */
-    if (parent_pcb == NULL) {
-        child_pid = 0;
-        goto cont;
-    }
-
-    /* if the process has a parent and valid pid is assigned*/
-    for (i = 0; i < NUM_PROC; i++) {
-        if (proc_status[i] == INACTIVE) { // if vacant spot is found
-            child_pid = (uint32_t) i;
-            goto cont;
-        }
-    }
-    return NULL; // if no valid pid can be obtained return -1
 
-cont:
-    child_pcb = get_pcb_by_pid(child_pid); // get child pcb
+    /* if the process does not have a parent it is a startup process, which takes pid 0 */
+    if (parent_pcb == NULL && proc_table[0] != NULL)
+        child_pcb = proc_table[0];
+    else if ((child_pcb = proc_alloc()) == NULL)
+        return NULL; // if no pid or memory can be obtained
+    child_pcb->cpu = smp_cpu_id(); // a child starts out on the cpu of its parent
 
     /* set up child pcb struct */
-    proc_status[child_pid] = ACTIVE; // set child process to active
-    child_pcb->pid = child_pid;
+    proc_set_state(child_pcb, ACTIVE); // set child process to active
     if (parent_pcb != NULL) {
         child_pcb->parent_pid = parent_pcb->pid;
         child_pcb->active_sess = parent_pcb->active_sess;
+        child_pcb->nice = parent_pcb->nice; // a child runs at its parent's priority
+        sched_set_level(child_pcb, child_pcb->nice);
     }
     clear_args(child_pcb);
     child_pcb->uptime = 0;
+    memset(child_pcb->acct, 0, sizeof(child_pcb->acct));
+    fpu_release(child_pcb); // a new program starts with a clean fpu
     child_pcb->prog_break = 0UL;
+    child_pcb->ring = 0; // the rings belong to the program image they were set up in
     return child_pcb;
 }
 
@@ -317,46 +514,55 @@ void file_io_init(int8_t * fin, int8_t * fout) {
 void kill_pid(uint32_t pid, int32_t exit_code) {
     struct regs * parent_regs;
     pcb_t* cur_pcb = get_pcb_by_pid(pid);
+    timer_del(&(cur_pcb->alarm)); // an alarm does not outlive the program that set it
+    fpu_release(cur_pcb);
 
     /* if try to halt root process */
     if (cur_pcb->parent_pid == NUM_PROC) {
         cur_pcb->uptime = 0; // reset the timer
-        proc_status[pid] = PENDING; // mark current process as pending
-        sti(); // enable interrupts
-        while(1); // spin until time quantum passes
+        memset(cur_pcb->acct, 0, sizeof(cur_pcb->acct));
+        proc_set_state(cur_pcb, PENDING); // mark current process as pending
+        cli();
+        while (1) // the scheduler reloads the shell when it comes up in the run queue
+            sched_idle();
+    }
+
+    /* a forked process has no parent waiting on it; drop its address space and leave the cpu for good, the pcb is released once the scheduler has moved on */
+    if (cur_pcb->parent_esp == 0) {
+        cli();
+        fd_array_close(cur_pcb); // its dentry chains are its own, see fd_array_dup
+        proc_set_state(cur_pcb, ZOMBIE);
+        switch_kernel_pgdir();
+        vm_release(pid);
+        while (1)
+            sched_idle();
     }
     pcb_t* child_pcb = cur_pcb; // set child pcb
 
+    cli(); // no context switch until control is back in the parent
     cur_pcb = get_parent_pcb(child_pcb); // set current pcb to be parent of child pcb
-    proc_status[child_pcb->pid] = INACTIVE; // child process is finished
-    proc_status[cur_pcb->pid] = ACTIVE; // resume execution of parent process
+    proc_set_state(child_pcb, ZOMBIE); // child process is finished, its stack is released once left behind
+    proc_set_state(cur_pcb, ACTIVE); // resume execution of parent process
 
     /* relink sigaction linkage pcb field */
     link_sa_pcb(cur_pcb, cur_sess_id);
 
-    /* rempas program virtual page (128mb - 132mb) to current process */
-    uint32_t prog_phys_addr;
-    if (cur_pcb != NULL) {
-        prog_phys_addr = get_phys_addr_by_pid(cur_pcb->pid);
-        map_virtual_4mb(prog_phys_addr, USER_VIRT_TOP);
-    }
-
-    /* if switching to current session from daemon session, then current process running must switch back to active and write to video memory */
-    if (cur_pcb->active_sess == cur_sess_id)
-        map_virtual_4kb_prog(VIDEO, VMEM_VIRT_START);
-
-    /* if switching away from current session, then current process running must run as daemon and write to its assigned cached video memory */
-    else
-        map_virtual_4kb_prog(sess_desc[cur_pcb->active_sess].cached_vidmem, VMEM_VIRT_START);
+    /* switch back to the parent's address space; its video page is kept up to date by sess_switch */
+    switch_pgdir(cur_pcb->pid);
+    vm_release(child_pcb->pid); // child's pages are no longer reachable
 
     /* set tss esp0 to be parent esp */
-    tss.esp0 = get_esp0_by_pid(child_pcb->parent_pid);
+    this_cpu()->tss->esp0 = get_esp0_by_pid(child_pcb->parent_pid);
 
     /* set video memory */
     set_vidmem_param(VMEM_VIRT_START);
 
     /* set current pcb */
+    acct_charge(); // the child pays for its exit
+    cur_pcb->cpu = smp_cpu_id(); // the parent goes on here, wherever it called execute
     cur_proc_pcb = cur_pcb;
+    fpu_switch(cur_pcb);
+    this_cpu()->lock_depth = cur_pcb->lock_depth; // as deep as when it called execute
 
     /* return to parent. restores parent esp and ebp, return exit_code */
     parent_regs = (struct regs *)child_pcb->parent_esp;
@@ -0,0 +1,88 @@
+/* ring.c - submission and completion rings, see ring.h. Operations run one after another in sys_ring_enter, through
+   the same system call functions and file operation jump tables a trap would reach; the ring only saves the traps.
+*/
+
+#include <ring.h>
+#include <types.h>
+#include <lib.h>
+#include <proc.h>
+#include <vm.h>
+#include <syscall.h>
+
+/* ring_setup
+   description: give the current process its rings, in an anonymous mapping of its address space
+   input: entries - length of each queue, a power of two up to RING_MAX_ENTRIES
+   output: none
+   return value: address of the shared region; -1 if the length is invalid, the process has its rings already, or there is no room
+   side effect: none
+*/
+int32_t ring_setup(uint32_t entries) {
+    ring_t* ring;
+    int32_t addr;
+    if (entries == 0 || entries > RING_MAX_ENTRIES || (entries & (entries - 1)))
+        return -1;
+    if (cur_proc_pcb->ring != 0)
+        return -1;
+    if ((addr = vm_mmap(RING_SIZE(entries))) == -1)
+        return -1;
+    ring = (ring_t* )addr;
+    ring->sq_head = ring->sq_tail = 0;
+    ring->cq_head = ring->cq_tail = 0;
+    ring->entries = entries;
+    cur_proc_pcb->ring = addr;
+    cur_proc_pcb->ring_entries = entries;
+    return addr;
+}
+
+
+/* ring_do
+   description: run one submitted operation
+   input: sqe - kernel copy of the submission
+   output: none
+   return value: result of the operation; -1 for an unknown opcode
+   side effect: may block, like the system call it stands for
+*/
+static int32_t ring_do(const ring_sqe_t* sqe) {
+    switch (sqe->opcode) {
+        case RING_OP_NOP: return 0;
+        case RING_OP_READ: return sys_read(sqe->fd, (void* )sqe->addr, sqe->len);
+        case RING_OP_WRITE: return sys_write(sqe->fd, (const void* )sqe->addr, sqe->len);
+        case RING_OP_OPEN: return sys_open((const int8_t* )sqe->addr);
+        case RING_OP_CLOSE: return sys_close(sqe->fd);
+        case RING_OP_SEEK: return sys_seek(sqe->fd, (int32_t)sqe->len, (int32_t)sqe->whence);
+        default: return -1;
+    }
+}
+
+
+/* ring_enter
+   description: take submissions off the ring of the current process and post their completions. it stops early when the submission queue runs empty or the completion queue is full; the program reaps completions and enters again.
+   input: to_submit - most submissions to take
+   output: none
+   return value: number of submissions taken; -1 if the process has no rings
+   side effect: none
+*/
+int32_t ring_enter(uint32_t to_submit) {
+    ring_t* ring = (ring_t* )cur_proc_pcb->ring;
+    uint32_t entries = cur_proc_pcb->ring_entries, mask = entries - 1;
+    uint32_t head, done = 0;
+    ring_sqe_t sqe;
+    ring_cqe_t* cqe;
+    if (ring == NULL)
+        return -1;
+    head = ring->sq_head;
+    while (done < to_submit && head != ring->sq_tail) {
+        if (ring->cq_tail - ring->cq_head >= entries)
+            break;
+        sqe = RING_SQES(ring)[head & mask]; // the program may reuse the slot as soon as sq_head passes it
+        asm volatile ("" : : : "memory");
+        ring->sq_head = ++head;
+        cqe = &RING_CQES(ring, entries)[ring->cq_tail & mask];
+        cqe->user_data = sqe.user_data;
+        cqe->res = ring_do(&sqe);
+        asm volatile ("" : : : "memory"); // the completion is filled in before the program can see it
+        ring->cq_tail++;
+        done++;
+    }
+    return done;
+}
@@ -10,8 +10,10 @@
 #include <idt.h>
 #include <proc.h>
 #include <vfs.h>
+#include <wait.h>
 
-volatile int wait;
+static volatile uint32_t rtc_ticks; // number of RTC interrupts so far
+static DECLARE_WAIT_QUEUE(rtc_wait); // readers waiting for the next interrupt
 
 /// File operations for RTC.
 static int32_t rtc_fopen(file_t * self, const int8_t * filename);
@@ -35,11 +37,12 @@ file_op_t * rtc_fop = &rtc_fops;
 /// Handles an RTC interrupt.
 ///
 /// - author: Zhengcheng Huang
-/// - side effects: Writes garbage to video memory (for now).
+/// - side effects: Wakes up readers waiting for the interrupt.
 ///
 void rtc_handler(void) {
    //test_interrupts();
-   wait = 1;
+   rtc_ticks++;
+   wake_up(&rtc_wait);
    outb(0x0C, INDEX_PORT);  // select register C
    inb(VALUE_PORT);
 
@@ -73,7 +76,6 @@ void rtc_init(void){
     outb((prev & MASK_KEEP_SETTINGS) | SHIFT, VALUE_PORT);
 
     enable_irq(RTC_IRQ_PIN);
-    wait = 0;
 }
 
 ///
@@ -131,15 +133,14 @@ int32_t rtc_fopen(file_t * self, const int8_t * filename) {
 ///
 /// File read operation for RTC.
 ///
-/// This function returns only on the next RTC interrupt.
+/// This function returns only on the next RTC interrupt. The reader sleeps
+/// until then instead of spinning.
 ///
 int32_t rtc_fread(file_t * self, void * buf, uint32_t nbytes) {
-    sti();
+    uint32_t start = rtc_ticks;
 
-    // Starts waiting.
-    wait = 0;
-    // Wait.
-    while (!wait);
+    // Sleep until the tick count moves on.
+    wait_event(&rtc_wait, rtc_ticks != start);
 
     return 0;
 }
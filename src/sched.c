@@ -1,4 +1,12 @@
-/* sched.c - Scheduler for the OS. This scheduler uses round-robin algorithm and time quantum for each process is 15ms.
+/* sched.c - Scheduler for the OS. This scheduler is a multilevel feedback queue with SCHED_LEVELS priority levels.
+   Processes that can run wait in a fifo run queue per level, and a bitmap of non-empty levels finds the head of the
+   highest one, so scheduling cost does not depend on the number of processes. A process that uses up its time slice
+   drops one level, where slices are twice as long; one that sleeps keeps its level, and one woken by keyboard input
+   goes back to its base level, so interactive shells stay ahead of cpu-bound jobs. A process never runs above its
+   base level (its nice value), and all processes are lifted back to it every SCHED_BOOST_PERIOD ms. Each cpu has its
+   own run queues and only runs what waits in them; a cpu with nothing to run, and every cpu each SCHED_BALANCE_PERIOD
+   ms, pulls a process over from the cpu with the most waiting. An idle cpu has no tick, so a busy one with processes
+   waiting wakes it up to pull.
    author: Kexuan Zou
    date: 11/14/2017
 */
@@ -8,6 +16,7 @@
 #include <lib.h>
 #include <paging.h>
 #include <proc.h>
+#include <vm.h>
 #include <vfs.h>
 #include <mod_fs.h>
 #include <ext2.h>
@@ -15,19 +24,34 @@
 #include <x86_desc.h>
 #include <pit.h>
 #include <i8259.h>
+#include <time.h>
+#include <acct.h>
+#include <fpu.h>
+#include <clock.h>
 
-pcb_t* cur_proc_pcb; // declared in proc.h
 uint8_t proc_status[NUM_PROC]; // declared in proc.h
 sess_t sess_desc[NUM_SESS]; // declared in terminal.h
 uint32_t cur_sess_id; // declared in terminal.h
+#define RUN_QUEUE_INIT(cpu) {                   \
+    {&run_queue[cpu][0], &run_queue[cpu][0]},   \
+    {&run_queue[cpu][1], &run_queue[cpu][1]},   \
+    {&run_queue[cpu][2], &run_queue[cpu][2]},   \
+    {&run_queue[cpu][3], &run_queue[cpu][3]}    \
+}
+list_head run_queue[MAX_CPUS][SCHED_LEVELS] = { // declared in sched.h
+    RUN_QUEUE_INIT(0), RUN_QUEUE_INIT(1), RUN_QUEUE_INIT(2), RUN_QUEUE_INIT(3),
+    RUN_QUEUE_INIT(4), RUN_QUEUE_INIT(5), RUN_QUEUE_INIT(6), RUN_QUEUE_INIT(7)
+};
+uint32_t run_map[MAX_CPUS]; // declared in sched.h
+uint32_t run_count[MAX_CPUS]; // declared in sched.h
 
 
 /* load_shell_img
-   description: get entry point of a shell program, load it into its designated memory, map virtual address for the program image.
+   description: get entry point of a shell program and set up its demand-paged address space.
    input: cur_pid - current pid
    output: none
    return value: shell program image's entry point
-   side effect: load program inage in its user space, map virtual memory
+   side effect: releases frames of the previous shell image, switch to the shell's page directory
 */
 uint32_t load_shell_img(uint32_t cur_pid) {
     uint32_t entry_point;
@@ -40,62 +64,228 @@ uint32_t load_shell_img(uint32_t cur_pid) {
     program.f_op->read(&program, cmd_buf, CMD_WORD_SIZE);
     entry_point = (uint32_t)cmd_buf[0] | ((uint32_t)cmd_buf[1] << 8) | ((uint32_t)cmd_buf[2] << 16) | ((uint32_t)cmd_buf[3] << 24);
 
-    /* initilize a 4mb page for user program; maps program physical address to virtual user space, copy data to the virtual memory space */
-    uint32_t prog_phys_addr = get_phys_addr_by_pid(cur_pid);
-    map_virtual_4mb(prog_phys_addr, USER_VIRT_TOP);
-
-    program.f_pos = 0;
-    program.f_op->read(&program, (void *)PROG_VIRT_START, program.f_dentry.d_inode.i_size);
+    /* initilize an empty address space for user program; pages of the image are read in as the shell touches them */
+    vm_proc_init(get_pcb_by_pid(cur_pid), &program.f_dentry.d_inode);
+    switch_pgdir(cur_pid);
     program.f_op->close(&program);
 
     return entry_point;
 }
 
 
+/* sched_pull
+   description: move one process from the run queues of the cpu with the most waiting to those of the running cpu, if
+                that evens them out. a process whose cpu still runs on its kernel stack stays, and the lowest levels go
+                first, since they hold the cpu-bound processes
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+static void sched_pull(void) {
+    uint32_t flags, i, cpu = smp_cpu_id(), busiest = cpu;
+    int32_t level;
+    struct list_head* node;
+    pcb_t* pcb;
+    if (num_online == 1) return;
+    write_lock_irqsave(&proc_lock, flags);
+    for (i = 0; i < num_cpus; i++) {
+        if (cpus[i].online && run_count[i] > run_count[busiest])
+            busiest = i;
+    }
+    if (busiest != cpu && run_count[busiest] > run_count[cpu] + (run_count[cpu] != 0)) {
+        for (level = SCHED_LEVELS - 1; level >= 0; level--) {
+            for (node = run_queue[busiest][level].next; node != &run_queue[busiest][level]; node = node->next) {
+                pcb = LIST_ENTRY(node, pcb_t, run_node);
+                if (proc_running(pcb))
+                    continue;
+                sched_dequeue(pcb);
+                pcb->cpu = cpu;
+                sched_enqueue(pcb);
+                goto out;
+            }
+        }
+    }
+out:
+    write_unlock_irqrestore(&proc_lock, flags);
+}
+
+
+/* sched_halt
+   description: halt the cpu until the next interrupt. the kernel lock is dropped meanwhile, so other cpus can enter the kernel
+   input: none
+   output: none
+   return value: none
+   side effect: must be called with interrupts off; they are still off when it returns
+*/
+static void sched_halt(void) {
+    uint32_t depth;
+    acct_switch(ACCT_IDLE);
+    clock_idle_enter();
+    this_cpu()->idle = 1;
+    depth = release_kernel_lock();
+    asm volatile ("sti\nhlt\ncli\n" : : : "memory"); // sti only takes effect after hlt, so no interrupt slips in between
+    reacquire_kernel_lock(depth);
+    this_cpu()->idle = 0;
+    clock_idle_exit();
+    acct_switch(ACCT_SYS);
+}
+
+
+/* sched_idle
+   description: let the process at the head of the highest run queue have the cpu, or halt the cpu until the next interrupt if no process can run here or be pulled from another cpu. this is the idle loop of a process that is not ACTIVE: one that sleeps, or one that has exited.
+   input: none
+   output: none
+   return value: none
+   side effect: must be called with interrupts off; they are still off when it returns
+*/
+void sched_idle(void) {
+    if (run_map[smp_cpu_id()] == 0)
+        sched_pull();
+    if (run_map[smp_cpu_id()] == 0)
+        sched_halt();
+    else
+        sched_yield();
+}
+
+
+/* sched_ap_loop
+   description: idle loop of an application processor before it has a process of its own: run whatever its run queues
+                or another cpu's hand it, and halt otherwise. once do_sched switches to a process, the cpu goes on from
+                there and idles in sched_idle of its processes, like the boot processor
+   input: none
+   output: none
+   return value: never returns
+   side effect: must be called holding the kernel lock
+*/
+void sched_ap_loop(void) {
+    cli();
+    while (1) {
+        if (run_map[smp_cpu_id()] == 0)
+            sched_pull();
+        if (run_map[smp_cpu_id()] == 0)
+            sched_halt();
+        else
+            do_sched();
+    }
+}
+
+
+/* sched_set_level
+   description: move a process to another priority level and give it a full time slice of that level. a process waiting in the run queue moves to the back of the new level.
+   input: pcb - pcb of the process
+          level - new level
+   output: none
+   return value: none
+   side effect: none
+*/
+void sched_set_level(pcb_t* pcb, uint8_t level) {
+    uint32_t flags;
+    uint8_t queued;
+    write_lock_irqsave(&proc_lock, flags);
+    queued = STATE_QUEUED(proc_status[pcb->pid]);
+    if (queued) sched_dequeue(pcb);
+    pcb->level = level;
+    pcb->slice = SCHED_SLICE(level);
+    if (queued) sched_enqueue(pcb);
+    write_unlock_irqrestore(&proc_lock, flags);
+}
+
+
+/* sched_boost
+   description: lift every process that dropped below its base level back to it
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+static void sched_boost(void) {
+    uint32_t pid;
+    pcb_t* pcb;
+    for (pid = 0; pid < NUM_PROC; pid++) {
+        pcb = proc_table[pid];
+        if (pcb != NULL && proc_status[pid] != INACTIVE && pcb->level != pcb->nice)
+            sched_set_level(pcb, pcb->nice);
+    }
+}
+
+
+/* sched_tick
+   description: charge the running process for one clock tick. it is preempted when its time slice runs out, and drops one level then, or as soon as a process of a higher level can run.
+   input: none
+   output: none
+   return value: none
+   side effect: called from the pit interrupt; may switch to another process and not return
+*/
+void sched_tick(void) {
+    static uint32_t last_boost, last_balance[MAX_CPUS];
+    uint32_t cpu = smp_cpu_id();
+    pcb_t* pcb = cur_proc_pcb;
+    if (pcb == NULL) return;
+    if (cpu == 0 && system_time.count_ms - last_boost >= SCHED_BOOST_PERIOD) { // an idle cpu skips ticks, so the boost can not wait for an exact multiple
+        last_boost = system_time.count_ms;
+        sched_boost();
+    }
+    if (system_time.count_ms - last_balance[cpu] >= SCHED_BALANCE_PERIOD) {
+        last_balance[cpu] = system_time.count_ms;
+        sched_pull();
+        if (run_count[cpu] != 0) // an idle cpu does not tick, so it has to be told there is work
+            smp_kick_idle();
+    }
+    if (proc_status[pcb->pid] != ACTIVE) return; // a sleeping or exited process hands over the cpu itself
+
+    pcb->uptime++;
+    if (pcb->slice > 0)
+        pcb->slice--;
+    if (pcb->slice == 0) {
+        sched_set_level(pcb, (pcb->level < SCHED_LEVELS - 1) ? pcb->level + 1 : pcb->level);
+        do_sched();
+    }
+    else if (run_map[cpu] & ((1 << pcb->level) - 1)) // a process of a higher level is waiting
+        do_sched();
+}
+
+
 /* do_sched
-   description: switch to the next process in the queue. in the first round terminal 2 and 3 are assigned their PCBs, but shell programs are neither loaded nor being run; in this case, do_sched executes shell.
+   description: switch to the process at the head of the highest run queue of this cpu. in the first round terminal 2 and 3 are assigned their PCBs, but shell programs are neither loaded nor being run; when such a pending process comes up, do_sched executes shell. an AP that has not run a process yet has no current process to save.
    input: none
    output: none
    return value: none
    side effect: none
 */
 void do_sched(void) {
-    /* if all procsses are inactive, return */
-    if (query_proc_status(INACTIVE) == NUM_PROC) return;
+    /* release processes that exited since the last tick, then if no other process can run, the current one keeps the cpu */
+    proc_reap();
+    if (run_map[smp_cpu_id()] == 0) return;
     pcb_t* this_pcb, * next_pcb;
-    uint32_t this_pid, next_pid;
+    uint32_t next_pid;
     uint32_t entry_point;
-    uint32_t prog_phys_addr;
 
-    /* save current pcb */
+    /* save current pcb, and how deep this cpu is in the kernel lock on its behalf */
     this_pcb = cur_proc_pcb;
-    this_pid = this_pcb->pid;
-
-    if (proc_status[this_pid] == ACTIVE)
-        proc_status[this_pid] = DAEMON; // set current process as daemon
+    if (this_pcb != NULL) {
+        this_pcb->lock_depth = this_cpu()->lock_depth;
+        if (proc_status[this_pcb->pid] == ACTIVE)
+            proc_set_state(this_pcb, RUNNABLE); // current process goes to the back of its level
+    }
 
-    /* if shell program still awaits to load, switch to next pending process */
-    if (query_proc_status(PENDING)) {
-        next_pid = get_next_pid(this_pid, PENDING);
+    next_pcb = sched_first();
+    next_pid = next_pcb->pid;
 
-        /* if pending process exists but get_next_pid fails, then the process itself is marked pending (and in this case must be a existing shell) */
-        next_pid = (next_pid == NUM_PROC) ? this_pid : next_pid;
-        next_pcb = get_pcb_by_pid(next_pid);
+    /* if shell program still awaits to load, load and run it */
+    if (proc_status[next_pid] == PENDING) {
         entry_point = load_shell_img(next_pcb->pid);
 
-        /* if switching to an active session, then next process to schedule must switch back to active and write to video memory */
-        if (next_pcb->active_sess == cur_sess_id)
-            map_virtual_4kb_prog(VIDEO, VMEM_VIRT_START);
-
-        /* if switching away from active session, then current process running must run as daemon and write to its assigned cached video memory */
-        else
-            map_virtual_4kb_prog(sess_desc[next_pcb->active_sess].cached_vidmem, VMEM_VIRT_START);
+        /* write to video memory if the session is active, or to its assigned cached video memory otherwise */
+        proc_vidmap_update(next_pcb);
 
         /* modify tss. ss0 is kernel stack segment, esp0 points to the starting address of current process's kernel stack */
-        tss.esp0 = get_esp0_by_pid(next_pcb->pid);
+        this_cpu()->tss->esp0 = get_esp0_by_pid(next_pcb->pid);
 
-        proc_status[next_pid] = ACTIVE;
+        proc_set_state(next_pcb, ACTIVE);
+        acct_charge(); // the outgoing process pays for the switch
         cur_proc_pcb = next_pcb;
+        fpu_switch(next_pcb);
 
         /* set up file descriptor, enables stdin and stdout */
         fd_array_init();
@@ -103,10 +293,10 @@ void do_sched(void) {
 
         /* set video memory */
         set_vidmem_param(VMEM_VIRT_START);
-        cur_proc_pcb->uptime += TIME_QUANTUM;
         send_eoi(PIT_IRQ_PIN);
 
-        /* jump to loaded shell program */
+        /* jump to loaded shell program, which starts out of the kernel */
+        release_kernel_lock();
         asm volatile (
             "pushl %0\n" // push SS
             "pushl %1\n" // push ESP
@@ -120,38 +310,31 @@ void do_sched(void) {
         );
     }
 
-    /* if shell programs are all active, switch to next active process */
+    /* otherwise resume the process where its last time quantum ended */
     else {
-        next_pid = get_next_pid(this_pid, DAEMON);
-        next_pcb = get_pcb_by_pid(next_pid);
-
-        /* remap virtual address to the next prmgram's user space */
-        prog_phys_addr = get_phys_addr_by_pid(next_pid);
-        map_virtual_4mb(prog_phys_addr, USER_VIRT_TOP);
+        proc_set_state(next_pcb, ACTIVE);
 
-        /* if switching to an active session, then next process to schedule must switch back to active and write to video memory */
-        if (next_pcb->active_sess == cur_sess_id)
-            map_virtual_4kb_prog(VIDEO, VMEM_VIRT_START);
-
-        /* if switching away from active session, then current process running must run as daemon and write to its assigned cached video memory */
-        else
-            map_virtual_4kb_prog(sess_desc[next_pcb->active_sess].cached_vidmem, VMEM_VIRT_START);
+        /* switch to the next program's address space */
+        switch_pgdir(next_pid);
 
         /* modify tss. ss0 is kernel stack segment, esp0 points to the starting address of current process's kernel stack */
-        tss.esp0 = get_esp0_by_pid(next_pcb->pid);
+        this_cpu()->tss->esp0 = get_esp0_by_pid(next_pcb->pid);
 
+        acct_charge(); // the outgoing process pays for the switch
         cur_proc_pcb = next_pcb;
+        fpu_switch(next_pcb);
+        this_cpu()->lock_depth = next_pcb->lock_depth;
 
         /* set video memory */
         set_vidmem_param(VMEM_VIRT_START);
-        cur_proc_pcb->uptime += TIME_QUANTUM;
         send_eoi(PIT_IRQ_PIN);
 
         /* save current ebp. kernel_esp, which points to the top of reg_struct, has already been saved by do_irq(). restore next process's ebp and esp */
-        asm volatile (
-            "movl %%ebp,%0\n"
-            :"=g"(this_pcb->kernel_ebp)
-        );
+        if (this_pcb != NULL)
+            asm volatile (
+                "movl %%ebp,%0\n"
+                :"=g"(this_pcb->kernel_ebp)
+            );
         asm volatile (
             "movl %0,%%esp\n"
             "movl %1,%%ebp\n"
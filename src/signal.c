@@ -11,6 +11,7 @@
 #include <regs.h>
 #include <panic.h>
 #include <debug.h>
+#include <wait.h>
 
 uint32_t sigmask_info[SIG_COUNT];
 
@@ -48,7 +49,8 @@ void set_other_sigmask(int32_t signum) {
 
 
 /**
- * request_signal - install a new pending signal in the pcb's sigpending struct
+ * request_signal - install a new pending signal in the pcb's sigpending struct. a process sleeping on a wait queue is
+ * woken up, so that a sleep such as msleep ends early and the signal is handled without waiting for it
  * @param num - signum to insert
  * @param sa_pcb - pcb pointer where sigaction appends to
  */
@@ -56,6 +58,7 @@ void request_signal(int32_t signum, pcb_t* sa_pcb) {
     sigaction* new_sig = malloc(sizeof(sigaction));
     new_sig->sig = signum;
     enqueue_signal(new_sig, &(sa_pcb->sigpending));
+    wake_up_process(sa_pcb);
 }
 
 
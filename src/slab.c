@@ -0,0 +1,154 @@
+/* slab.c - size-class object caches. Small objects (up to 2kb) are carved out of single 4kb heap pages so that
+   they no longer consume a whole heap page each. Layout of a slab page:
++-------+-------+-------+-----+-------+
+| obj 0 | obj 1 | obj 2 | ... | obj n |
++-------+-------+-------+-----+-------+
+   there is no in-object header; the owning cache is found through the off-page descriptor of the heap page.
+*/
+
+#include <slab.h>
+#include <mem.h>
+#include <lib.h>
+#include <types.h>
+#include <list.h>
+#include <bitops.h>
+#include <system.h>
+
+kmem_cache_t kmalloc_caches[NUM_SLAB_CACHE]; // caches of 16, 32, ..., 2048 bytes
+slab_t slab_desc[HEAP_ENTRY]; // one descriptor per heap page
+
+/* slab_init
+   description: initialize all size-class caches and slab descriptors
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void slab_init(void) {
+    int i;
+    for (i = 0; i < NUM_SLAB_CACHE; i++) {
+        kmalloc_caches[i].obj_size = SLAB_MIN_SIZE << i;
+        kmalloc_caches[i].obj_per_slab = HEAP_PAGE_SIZE / kmalloc_caches[i].obj_size;
+        kmalloc_caches[i].num_slabs = 0;
+        init_list_head(&(kmalloc_caches[i].partial));
+        spin_lock_init(&(kmalloc_caches[i].lock));
+    }
+    memset(slab_desc, 0, sizeof(slab_desc));
+}
+
+
+/* kmem_cache_select
+   description: get the smallest cache that fits an object of given size
+   input: size - size of the object in bytes
+   output: none
+   return value: pointer to the cache; NULL if size is larger than the largest size class
+   side effect: none
+*/
+kmem_cache_t* kmem_cache_select(uint32_t size) {
+    if (size > SLAB_MAX_SIZE) return NULL;
+    int shift = fls(size - 1); // round up log base 2 of size
+    if (shift < SLAB_MIN_SHIFT) shift = SLAB_MIN_SHIFT;
+    return &kmalloc_caches[shift - SLAB_MIN_SHIFT];
+}
+
+
+/* kmem_cache_grow
+   description: obtain a fresh heap page and turn it into a slab of the cache
+   input: cache - cache to grow
+   output: none
+   return value: pointer to the new slab; NULL if out of memory
+   side effect: the new slab is put on the partial list of the cache
+*/
+static slab_t* kmem_cache_grow(kmem_cache_t* cache) {
+    uint32_t page_ptr = alloc_request_pages(HEAP_PAGE_SIZE);
+    if (page_ptr == ENOMEM) return NULL; // if out of memory
+    slab_t* slab = &slab_desc[PAGE_PTR_TO_IDX(page_ptr)];
+    uint32_t i, obj = page_ptr;
+
+    /* thread every object of the page onto the free list */
+    for (i = 0; i < cache->obj_per_slab - 1; i++, obj += cache->obj_size)
+        *((void** )obj) = (void* )(obj + cache->obj_size);
+    *((void** )obj) = NULL;
+
+    slab->cache = cache;
+    slab->free_list = (void* )page_ptr;
+    slab->inuse = 0;
+    list_insert_after(&(slab->node), &(cache->partial));
+    cache->num_slabs++;
+    return slab;
+}
+
+
+/* kmem_cache_alloc
+   description: allocate an object from a cache
+   input: cache - cache to allocate from
+   output: none
+   return value: pointer to the object if success; NULL if out of memory
+   side effect: none
+*/
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    uint32_t flags;
+    slab_t* slab;
+    void* obj;
+    spin_lock_irqsave(&(cache->lock), flags);
+    if (list_is_empty(&(cache->partial))) {
+        if ((slab = kmem_cache_grow(cache)) == NULL) {
+            spin_unlock_irqrestore(&(cache->lock), flags);
+            return NULL;
+        }
+    }
+    else
+        slab = LIST_FIRST_ENTRY(&(cache->partial), slab_t, node);
+
+    /* pop the first free object; a slab that just became full leaves the partial list */
+    obj = slab->free_list;
+    slab->free_list = *((void** )obj);
+    if (++slab->inuse == cache->obj_per_slab)
+        list_delete(&(slab->node));
+    spin_unlock_irqrestore(&(cache->lock), flags);
+    return obj;
+}
+
+
+/* kmem_cache_free
+   description: return an object to the cache that owns it. an empty slab is given back to the page allocator unless it is the last partial slab of the cache
+   input: obj - pointer to the object
+   output: none
+   return value: none
+   side effect: none
+*/
+void kmem_cache_free(void* obj) {
+    uint32_t flags;
+    slab_t* slab = virt_to_slab(obj);
+    if (slab == NULL) return;
+    kmem_cache_t* cache = slab->cache;
+    spin_lock_irqsave(&(cache->lock), flags);
+    *((void** )obj) = slab->free_list;
+    slab->free_list = obj;
+    if (slab->inuse-- == cache->obj_per_slab) // slab was full, make it available again
+        list_insert_after(&(slab->node), &(cache->partial));
+
+    /* keep one empty slab around so a single alloc/free pair does not bounce a page */
+    if (slab->inuse == 0 && cache->partial.next != cache->partial.prev) {
+        uint32_t page_ptr = (uint32_t)obj & SLAB_PAGE_MASK;
+        list_delete(&(slab->node));
+        slab->cache = NULL;
+        slab->free_list = NULL;
+        cache->num_slabs--;
+        free_request_pages(PAGE_PTR_TO_IDX(page_ptr), HEAP_PAGE_SIZE);
+    }
+    spin_unlock_irqrestore(&(cache->lock), flags);
+}
+
+
+/* kmem_cache_obj_size
+   description: get the usable size of a slab object
+   input: obj - pointer to the object
+   output: none
+   return value: object size of the owning cache; 0 if the object is not from a slab
+   side effect: none
+*/
+uint32_t kmem_cache_obj_size(void* obj) {
+    slab_t* slab = virt_to_slab(obj);
+    return (slab != NULL) ? slab->cache->obj_size : 0;
+}
@@ -0,0 +1,437 @@
+/* smp.c - Finds the processors through the MP configuration table and brings the application processors online with
+   the INIT-SIPI-SIPI sequence. Each cpu has its own tss, current process, fpu owner and run queue (see cpu_t and
+   sched.c); the rest of the kernel is still written for one cpu, so it runs under one kernel lock. A cpu takes the
+   lock on every way into the kernel and drops it on the way back to user mode and while it halts, so processes run
+   in parallel in user mode and one at a time in the kernel, like on one cpu.
+   external source: Intel MultiProcessor Specification 1.4, http://wiki.osdev.org/SMP
+*/
+
+#include <smp.h>
+#include <apic.h>
+#include <types.h>
+#include <lib.h>
+#include <paging.h>
+#include <pit.h>
+#include <idt.h>
+#include <x86_desc.h>
+#include <spinlock.h>
+#include <fpu.h>
+#include <clock.h>
+#include <sched.h>
+
+#define TRAMP_VAR(sym) \
+    (AP_TRAMPOLINE_ADDR + (uint32_t)(sym) - (uint32_t)ap_trampoline_start)
+
+cpu_t cpus[MAX_CPUS] = { { .tss = &tss, .acct_mode = ACCT_SYS, .pgdir = page_directory } }; // declared in smp.h
+uint32_t num_cpus = 1; // declared in smp.h
+uint32_t num_online = 1; // declared in smp.h
+volatile uint32_t tlb_gen; // declared in smp.h
+static uint8_t ap_stacks[MAX_CPUS][AP_STACK_SIZE] __attribute__((aligned(AP_STACK_SIZE)));
+static tss_t ap_tss[MAX_CPUS]; // entry 0 is unused, the boot processor has tss
+static seg_desc_t smp_gdt[GDT_ENTRIES + MAX_CPUS]; // the gdt of x86_desc.S followed by a tss descriptor per AP
+static volatile uint32_t kernel_flag; // the kernel lock, see lock_kernel
+static volatile uint64_t tsc_sync_value; // time stamp counter of the boot processor, handed to an AP coming online
+static volatile uint32_t tsc_sync_go; // tsc_sync_value is set and the AP should read its own counter now
+
+/* map_low_range
+   description: identity map the pages of a range below 1mb, which are not present unless mapped explicitly
+   input: start - starting physical address
+          length - length of the range in bytes
+   output: none
+   return value: none
+   side effect: modifies the first page table
+*/
+static void map_low_range(uint32_t start, uint32_t length) {
+    uint32_t addr;
+    for (addr = start & ~(PAGE_SIZE - 1); addr < start + length; addr += PAGE_SIZE)
+        map_virtual_4kb_first(addr, addr);
+}
+
+
+/* mp_checksum
+   description: sum the bytes of an MP structure
+   input: addr - starting address
+          length - length in bytes
+   output: none
+   return value: sum of the bytes, 0 for a valid structure
+   side effect: none
+*/
+static uint8_t mp_checksum(uint32_t addr, uint32_t length) {
+    uint8_t sum = 0;
+    uint32_t i;
+    for (i = 0; i < length; i++)
+        sum += ((uint8_t* )addr)[i];
+    return sum;
+}
+
+
+/* mp_scan
+   description: search a range for the MP floating pointer structure, which sits on a 16 byte boundary
+   input: start - starting physical address
+          length - length of the range in bytes
+   output: none
+   return value: pointer to the structure; NULL if not found
+   side effect: maps the range
+*/
+static mp_fps_t* mp_scan(uint32_t start, uint32_t length) {
+    uint32_t addr;
+    mp_fps_t* fps;
+    map_low_range(start, length);
+    for (addr = start; addr + sizeof(mp_fps_t) <= start + length; addr += sizeof(mp_fps_t)) {
+        fps = (mp_fps_t* )addr;
+        if (fps->sig == MP_FPS_SIG && fps->length == 1 && mp_checksum(addr, sizeof(mp_fps_t)) == 0)
+            return fps;
+    }
+    return NULL;
+}
+
+
+/* mp_find_conf
+   description: find the MP configuration table. the floating pointer is searched for in the first kb of the ebda, in
+                the last kb of base memory, and in the bios rom, in that order
+   input: none
+   output: none
+   return value: pointer to a valid configuration table; NULL if the firmware has none we can use
+   side effect: maps the pages searched
+*/
+static mp_conf_t* mp_find_conf(void) {
+    uint32_t ebda = (uint32_t)(*(uint16_t* )EBDA_SEG_PTR) << 4;
+    mp_fps_t* fps = NULL;
+    mp_conf_t* conf;
+    if (ebda >= 0x80000 && ebda < 0xA0000) // only trust a pointer into the top of base memory
+        fps = mp_scan(ebda, 1024);
+    if (fps == NULL)
+        fps = mp_scan(BASE_MEM_TOP, 1024);
+    if (fps == NULL)
+        fps = mp_scan(BIOS_ROM_BASE, BIOS_ROM_TOP - BIOS_ROM_BASE);
+    /* a zero table address means a default configuration, which only ever describes two cpus on an 82489DX */
+    if (fps == NULL || fps->conf == 0 || fps->conf + sizeof(mp_conf_t) > BIOS_ROM_TOP)
+        return NULL;
+    map_low_range(fps->conf, sizeof(mp_conf_t));
+    conf = (mp_conf_t* )fps->conf;
+    if (conf->sig != MP_CONF_SIG || fps->conf + conf->length > BIOS_ROM_TOP)
+        return NULL;
+    map_low_range(fps->conf, conf->length);
+    if (mp_checksum(fps->conf, conf->length) != 0)
+        return NULL;
+    return conf;
+}
+
+
+/* mp_parse
+   description: record the enabled application processors and mask every I/O APIC listed in the configuration table
+   input: conf - configuration table
+   output: none
+   return value: none
+   side effect: fills cpus and num_cpus
+*/
+static void mp_parse(mp_conf_t* conf) {
+    uint8_t* entry = (uint8_t* )(conf + 1);
+    uint8_t* end = (uint8_t* )conf + conf->length;
+    mp_proc_t* proc;
+    uint32_t i;
+    for (i = 0; i < conf->count && entry < end; i++) {
+        if (*entry == MP_ENT_PROC) {
+            proc = (mp_proc_t* )entry;
+            if ((proc->flags & MP_PROC_EN) && proc->apic_id != cpus[0].apic_id && num_cpus < MAX_CPUS)
+                cpus[num_cpus++].apic_id = proc->apic_id;
+            entry += sizeof(mp_proc_t);
+        }
+        else {
+            if (*entry == MP_ENT_IOAPIC && (((mp_ioapic_t* )entry)->flags & 0x1))
+                ioapic_init(((mp_ioapic_t* )entry)->addr);
+            entry += MP_ENT_SIZE;
+        }
+    }
+}
+
+
+/* cpu_by_apic_id
+   description: find a cpu in cpus by its APIC id; used before the cpu has loaded its tss, see smp_cpu_id
+   input: apic_id - APIC id of the cpu
+   output: none
+   return value: index of the cpu; 0 if it is not listed
+   side effect: none
+*/
+static uint32_t cpu_by_apic_id(uint32_t apic_id) {
+    uint32_t i;
+    for (i = 0; i < num_cpus; i++) {
+        if (cpus[i].apic_id == apic_id)
+            return i;
+    }
+    return 0;
+}
+
+
+/* lock_kernel
+   description: take the kernel lock on the way into the kernel, or nest once more if the running cpu holds it already.
+                the first acquire also flushes the tlb if another cpu has changed a mapping since this cpu last did, so
+                stale kernel entries are gone before any kernel code runs here
+   input: none
+   output: none
+   return value: none
+   side effect: spins with interrupts off while another cpu is in the kernel
+*/
+void lock_kernel(void) {
+    uint32_t flags;
+    cpu_t* cpu;
+    cli_and_save(flags); // critical section begins
+    cpu = this_cpu();
+    if (cpu->lock_depth++ == 0) {
+        while (xchg(&kernel_flag, 1) != 0) {
+            while (kernel_flag)
+                cpu_relax();
+        }
+        if (cpu->tlb_gen != tlb_gen) {
+            cpu->tlb_gen = tlb_gen;
+            flush_tlb_global();
+        }
+    }
+    restore_flags(flags); // critical section ends
+}
+
+
+/* unlock_kernel
+   description: leave one kernel entry, and release the kernel lock when it was the outermost one
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void unlock_kernel(void) {
+    uint32_t flags;
+    cpu_t* cpu;
+    cli_and_save(flags); // critical section begins
+    cpu = this_cpu();
+    if (--cpu->lock_depth == 0) {
+        asm volatile ("" : : : "memory");
+        kernel_flag = 0;
+    }
+    restore_flags(flags); // critical section ends
+}
+
+
+/* release_kernel_lock
+   description: release the kernel lock however deep the running cpu is nested in it, before it halts or starts a
+                program in user mode
+   input: none
+   output: none
+   return value: nesting depth to pass to reacquire_kernel_lock
+   side effect: none
+*/
+uint32_t release_kernel_lock(void) {
+    uint32_t flags, depth;
+    cpu_t* cpu;
+    cli_and_save(flags); // critical section begins
+    cpu = this_cpu();
+    depth = cpu->lock_depth;
+    if (depth != 0) {
+        cpu->lock_depth = 1;
+        unlock_kernel();
+    }
+    restore_flags(flags); // critical section ends
+    return depth;
+}
+
+
+/* reacquire_kernel_lock
+   description: take the kernel lock back after release_kernel_lock
+   input: depth - nesting depth release_kernel_lock returned
+   output: none
+   return value: none
+   side effect: none
+*/
+void reacquire_kernel_lock(uint32_t depth) {
+    uint32_t flags;
+    if (depth == 0) return;
+    cli_and_save(flags); // critical section begins
+    lock_kernel();
+    this_cpu()->lock_depth = depth;
+    restore_flags(flags); // critical section ends
+}
+
+
+/* smp_kick
+   description: wake up an idle cpu with an extra clock tick, so it finds the process just queued on it
+   input: idx - index of the cpu in cpus
+   output: none
+   return value: none
+   side effect: none
+*/
+void smp_kick(uint32_t idx) {
+    if (idx != smp_cpu_id() && cpus[idx].idle)
+        lapic_send_ipi(cpus[idx].apic_id, LAPIC_ICR_FIXED | LAPIC_TIMER_ENTRY);
+}
+
+
+/* smp_kick_idle
+   description: wake up one idle cpu other than the running one, so it pulls over a process waiting here. an idle AP
+                has no clock tick of its own to notice the work by
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void smp_kick_idle(void) {
+    uint32_t i;
+    for (i = 0; i < num_cpus; i++) {
+        if (i != smp_cpu_id() && cpus[i].online && cpus[i].idle) {
+            smp_kick(i);
+            return;
+        }
+    }
+}
+
+
+/* tsc_sync_ap
+   description: AP side of measuring how far its time stamp counter is from the boot processor's, which runs
+                tsc_sync_bsp at the same time. the AP reads its counter as soon as it sees the boot processor's, so the
+                offset is short by the time the store takes to reach it; ktime_get keeps the clock from going back over
+                that small a gap
+   input: idx - index of the processor in cpus
+   output: none
+   return value: none
+   side effect: sets the tsc_offset of the cpu
+*/
+static void tsc_sync_ap(uint32_t idx) {
+    uint64_t tsc;
+    while (!tsc_sync_go);
+    tsc = rdtsc();
+    cpus[idx].tsc_offset = tsc_sync_value - tsc;
+    tsc_sync_go = 0;
+}
+
+
+/* tsc_sync_bsp
+   description: boot processor side of tsc_sync_ap, once the AP is online
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+static void tsc_sync_bsp(void) {
+    tsc_sync_value = rdtsc();
+    tsc_sync_go = 1;
+    while (tsc_sync_go);
+}
+
+
+/* ap_main
+   description: kernel entry of an application processor, reached from the trampoline with paging on. it loads its own
+                tss and sysenter stack, reports in, then waits for the kernel lock, which the boot processor holds until
+                the first program runs, and becomes a scheduler like the boot processor if its local APIC timer ticks
+   input: none
+   output: none
+   return value: never returns
+   side effect: marks the cpu online
+*/
+static void ap_main(void) {
+    uint32_t idx = cpu_by_apic_id(lapic_id());
+    ltr(AP_TSS_SEL(idx));
+    lapic_init(0);
+    fpu_init();
+    sysenter_init();
+    num_online++;
+    cpus[idx].online = 1;
+    tsc_sync_ap(idx);
+    lock_kernel();
+    if (clock_ap_init() == -1) {
+        /* no tick to preempt processes with or to notice work by, so this cpu stays out of scheduling */
+        release_kernel_lock();
+        while (1)
+            asm volatile ("sti; hlt; cli\n");
+    }
+    sched_ap_loop();
+}
+
+
+/* ap_tss_init
+   description: set up the tss of an application processor and its descriptor in smp_gdt
+   input: idx - index of the processor in cpus
+   output: none
+   return value: none
+   side effect: none
+*/
+static void ap_tss_init(uint32_t idx) {
+    seg_desc_t* desc = &smp_gdt[GDT_ENTRIES + idx];
+    tss_t* ap = &ap_tss[idx];
+    memset(ap, 0, sizeof(tss_t));
+    ap->ss0 = KERNEL_DS;
+    ap->esp0 = cpus[idx].stack;
+    ap->ldt_segment_selector = KERNEL_LDT;
+    ap->io_base_addr = TSS_SIZE; // past the limit: no I/O permission bitmap
+    desc->val[0] = desc->val[1] = 0;
+    desc->present = 0x1;
+    desc->type = 0x9; // available 32-bit tss
+    SET_TSS_PARAMS((*desc), ap, TSS_SIZE - 1);
+    cpus[idx].tss = ap;
+}
+
+
+/* ap_boot
+   description: start an application processor with INIT followed by up to two startup IPIs, wait for it to report,
+                and let it measure its time stamp counter against this one
+   input: idx - index of the processor in cpus
+   output: none
+   return value: none
+   side effect: sets the stack of the trampoline
+*/
+static void ap_boot(uint32_t idx) {
+    uint32_t sipi, waited;
+    cpus[idx].stack = (uint32_t)ap_stacks[idx] + AP_STACK_SIZE;
+    cpus[idx].acct_mode = ACCT_SYS;
+    cpus[idx].pgdir = page_directory; // the trampoline loads it
+    ap_tss_init(idx);
+    *(volatile uint32_t* )TRAMP_VAR(ap_tramp_stack) = cpus[idx].stack;
+    lapic_send_ipi(cpus[idx].apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    pit_udelay(INIT_DELAY_US);
+    for (sipi = 0; sipi < 2 && !cpus[idx].online; sipi++) {
+        lapic_send_ipi(cpus[idx].apic_id, LAPIC_ICR_STARTUP | (AP_TRAMPOLINE_ADDR >> 12));
+        pit_udelay(SIPI_DELAY_US);
+    }
+    for (waited = 0; !cpus[idx].online && waited < AP_BOOT_TIMEOUT_US; waited += SIPI_DELAY_US)
+        pit_udelay(SIPI_DELAY_US);
+    if (cpus[idx].online)
+        tsc_sync_bsp();
+}
+
+
+/* smp_init
+   description: enable the local APIC of the boot processor and bring every application processor online, one at a time
+                since they share the trampoline. called once the pit is ticking, which pit_udelay depends on. the boot code
+                holds the kernel lock from here on, as if it had entered the kernel, until the first program starts
+   input: none
+   output: none
+   return value: none
+   side effect: maps the APIC registers and the trampoline page
+*/
+void smp_init(void) {
+    mp_conf_t* conf;
+    uint32_t i, tramp_gdtr;
+    lock_kernel();
+    cpus[0].online = 1;
+    if (apic_detect() == -1)
+        return;
+    spurious_set_idt();
+    lapic_init(1);
+    cpus[0].apic_id = lapic_id();
+    if ((conf = mp_find_conf()) == NULL)
+        return;
+    mp_parse(conf);
+    if (num_cpus == 1 || gdt_desc.size + 1 > sizeof(seg_desc_t) * GDT_ENTRIES)
+        return;
+
+    /* the APs load a copy of the kernel gdt with room for their tss descriptors */
+    memcpy(smp_gdt, (void* )gdt_desc.addr, gdt_desc.size + 1);
+
+    /* copy the trampoline and give it that gdt, which real mode can not reach at its linked address */
+    map_virtual_4kb_first(AP_TRAMPOLINE_ADDR, AP_TRAMPOLINE_ADDR);
+    memcpy((void* )AP_TRAMPOLINE_ADDR, ap_trampoline_start, (uint32_t)ap_trampoline_end - (uint32_t)ap_trampoline_start);
+    tramp_gdtr = TRAMP_VAR(ap_tramp_gdtr);
+    *(uint16_t* )tramp_gdtr = sizeof(smp_gdt) - 1;
+    *(uint32_t* )(tramp_gdtr + 2) = (uint32_t)smp_gdt;
+    *(uint32_t* )TRAMP_VAR(ap_tramp_entry) = (uint32_t)ap_main;
+
+    for (i = 1; i < num_cpus; i++)
+        ap_boot(i);
+}
@@ -0,0 +1,169 @@
+/* spinlock.c - lock order checking for LOCK_DEBUG builds. locks are grouped into classes by the place they were
+   initialized, and every time a lock is taken while others are held, the order between their classes is recorded.
+   taking two classes in both orders can deadlock even if it never has yet, so the first such acquire is reported,
+   together with taking a lock the cpu already holds and releasing one it does not. one report is printed, after
+   which checking stops, since the lock state is no longer trustworthy.
+   external source: https://www.kernel.org/doc/Documentation/locking/lockdep-design.txt
+*/
+
+#include <spinlock.h>
+#include <types.h>
+#include <lib.h>
+#include <smp.h>
+
+#ifdef LOCK_DEBUG
+
+#define LOCK_CLASSES 32 // one bit per class in lock_after
+#define LOCK_HELD_MAX 16 // locks one cpu may hold at once
+
+/* a lock held by a cpu */
+typedef struct held_lock_t {
+    lock_dep_t* dep;
+    int32_t read; // held for reading, which may nest
+} held_lock_t;
+
+static const char* class_name[LOCK_CLASSES];
+static uint32_t class_cnt;
+static uint32_t lock_after[LOCK_CLASSES]; // bit j of entry i: class j has been taken while class i was held, directly or through other classes
+static held_lock_t held[MAX_CPUS][LOCK_HELD_MAX];
+static uint32_t held_cnt[MAX_CPUS];
+static uint32_t lock_debug_off;
+
+/* lock_report
+   description: print a locking bug and stop checking
+   input: msg - what went wrong
+          name - lock being taken or released
+          other - lock it conflicts with; NULL if none
+   output: message on screen
+   return value: none
+   side effect: turns lock checking off
+*/
+static void lock_report(const char* msg, const char* name, const char* other) {
+    uint32_t i, cpu = smp_cpu_id();
+    lock_debug_off = 1;
+    printf("lockdep: %s: %s", msg, name);
+    if (other != NULL)
+        printf(" vs %s", other);
+    printf("\nlockdep: cpu %d holds:", cpu);
+    for (i = 0; i < held_cnt[cpu]; i++)
+        printf(" %s", held[cpu][i].dep->name);
+    printf("\n");
+}
+
+
+/* lock_class
+   description: get the class of a lock, giving it one the first time it is taken
+   input: dep - lock ordering state of the lock
+   output: none
+   return value: class index; -1 if out of classes
+   side effect: none
+*/
+static int32_t lock_class(lock_dep_t* dep) {
+    uint32_t i;
+    if (dep->class != 0)
+        return dep->class - 1;
+    for (i = 0; i < class_cnt && class_name[i] != dep->name; i++);
+    if (i == LOCK_CLASSES)
+        return -1;
+    if (i == class_cnt)
+        class_name[class_cnt++] = dep->name;
+    dep->class = i + 1;
+    return i;
+}
+
+
+/* lock_order
+   description: record that class next was taken while class prev was held, and carry it over to every class known to
+                come before prev
+   input: prev - class held
+          next - class taken
+   output: none
+   return value: none
+   side effect: none
+*/
+static void lock_order(uint32_t prev, uint32_t next) {
+    uint32_t i, after = (1 << next) | lock_after[next];
+    for (i = 0; i < class_cnt; i++) {
+        if (i == prev || (lock_after[i] & (1 << prev)))
+            lock_after[i] |= after;
+    }
+}
+
+
+/* lock_acquire
+   description: check a lock about to be taken against the locks the cpu holds, and push it on them
+   input: dep - lock ordering state of the lock
+          read - nonzero if an rwlock is taken for reading
+   output: message on screen if the acquire can deadlock
+   return value: none
+   side effect: none
+*/
+void lock_acquire(lock_dep_t* dep, int32_t read) {
+    unsigned long flags;
+    uint32_t i, cpu;
+    int32_t class, held_class;
+    cli_and_save(flags); // critical section begins
+    if (lock_debug_off)
+        goto out;
+    cpu = smp_cpu_id();
+    if ((class = lock_class(dep)) == -1) {
+        lock_report("out of lock classes", dep->name, NULL);
+        goto out;
+    }
+    for (i = 0; i < held_cnt[cpu]; i++) {
+        held_class = lock_class(held[cpu][i].dep);
+        if (held_class == class) {
+            if (read && held[cpu][i].read)
+                continue;
+            lock_report("recursive locking", dep->name, held[cpu][i].dep->name);
+            goto out;
+        }
+        if (lock_after[class] & (1 << held_class)) {
+            lock_report("lock order inversion", dep->name, held[cpu][i].dep->name);
+            goto out;
+        }
+    }
+    if (held_cnt[cpu] == LOCK_HELD_MAX) {
+        lock_report("too many locks held", dep->name, NULL);
+        goto out;
+    }
+    for (i = 0; i < held_cnt[cpu]; i++) {
+        held_class = lock_class(held[cpu][i].dep);
+        if (held_class != class)
+            lock_order(held_class, class);
+    }
+    held[cpu][held_cnt[cpu]].dep = dep;
+    held[cpu][held_cnt[cpu]].read = read;
+    held_cnt[cpu]++;
+out:
+    restore_flags(flags); // critical section ends
+}
+
+
+/* lock_release
+   description: pop a lock about to be released from the locks the cpu holds; locks need not be released in order
+   input: dep - lock ordering state of the lock
+   output: message on screen if the cpu does not hold the lock
+   return value: none
+   side effect: none
+*/
+void lock_release(lock_dep_t* dep) {
+    unsigned long flags;
+    uint32_t cpu;
+    int32_t i;
+    cli_and_save(flags); // critical section begins
+    if (lock_debug_off)
+        goto out;
+    cpu = smp_cpu_id();
+    for (i = held_cnt[cpu] - 1; i >= 0 && held[cpu][i].dep != dep; i--);
+    if (i < 0) {
+        lock_report("releasing a lock that is not held", dep->name, NULL);
+        goto out;
+    }
+    for (held_cnt[cpu]--; i < held_cnt[cpu]; i++)
+        held[cpu][i] = held[cpu][i + 1];
+out:
+    restore_flags(flags); // critical section ends
+}
+
+#endif /* LOCK_DEBUG */
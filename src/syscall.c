@@ -4,6 +4,7 @@
 #include <types.h>
 #include <proc.h>
 #include <paging.h>
+#include <vm.h>
 #include <lib.h>
 #include <x86_desc.h>
 #include <terminal.h>
@@ -14,11 +15,16 @@
 #include <system.h>
 #include <time.h>
 #include <mem.h>
+#include <heapinfo.h>
 #include <aes.h>
 #include <network.h>
 #include <color.h>
+#include <sched.h>
+#include <acct.h>
+#include <fpu.h>
+#include <clock.h>
+#include <ring.h>
 
-pcb_t * cur_proc_pcb; // declared in proc.h
 uint8_t proc_status[NUM_PROC]; // declared in proc.h
 sess_t sess_desc[NUM_SESS]; // declared in terminal.h
 uint32_t cur_sess_id; // declared in terminal.h
@@ -34,6 +40,7 @@ static struct regs * cur_regs;
  */
 __attribute__((fastcall))
 void do_sys(struct regs *regs) {
+    acct_switch(ACCT_SYS);
     CHK_USR_ESP;
     int32_t retval;
     uint32_t sysnum = regs->orig_eax;
@@ -159,6 +166,63 @@ void do_sys(struct regs *regs) {
         case SYS_GETIP:
         	retval = sys_getip();
         	break;
+
+        case SYS_FORK:
+            retval = sys_fork();
+            break;
+
+        case SYS_BRK:
+            retval = sys_brk((void* )regs->ebx);
+            break;
+
+        case SYS_MMAP:
+            retval = sys_mmap((uint32_t)regs->ebx);
+            break;
+
+        case SYS_MUNMAP:
+            retval = sys_munmap((void* )regs->ebx, (uint32_t)regs->ecx);
+            break;
+
+        case SYS_SLEEP:
+            retval = sys_sleep((uint32_t)regs->ebx);
+            break;
+
+        case SYS_ALARM:
+            retval = sys_alarm((uint32_t)regs->ebx);
+            break;
+
+        case SYS_SETPRIORITY:
+            retval = sys_setpriority((uint32_t)regs->ebx, (uint32_t)regs->ecx);
+            break;
+
+        case SYS_CLOCK_GETTIME:
+            retval = sys_clock_gettime((uint32_t)regs->ebx, (timespec_t* )regs->ecx);
+            break;
+
+        case SYS_RING_SETUP:
+            retval = sys_ring_setup((uint32_t)regs->ebx);
+            break;
+
+        case SYS_RING_ENTER:
+            retval = sys_ring_enter((uint32_t)regs->ebx);
+            break;
+
+        case SYS_READV:
+            retval = sys_readv((uint32_t)regs->ebx, (const iovec_t* )regs->ecx, (uint32_t)regs->edx);
+            break;
+
+        case SYS_WRITEV:
+            retval = sys_writev((uint32_t)regs->ebx, (const iovec_t* )regs->ecx, (uint32_t)regs->edx);
+            break;
+
+        case SYS_PREAD:
+            retval = sys_pread((uint32_t)regs->ebx, (void* )regs->ecx, (uint32_t)regs->edx, (uint32_t)regs->esi);
+            break;
+
+        case SYS_PWRITE:
+            retval = sys_pwrite((uint32_t)regs->ebx, (const void* )regs->ecx, (uint32_t)regs->edx, (uint32_t)regs->esi);
+            break;
+
         default: return;
     }
     regs->eax = retval;
@@ -189,7 +253,7 @@ int32_t sys_halt(int32_t status) {
 */
 int32_t sys_execute(const int8_t * command) {
     /* if cpu reaches its maximum control, abort */
-    if (cur_proc_pcb && get_next_pid(cur_proc_pcb->pid, INACTIVE) == NUM_PROC)
+    if (cur_proc_pcb && query_proc_status(INACTIVE) == 0)
         return -1;
     uint32_t entry_point;
     file_t program;
@@ -199,13 +263,13 @@ int32_t sys_execute(const int8_t * command) {
     int32_t cmd_status;
     int8_t fout [FNAME_LEN];
     if (cur_proc_pcb)
-        proc_status[cur_proc_pcb->pid] = IDLE; // switch parent process to idle
+        proc_set_state(cur_proc_pcb, BLOCKED); // parent waits on its child
 
     /* parse the command to get the first field */
     //clear_args(cur_proc_pcb);
     cmd_status = parse_cmd(command, parsed_cmd);
     if (cmd_status == -1) {
-        proc_status[cur_proc_pcb->pid] = DAEMON;
+        proc_set_state(cur_proc_pcb, ACTIVE);
         return -1; // if command is invalid return
     }
 
@@ -216,7 +280,7 @@ int32_t sys_execute(const int8_t * command) {
     program.f_op = ext2_file_fop;
     if (-1 == program.f_op->open(&program, parsed_cmd)) {
         if (-1 == program.f_op->open(&program, bin_fname) || parsed_cmd[0] == '.') {
-            proc_status[cur_proc_pcb->pid] = DAEMON;
+            proc_set_state(cur_proc_pcb, ACTIVE);
             return -1;
         }
     }
@@ -225,7 +289,7 @@ int32_t sys_execute(const int8_t * command) {
     program.f_pos = 0;
     program.f_op->read(&program, cmd_buf, CMD_WORD_SIZE);
     if (strncmp((int8_t *)cmd_buf, is_exe, CMD_WORD_SIZE)) {
-        proc_status[cur_proc_pcb->pid] = DAEMON;
+        proc_set_state(cur_proc_pcb, ACTIVE);
         return -1;
     }
 
@@ -237,9 +301,18 @@ int32_t sys_execute(const int8_t * command) {
     /* set up child pcb */
     pcb_t* child_pcb;
     child_pcb = child_pcb_init(cur_proc_pcb); // initialize child pcb
+    if (child_pcb == NULL) { // out of pids or memory
+        proc_set_state(cur_proc_pcb, ACTIVE);
+        program.f_op->close(&program);
+        return -1;
+    }
 
-    /* update pcb to current process */
+    /* update pcb to current process; the parent resumes as deep in the kernel lock as it is now, see kill_pid */
+    acct_charge();
+    if (cur_proc_pcb)
+        cur_proc_pcb->lock_depth = this_cpu()->lock_depth;
     cur_proc_pcb = child_pcb;
+    fpu_switch(child_pcb);
 
     /* link sigaction linkage pcb */
     link_sa_pcb(cur_proc_pcb, cur_sess_id);
@@ -258,29 +331,25 @@ int32_t sys_execute(const int8_t * command) {
     /* set up parent_esp and parent_ebp. parent_esp is used by 'iret' in sys_halt() and must point to return address set up when 'int 0x80' was made. parent_ebp is the ebp of current stack frame. */
     cur_proc_pcb->parent_esp = (uint32_t)cur_regs;
 
-    /* initilize a 4mb page for user program; maps program physical address to 128MB, copy data to the virtual memory space */
-    uint32_t prog_phys_addr = get_phys_addr_by_pid(cur_proc_pcb->pid);
-    map_virtual_4mb(prog_phys_addr, USER_VIRT_TOP);
-    program.f_pos = 0;
-    program.f_op->read(&program, (void *)PROG_VIRT_START, program.f_dentry.d_inode.i_size);
+    /* initilize an empty address space for user program at 128MB; the image is paged in from the file on first touch */
+    vm_proc_init(cur_proc_pcb, &program.f_dentry.d_inode);
+    switch_pgdir(cur_proc_pcb->pid);
     SET_BRK(PROG_VIRT_START + program.f_dentry.d_inode.i_size);
     STACK_BARRIER;
     program.f_op->close(&program);
 
-    /* if switching to current session from daemon session, then current process running must switch back to active and write to video memory */
-    if (cur_proc_pcb->active_sess == cur_sess_id)
-        map_virtual_4kb_prog(VIDEO, VMEM_VIRT_START);
-
-    /* if switching away from current session, then current process running must run as daemon and write to its assigned cached video memory */
-    else
-        map_virtual_4kb_prog(sess_desc[cur_sess_id].cached_vidmem, VMEM_VIRT_START);
+    /* write to video memory if the session is active, or to its assigned cached video memory otherwise */
+    proc_vidmap_update(cur_proc_pcb);
 
     /* modify tss. ss0 is kernel stack segment, esp0 points to the starting address of current process's kernel stack */
-    tss.esp0 = get_esp0_by_pid(cur_proc_pcb->pid);
+    this_cpu()->tss->esp0 = get_esp0_by_pid(cur_proc_pcb->pid);
 
     /* set video memory */
     set_vidmem_param(VMEM_VIRT_START);
 
+    /* the program starts out of the kernel */
+    release_kernel_lock();
+
     /* fake iret to user program's user stack. SS is user stack segment, ESP points to the starting address of current process's user stack, EFLAGS are never used, CS is user code segment, return address (in this case eip of user program) is the entry point specified by each file */
     asm volatile (
         "pushl %0\n" // push SS
@@ -327,7 +396,7 @@ int32_t sys_vidmap(uint8_t** screen_start) {
     if (screen_start == NULL) return -1; // if pointer is invalid, return
     if ((uint32_t)screen_start < USER_VIRT_TOP || (uint32_t)screen_start >= USER_VIRT_BOT)
         return -1; // if screen starting address is not within the user program's 4MB space return -1
-    map_virtual_4kb_prog(VIDEO, VMEM_VIRT_START);
+    proc_vidmap_update(cur_proc_pcb);
     *screen_start = (uint8_t* )VMEM_VIRT_START;
     return 0;
 }
@@ -432,6 +501,8 @@ int32_t sys_open(const int8_t * filename) {
     file = cur_proc_pcb->fd_array + fd;
     if (0 == strncmp(filename, "rtc", FNAME_LEN))
         file->f_op = rtc_fop;
+    else if (0 == strncmp(filename, "heapinfo", FNAME_LEN))
+        file->f_op = heapinfo_fop;
     else {
         file->f_op = ext2_file_fop;
     }
@@ -476,11 +547,13 @@ int32_t sys_close(uint32_t fd) {
  * sys_kill - kill a process given its pid
  * @param pid - pid to kill
  * @param ignore - signum to kill; we have only SIGKILL to kill a process so this field is trivial
- * @return - no real effect
+ * @return - -1 if no process has that pid, no real effect otherwise
  * @author - Kexuan Zou
  */
 int32_t sys_kill(uint32_t pid, int32_t ignore) {
-    request_signal(SIGKILL, get_pcb_by_pid(pid));
+    pcb_t* pcb = get_pcb_by_pid(pid);
+    if (pcb == NULL) return -1;
+    request_signal(SIGKILL, pcb);
     return 0; // trivial return value, control sequence never reach here
 }
 
@@ -492,14 +565,24 @@ int32_t sys_kill(uint32_t pid, int32_t ignore) {
  * @return - 0 if process exists, -1 if process does not exist
  */
 int32_t sys_query(uint32_t pid, proc_info* obj) {
-    if (proc_status[pid] == INACTIVE) return -1;
-    pcb_t* cur_pcb = get_pcb_by_pid(pid);
+    uint32_t flags;
+    pcb_t* cur_pcb;
+    read_lock_irqsave(&proc_lock, flags); // the process can not be reaped meanwhile
+    cur_pcb = get_pcb_by_pid(pid);
+    if (cur_pcb == NULL || proc_status[pid] == INACTIVE) {
+        read_unlock_irqrestore(&proc_lock, flags);
+        return -1;
+    }
     strncpy(obj->cmd, cur_pcb->command, ARG_WORD_SIZE);
-    if (proc_status[pid] == ACTIVE || proc_status[pid] == DAEMON)
+    if (proc_status[pid] == ACTIVE || proc_status[pid] == RUNNABLE)
         obj->status = ACTIVE;
     else
-        obj->status = IDLE;
+        obj->status = BLOCKED;
     obj->uptime = cur_pcb->uptime;
+    obj->user_cycles = cur_pcb->acct[ACCT_USER];
+    obj->sys_cycles = cur_pcb->acct[ACCT_SYS];
+    obj->irq_cycles = cur_pcb->acct[ACCT_IRQ];
+    read_unlock_irqrestore(&proc_lock, flags);
     return 0;
 }
 
@@ -510,9 +593,10 @@ int32_t sys_query(uint32_t pid, proc_info* obj) {
  * @return - 0, auto success
  */
 int32_t sys_info(system_info* obj) {
-    obj->num_active = query_proc_status(ACTIVE) + query_proc_status(DAEMON);
-    obj->num_idle = query_proc_status(IDLE);
+    obj->num_active = query_proc_status(ACTIVE) + query_proc_status(RUNNABLE);
+    obj->num_idle = query_proc_status(BLOCKED);
     obj->uptime = system_time.count_ms;
+    obj->idle_cycles = idle_cycles;
     return 0;
 }
 
@@ -814,8 +898,10 @@ int32_t sys_map_modex(uint8_t** screen_start) {
     if ((uint32_t)screen_start < USER_VIRT_TOP || (uint32_t)screen_start >= USER_VIRT_BOT)
         return -1; // if screen starting address is not within the user program's 4MB space return -1
     int i = 0;
+    tlb_batch_begin();
     for (; i < MODEX_PAGE_NUM; i++)
-        map_virtual_4kb_prog(VIDEO + i*MODEX_PAGE_SIZE, MODEX_VIRT_START + i*MODEX_PAGE_SIZE);
+        map_virtual_4kb_prog(cur_proc_pcb->pid, VIDEO + i*MODEX_PAGE_SIZE, MODEX_VIRT_START + i*MODEX_PAGE_SIZE);
+    tlb_batch_flush();
     *screen_start = (uint8_t* )MODEX_VIRT_START;
     return 0;
 }
@@ -823,3 +909,292 @@ int32_t sys_map_modex(uint8_t** screen_start) {
 int32_t sys_getip(void) {
 	return get_ip();
 }
+
+
+/* sys_fork
+   description: create a child process that runs the same program as the caller. the child gets a copy-on-write view of the caller's user pages and copies of its file descriptors, and is picked up by the scheduler like any background process. the caller keeps running; it does not wait for the child.
+   input: none
+   output: none
+   return value: pid of the child to the caller, 0 to the child; -1 if no pid is available
+   side effect: none
+*/
+int32_t sys_fork(void) {
+    uint32_t flags;
+    pcb_t* child_pcb;
+    struct regs* child_regs;
+    cli_and_save(flags); // critical section begins
+    if ((child_pcb = child_pcb_init(cur_proc_pcb)) == NULL) {
+        restore_flags(flags); // critical section ends
+        return -1;
+    }
+
+    /* copy process state; the child has no parent waiting on it */
+    strncpy(child_pcb->command, cur_proc_pcb->command, ARG_WORD_SIZE);
+    strncpy(child_pcb->arg, cur_proc_pcb->arg, ARG_WORD_SIZE);
+    child_pcb->prog_break = cur_proc_pcb->prog_break;
+    child_pcb->ring = cur_proc_pcb->ring; // the copy-on-write address space carries the rings along
+    child_pcb->ring_entries = cur_proc_pcb->ring_entries;
+    child_pcb->parent_esp = 0;
+    memcpy(child_pcb->sighand, cur_proc_pcb->sighand, sizeof(child_pcb->sighand));
+    init_list_head(&(child_pcb->sigpending));
+    if (fd_array_dup(cur_proc_pcb, child_pcb) == -1) {
+        proc_set_state(child_pcb, ZOMBIE); // never ran, the scheduler releases it
+        restore_flags(flags); // critical section ends
+        return -1;
+    }
+    fpu_fork(cur_proc_pcb, child_pcb);
+
+    /* share user pages copy-on-write, and give the child its own video page */
+    vm_fork(cur_proc_pcb, child_pcb);
+    proc_vidmap_update(child_pcb);
+
+    /* the child resumes from a copy of the caller's trap frame at the top of its kernel stack, returning 0 */
+    child_regs = (struct regs* )(get_esp0_by_pid(child_pcb->pid) - sizeof(struct regs));
+    memcpy(child_regs, cur_regs, sizeof(struct regs));
+    child_regs->eax = 0;
+    child_pcb->kernel_esp = (uint32_t)child_regs;
+    child_pcb->kernel_ebp = 0;
+    child_pcb->lock_depth = 1; // one kernel entry to leave, like the caller
+
+    proc_set_state(child_pcb, RUNNABLE); // runnable from now on
+    restore_flags(flags); // critical section ends
+    return child_pcb->pid;
+}
+
+
+/**
+ * sys_brk - set the program break of the current process
+ * @param addr - new program break, NULL to query the current one
+ * @return - program break after the call, -1 if the break can not be moved there
+ */
+int32_t sys_brk(void* addr) {
+    return vm_brk((uint32_t)addr);
+}
+
+
+/**
+ * sys_mmap - map an anonymous, zero-filled region into the current process
+ * @param length - length of the region in bytes
+ * @return - starting address of the region, -1 if out of address space
+ */
+int32_t sys_mmap(uint32_t length) {
+    return vm_mmap(length);
+}
+
+
+/**
+ * sys_munmap - unmap anonymous memory of the current process
+ * @param addr - page aligned starting address
+ * @param length - length of the range in bytes
+ * @return - 0 if success, -1 if the range is invalid or overlaps the rings
+ */
+int32_t sys_munmap(void* addr, uint32_t length) {
+    return vm_munmap((uint32_t)addr, length);
+}
+
+
+/**
+ * sys_sleep - block the calling process for a while; other processes get the cpu in the meantime
+ * @param ms - time to sleep in ms
+ * @return - 0, or the time left in ms if a signal cut the sleep short
+ */
+int32_t sys_sleep(uint32_t ms) {
+    return msleep(ms);
+}
+
+
+/**
+ * sys_alarm - raise ALARM at the calling process after a while, replacing any alarm it has set before
+ * @param ms - time until the alarm in ms; 0 only cancels the alarm set before
+ * @return - time that was left until the previous alarm in ms, 0 if there was none
+ */
+int32_t sys_alarm(uint32_t ms) {
+    uint32_t flags;
+    int32_t left = 0;
+    timer_t* alarm = &(cur_proc_pcb->alarm);
+    cli_and_save(flags); // critical section begins
+    if (timer_pending(alarm)) {
+        left = (int32_t)(alarm->expires - system_time.count_ms);
+        if (left <= 0) left = 1; // due at this very tick
+    }
+    if (ms == 0)
+        timer_del(alarm);
+    else
+        timer_add(alarm, system_time.count_ms + ms);
+    restore_flags(flags); // critical section ends
+    return left;
+}
+
+
+/**
+ * sys_setpriority - set the base priority level of a process. a batch job can be demoted so that it only runs when
+ * nothing more important can; the process moves to the new level right away
+ * @param pid - pid of the process
+ * @param nice - new base level, from 0 (highest) to SCHED_LEVELS - 1 (lowest)
+ * @return - 0 if success, -1 if no such process or the level is invalid
+ */
+int32_t sys_setpriority(uint32_t pid, uint32_t nice) {
+    pcb_t* pcb = get_pcb_by_pid(pid);
+    if (pcb == NULL || proc_status[pid] == INACTIVE || nice >= SCHED_LEVELS) return -1;
+    pcb->nice = nice;
+    sched_set_level(pcb, nice);
+    return 0;
+}
+
+
+/**
+ * sys_clock_gettime - read a clock with nanosecond resolution
+ * @param clock_id - CLOCK_MONOTONIC for the time since boot
+ * @param ts - receives the time
+ * @return - 0 if success, -1 if the clock is not supported or ts is not in user space
+ */
+int32_t sys_clock_gettime(uint32_t clock_id, timespec_t* ts) {
+    if (clock_id != CLOCK_MONOTONIC) return -1; // there is no wall clock to back CLOCK_REALTIME
+    if ((uint32_t)ts < USER_VIRT_TOP || (uint32_t)ts > USER_VIRT_BOT - sizeof(timespec_t)) return -1;
+    ktime_to_timespec(ktime_get(), ts);
+    return 0;
+}
+
+
+/**
+ * sys_ring_setup - map a submission and a completion ring into the calling process, see ring.h
+ * @param entries - length of each queue, a power of two up to RING_MAX_ENTRIES
+ * @return - address of the rings, -1 if the length is invalid or the process has its rings already
+ */
+int32_t sys_ring_setup(uint32_t entries) {
+    return ring_setup(entries);
+}
+
+
+/**
+ * sys_ring_enter - run file operations queued on the ring of the calling process, and post their results
+ * @param to_submit - most operations to take off the submission queue
+ * @return - number of operations taken, -1 if the process has no rings
+ */
+int32_t sys_ring_enter(uint32_t to_submit) {
+    return ring_enter(to_submit);
+}
+
+
+/**
+ * user_buf_ok - check that a buffer lies within user space, so the kernel does not read or write its own memory for it
+ * @param buf - start of the buffer
+ * @param len - length of the buffer in bytes
+ * @return - 1 if [buf, buf + len) is within user space, 0 if not
+ */
+static int32_t user_buf_ok(const void* buf, uint32_t len) {
+    return (uint32_t)buf >= USER_VIRT_TOP && (uint32_t)buf <= USER_VIRT_BOT && len <= USER_VIRT_BOT - (uint32_t)buf;
+}
+
+
+/**
+ * iov_fetch - copy a vector of buffers in from user space, so it can not change while it is used
+ * @param kiov - kernel copy, IOV_MAX entries long
+ * @param iov - vector in user space
+ * @param iovcnt - number of buffers
+ * @return - 0 if success, -1 if there are too many buffers, one is not in user space or their lengths add up past 2gb
+ */
+static int32_t iov_fetch(iovec_t* kiov, const iovec_t* iov, uint32_t iovcnt) {
+    uint32_t i, total = 0;
+    if (iovcnt == 0 || iovcnt > IOV_MAX) return -1;
+    if (!user_buf_ok(iov, iovcnt * sizeof(iovec_t))) return -1;
+    memcpy(kiov, iov, iovcnt * sizeof(iovec_t));
+    for (i = 0; i < iovcnt; i++) {
+        if (!user_buf_ok(kiov[i].iov_base, kiov[i].iov_len)) return -1;
+        if (kiov[i].iov_len > 0x7FFFFFFF - total) return -1;
+        total += kiov[i].iov_len;
+    }
+    return 0;
+}
+
+
+/**
+ * sys_readv - read from a file into several buffers in one call, filling each before the next
+ * @param fd - file descriptor
+ * @param iov - buffers
+ * @param iovcnt - number of buffers, up to IOV_MAX
+ * @return - number of bytes read, -1 on failure
+ */
+int32_t sys_readv(uint32_t fd, const iovec_t* iov, uint32_t iovcnt) {
+    iovec_t kiov[IOV_MAX];
+    file_t* file;
+    int32_t total = 0, len;
+    uint32_t i;
+    if (fd >= MAX_OPEN_FILES || fd_avail(fd) || iov_fetch(kiov, iov, iovcnt) == -1) return -1;
+    file = cur_proc_pcb->fd_array + fd;
+    if (file->f_op->readv != NULL)
+        return file->f_op->readv(file, kiov, iovcnt);
+
+    /* one read per buffer; a short read ends the call */
+    for (i = 0; i < iovcnt; i++) {
+        if ((len = file->f_op->read(file, kiov[i].iov_base, kiov[i].iov_len)) == -1)
+            return (total > 0) ? total : -1;
+        total += len;
+        if ((uint32_t)len < kiov[i].iov_len) break;
+    }
+    return total;
+}
+
+
+/**
+ * sys_writev - write several buffers to a file in one call, in order
+ * @param fd - file descriptor
+ * @param iov - buffers
+ * @param iovcnt - number of buffers, up to IOV_MAX
+ * @return - number of bytes written, -1 on failure
+ */
+int32_t sys_writev(uint32_t fd, const iovec_t* iov, uint32_t iovcnt) {
+    iovec_t kiov[IOV_MAX];
+    file_t* file;
+    int32_t total = 0, len;
+    uint32_t i;
+    if (fd >= MAX_OPEN_FILES || fd_avail(fd) || iov_fetch(kiov, iov, iovcnt) == -1) return -1;
+    file = cur_proc_pcb->fd_array + fd;
+    if (file->f_op->writev != NULL)
+        return file->f_op->writev(file, kiov, iovcnt);
+
+    /* one write per buffer; a short write ends the call */
+    for (i = 0; i < iovcnt; i++) {
+        if ((len = file->f_op->write(file, kiov[i].iov_base, kiov[i].iov_len)) == -1)
+            return (total > 0) ? total : -1;
+        if (len == 0) // write ops such as terminal_fwrite and file_fwrite return 0 once all of buf is written
+            len = kiov[i].iov_len;
+        total += len;
+        if ((uint32_t)len < kiov[i].iov_len) break;
+    }
+    return total;
+}
+
+
+/**
+ * sys_pread - read from a file at a given offset, leaving the file position alone
+ * @param fd - file descriptor
+ * @param buf - buffer
+ * @param nbytes - number of bytes to read
+ * @param offset - offset in the file, passed in esi
+ * @return - number of bytes read, -1 on failure, if buf is not in user space or if the file has no offsets
+ */
+int32_t sys_pread(uint32_t fd, void* buf, uint32_t nbytes, uint32_t offset) {
+    file_t* file;
+    if (fd >= MAX_OPEN_FILES || fd_avail(fd) || !user_buf_ok(buf, nbytes)) return -1;
+    file = cur_proc_pcb->fd_array + fd;
+    if (file->f_op->pread == NULL) return -1;
+    return file->f_op->pread(file, buf, nbytes, offset);
+}
+
+
+/**
+ * sys_pwrite - write to a file at a given offset, leaving the file position alone
+ * @param fd - file descriptor
+ * @param buf - buffer
+ * @param nbytes - number of bytes to write
+ * @param offset - offset in the file, passed in esi
+ * @return - number of bytes written, -1 on failure, if buf is not in user space or if the file has no offsets
+ */
+int32_t sys_pwrite(uint32_t fd, const void* buf, uint32_t nbytes, uint32_t offset) {
+    file_t* file;
+    if (fd >= MAX_OPEN_FILES || fd_avail(fd) || !user_buf_ok(buf, nbytes)) return -1;
+    file = cur_proc_pcb->fd_array + fd;
+    if (file->f_op->pwrite == NULL) return -1;
+    return file->f_op->pwrite(file, buf, nbytes, offset);
+}
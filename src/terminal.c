@@ -10,7 +10,6 @@
 
 uint8_t ATTRIB = SET_COLOR(LIGHTGRAY, BLACK);
 
-pcb_t * cur_proc_pcb; // declared in proc.h
 uint8_t* usr_name[USR_NAME_LEN]; // declared in terminal.h
 uint8_t proc_status[NUM_PROC]; // declared in proc.h
 int32_t history_ptr[NUM_SESS];
@@ -130,14 +129,13 @@ void startup_envir_init(void) {
     boundary[1] = BOUNDARY2;
     boundary[2] = BOUNDARY3;
 
-    /* initiate environments for three sessions */
+    /* initiate environments for three sessions. these are the first processes created, so the pid of each shell matches its session id */
     for (cur_pid = 0; cur_pid < NUM_SESS; cur_pid++) {
-        cur_pcb = get_pcb_by_pid(cur_pid);
-        cur_pcb->pid = cur_pid;
+        cur_pcb = proc_alloc();
         cur_pcb->parent_pid = NUM_PROC; // mark parent pid to be invalid
         cur_pcb->active_sess = cur_pid; // set active session
         strncpy(cur_pcb->command, "shell", SHELL_CMD_LEN); // shell command length is 5
-        proc_status[cur_pid] = PENDING; // set process to be pending
+        proc_set_state(cur_pcb, PENDING); // set process to be pending
         proc_signal_init(cur_pcb); // set signal handler
     }
 }
@@ -164,7 +162,9 @@ void terminal_init(void) {
         sess_desc[i].vid_x = sess_desc[i].vid_y = 0;
         sess_desc[i].cached_vidmem = get_cached_vidmem(i);
         map_virtual_4kb_first(sess_desc[i].cached_vidmem, sess_desc[i].cached_vidmem);
+        spin_lock_init(&sess_desc[i].cmd_lock);
         sess_desc[i].cmd_available = 0;
+        init_wait_queue(&sess_desc[i].cmd_wait);
         sess_desc[i].kbd_buf_idx = 0;
         for (j = 0; j < KEY_BUF_SIZE; j++) // clear keyboard buffer
             sess_desc[i].kbd_buf[i] = 0x00;
@@ -181,7 +181,7 @@ void terminal_init(void) {
 
     /* startup terminal 0 for current session */
     cur_sess_id = 0;
-    proc_status[cur_sess_id] = ACTIVE;
+    proc_set_state(get_pcb_by_pid(cur_sess_id), ACTIVE);
 }
 
 
@@ -194,6 +194,8 @@ void terminal_init(void) {
    author: Kexuan Zou
 */
 int sess_switch(uint32_t sess_id) {
+    uint32_t pid;
+    unsigned long flags;
     if (sess_id >= NUM_SESS) return -1; // if sess_id is invalid
     if (sess_id == cur_sess_id) return 0; // shourtcut from switching to the same session
 
@@ -213,13 +215,13 @@ int sess_switch(uint32_t sess_id) {
     /* update session id */
     cur_sess_id = sess_id;
 
-    /* if switching to an active session, then current process running must switch back to active and write to video memory */
-    if (cur_proc_pcb->active_sess == cur_sess_id)
-        map_virtual_4kb_prog(VIDEO, VMEM_VIRT_START);
-
-    /* if switching away from an active session, then current process running must run as daemon and write to its assigned cached video memory */
-    else
-        map_virtual_4kb_prog(sess_desc[cur_sess_id].cached_vidmem, VMEM_VIRT_START);
+    /* every process keeps its own video page, so repoint all of them: processes of the new session write to video memory, the rest to their cached video memory */
+    read_lock_irqsave(&proc_lock, flags);
+    for (pid = 0; pid < NUM_PROC; pid++) {
+        if (proc_table[pid] != NULL && proc_status[pid] != INACTIVE && proc_status[pid] != PENDING)
+            proc_vidmap_update(proc_table[pid]);
+    }
+    read_unlock_irqrestore(&proc_lock, flags);
 
     if(history_ptr[sess_id] <= (screen_head[sess_id] + NUM_COLS * (NUM_ROWS - 1))){
         enable_cursor(0, NUM_ROWS-1);
@@ -324,11 +326,11 @@ static int32_t terminal_fread(file_t * self, void * buf, uint32_t nbytes) {
         nbytes = KEY_BUF_SIZE;
     }
 
-    // Spin until the next enter.
-    while (sess_desc[cur_proc_pcb->active_sess].cmd_available == 0);
-    sess_desc[cur_proc_pcb->active_sess].cmd_available = 0;
+    // Sleep until the next enter.
+    wait_event(&sess_desc[cur_proc_pcb->active_sess].cmd_wait, sess_desc[cur_proc_pcb->active_sess].cmd_available);
 
-    cli_and_save(flags); // critical section begins
+    spin_lock_irqsave(&sess_desc[cur_proc_pcb->active_sess].cmd_lock, flags);
+    sess_desc[cur_proc_pcb->active_sess].cmd_available = 0;
     for (i = 0; i < nbytes; i++) {
         ((uint8_t *)buf)[i] = sess_desc[cur_proc_pcb->active_sess].cmd_buf[i]; // copy cmd_buf into target buffer
         if (sess_desc[cur_proc_pcb->active_sess].cmd_buf[i] == '\n') { // reaching newline char
@@ -337,8 +339,7 @@ static int32_t terminal_fread(file_t * self, void * buf, uint32_t nbytes) {
             break;
         }
     }
-    sti();
-    restore_flags(flags); // critical section ends
+    spin_unlock_irqrestore(&sess_desc[cur_proc_pcb->active_sess].cmd_lock, flags);
     return i;
 }
 
@@ -10,6 +10,7 @@
 #include <sound.h>
 #include <ext2.h>
 #include <mem.h>
+#include <heapinfo.h>
 #include <list.h>
 #include <aes.h>
 #include <rand.h>
@@ -408,6 +409,84 @@ void test_ext2_rm(void) {
     iroot->i_op->remove(iroot, fname);
 }
 
+#define VEC_TEST_MAX 16384 // frame0.txt, and room for the buffers below to span blocks of up to 4kb
+
+static uint8_t vec_ref [VEC_TEST_MAX];
+static uint8_t vec_buf [VEC_TEST_MAX];
+
+static int32_t vec_same(const uint8_t * a, const uint8_t * b, uint32_t len) {
+    while (len-- > 0)
+        if (*a++ != *b++)
+            return 0;
+    return 1;
+}
+
+/// Reads frame0.txt through readv and pread, and compares the bytes with what
+/// file_fread gives. The buffers include empty ones, ones that end on a block
+/// boundary or span several blocks, and reads that start or run past the end
+/// of the file.
+void test_ext2_readv_pread(void) {
+    uint32_t blocksize = superblock.s_blocksize;
+    uint32_t offs [6];
+    iovec_t iov [6];
+    int32_t size, bytes, want, ok;
+    uint32_t i;
+    file_t file;
+
+    file.f_op = ext2_file_fop;
+    file.f_op->open(&file, "frame0.txt");
+    size = file.f_op->read(&file, vec_ref, VEC_TEST_MAX);
+    TEST_OUTPUT("file_fread whole file", size > 0 && size < VEC_TEST_MAX);
+    if (size <= 0 || size >= VEC_TEST_MAX)
+        return;
+
+    // Whole file, from offset 0.
+    iov[0].iov_base = vec_buf;                  iov[0].iov_len = 0;
+    iov[1].iov_base = vec_buf;                  iov[1].iov_len = 1;
+    iov[2].iov_base = vec_buf + 1;              iov[2].iov_len = 0;
+    iov[3].iov_base = vec_buf + 1;              iov[3].iov_len = blocksize - 2;
+    iov[4].iov_base = vec_buf + blocksize - 1;  iov[4].iov_len = blocksize + 2;
+    iov[5].iov_base = vec_buf + 2 * blocksize + 1;
+    iov[5].iov_len = VEC_TEST_MAX - 2 * blocksize - 1;
+    file.f_pos = 0;
+    bytes = file.f_op->readv(&file, iov, 6);
+    TEST_OUTPUT("readv whole file", bytes == size && vec_same(vec_buf, vec_ref, size) && file.f_pos == size);
+
+    // From the middle, ending in an empty buffer past the end of file.
+    file.f_pos = size / 2;
+    iov[0].iov_base = vec_buf;      iov[0].iov_len = 3;
+    iov[1].iov_base = vec_buf + 3;  iov[1].iov_len = VEC_TEST_MAX - 3;
+    iov[2].iov_base = vec_buf;      iov[2].iov_len = 0;
+    want = size - size / 2;
+    bytes = file.f_op->readv(&file, iov, 3);
+    TEST_OUTPUT("readv from the middle", bytes == want && vec_same(vec_buf, vec_ref + size / 2, want) && file.f_pos == size);
+
+    // At the end of file there is nothing left.
+    bytes = file.f_op->readv(&file, iov, 2);
+    TEST_OUTPUT("readv at end of file", bytes == 0 && file.f_pos == size);
+
+    // pread around block boundaries; none of them moves f_pos.
+    offs[0] = 0;
+    offs[1] = 1;
+    offs[2] = blocksize - 1;
+    offs[3] = blocksize;
+    offs[4] = size - 1;
+    offs[5] = size;
+    ok = 1;
+    file.f_pos = 0;
+    for (i = 0; i < 6; i++) {
+        want = (offs[i] >= size) ? 0 : size - offs[i];
+        if (want > blocksize + 1)
+            want = blocksize + 1;
+        bytes = file.f_op->pread(&file, vec_buf, blocksize + 1, offs[i]);
+        if (bytes != want || !vec_same(vec_buf, vec_ref + offs[i], want) || file.f_pos != 0)
+            ok = 0;
+    }
+    TEST_OUTPUT("pread at block boundaries", ok);
+
+    file.f_op->close(&file);
+}
+
 typedef struct irq_action {
     void (* handler)(void);
     uint32_t flags;
@@ -466,6 +545,35 @@ void test_bst(void) {
     free(head);
 }
 
+void test_slab(void) {
+    int i;
+    void* objs[64];
+    kmem_cache_t* cache = kmem_cache_select(sizeof(dentry_t));
+    uint32_t pages = alloc_info.page_alloc;
+    uint32_t max_pages = (64 + cache->obj_per_slab - 1) / cache->obj_per_slab + 1; // one partial slab may be taken already
+    for (i = 0; i < 64; i++) // 64 dentries should fit in a handful of pages
+        objs[i] = malloc(sizeof(dentry_t));
+    TEST_OUTPUT("slab pages for 64 dentries", alloc_info.page_alloc - pages <= max_pages);
+    for (i = 0; i < 64; i++)
+        free(objs[i]);
+    TEST_OUTPUT("slab pages back after free", alloc_info.page_alloc <= pages + 1); // the cache keeps one empty slab
+}
+
+void test_heapinfo(void) {
+    file_t file;
+    int8_t buf[128];
+    int32_t n;
+    uint32_t inuse = alloc_stat.cls[SLAB_CLASS(kmem_cache_select(sizeof(dentry_t)))].inuse;
+    void* obj = malloc(sizeof(dentry_t));
+    TEST_OUTPUT("heapinfo class count", alloc_stat.cls[SLAB_CLASS(kmem_cache_select(sizeof(dentry_t)))].inuse == inuse + 1);
+    free(obj);
+    heapinfo_fop->open(&file, "heapinfo");
+    while ((n = heapinfo_fop->read(&file, buf, sizeof(buf) - 1)) > 0) {
+        buf[n] = '\0';
+        printf("%s", buf);
+    }
+}
+
 /* Checkpoint 2 tests */
 /* Checkpoint 3 tests */
 /* Checkpoint 4 tests */
@@ -571,6 +679,7 @@ void launch_tests(){
 	// launch your tests here
 
     //test_bst();
+    //test_ext2_readv_pread();
 
 	send_arq_request();
 	//while(1);
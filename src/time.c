@@ -1,4 +1,6 @@
-/* time.c - Functions to handle clock tick.
+/* time.c - Functions to handle clock tick. Kernel timers hang in a wheel of TIMER_WHEEL_SIZE slots indexed by the low
+   bits of their expiry time; each pit tick only looks at the slot of the current millisecond, so adding, removing and
+   firing a timer costs the same however many are pending.
    author: Kexuan Zou
    date: 11/19/2017
 */
@@ -6,8 +8,16 @@
 #include <time.h>
 #include <pit.h>
 #include <lib.h>
+#include <list.h>
+#include <wait.h>
+#include <smp.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <signal.h>
 
 volatile time_t system_time;
+static struct list_head timer_wheel[TIMER_WHEEL_SIZE]; // pending timers, by the low bits of their expiry time
+static DEFINE_SPINLOCK(timer_lock); // guards the wheel and the expired list of run_timers
 
 /* count_start
    description: call to start a timer
@@ -34,8 +44,155 @@ uint32_t count_end(uint32_t* time_var) {
 }
 
 
+/* timer_add
+   description: arm a timer; it fires at the first pit tick at or after its expiry time. a timer already pending is moved to the new time.
+   input: timer - initialized timer
+          expires - system time in ms at which to fire
+   output: none
+   return value: none
+   side effect: none
+*/
+void timer_add(timer_t* timer, uint32_t expires) {
+    uint32_t flags, slot = expires;
+    spin_lock_irqsave(&timer_lock, flags);
+    if (timer_pending(timer))
+        list_delete(&(timer->node));
+    if ((int32_t)(expires - system_time.count_ms) <= 0) // already due, fire at the next tick
+        slot = system_time.count_ms + 1;
+    timer->expires = expires;
+    list_insert_before(&(timer->node), &timer_wheel[slot & TIMER_WHEEL_MASK]);
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+
+/* timer_del
+   description: disarm a timer if it is pending
+   input: timer - initialized timer
+   output: none
+   return value: none
+   side effect: none
+*/
+void timer_del(timer_t* timer) {
+    uint32_t flags;
+    spin_lock_irqsave(&timer_lock, flags);
+    if (timer_pending(timer)) {
+        list_delete(&(timer->node));
+        init_list_head(&(timer->node));
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+
+/* run_timers
+   description: fire the timers due at the current tick. called from the pit interrupt; a timer in the slot whose expiry is a whole turn of the wheel away stays. expired timers are taken out first, and their functions run without timer_lock, so they may add or remove timers freely.
+   input: none
+   output: none
+   return value: none
+   side effect: none
+*/
+void run_timers(void) {
+    uint32_t now = system_time.count_ms;
+    struct list_head* slot = &timer_wheel[now & TIMER_WHEEL_MASK];
+    struct list_head* itr, * next;
+    timer_t* timer;
+    LIST_HEAD(expired);
+
+    spin_lock(&timer_lock); // interrupts are already off in the pit handler
+    for (itr = slot->next; itr != slot; itr = next) {
+        next = itr->next;
+        timer = LIST_ENTRY(itr, timer_t, node);
+        if ((int32_t)(now - timer->expires) >= 0) {
+            list_delete(itr);
+            list_insert_before(itr, &expired);
+        }
+    }
+    while (!list_is_empty(&expired)) {
+        timer = LIST_FIRST_ENTRY(&expired, timer_t, node);
+        list_delete(&(timer->node));
+        init_list_head(&(timer->node));
+        spin_unlock(&timer_lock);
+        timer->func(timer->data);
+        spin_lock(&timer_lock);
+    }
+    spin_unlock(&timer_lock);
+}
+
+
+/* timer_next
+   description: find how soon a timer may fire, for the idle tick. the first non-empty slot is taken as due; a timer in it that is whole turns of the wheel away only wakes the cpu early.
+   input: none
+   output: none
+   return value: ms until the next tick with a timer; TIMER_WHEEL_SIZE if the wheel is empty
+   side effect: must be called with interrupts off
+*/
+uint32_t timer_next(void) {
+    uint32_t now = system_time.count_ms, i;
+    spin_lock(&timer_lock);
+    for (i = 1; i < TIMER_WHEEL_SIZE; i++) {
+        if (!list_is_empty(&timer_wheel[(now + i) & TIMER_WHEEL_MASK]))
+            break;
+    }
+    spin_unlock(&timer_lock);
+    return i;
+}
+
+
+/* sleep_timeout
+   description: timer function that wakes up the wait queue a process sleeps on
+   input: data - the wait queue
+   output: none
+   return value: none
+   side effect: none
+*/
+static void sleep_timeout(uint32_t data) {
+    wake_up((wait_queue_t* )data);
+}
+
+
+/* sleep_on_timeout
+   description: sleep on a wait queue until woken up, or until the given time passes. like sleep_on, callers test their wait condition with interrupts off first.
+   input: wq - wait queue
+          ms - longest time to sleep in ms
+   output: none
+   return value: time left in ms; 0 if the time has run out
+   side effect: gives up the cpu
+*/
+uint32_t sleep_on_timeout(wait_queue_t* wq, uint32_t ms) {
+    timer_t timer;
+    uint32_t flags, expires = system_time.count_ms + ms;
+    int32_t left;
+    cli_and_save(flags); // critical section begins
+    timer_init(&timer, sleep_timeout, (uint32_t)wq);
+    timer_add(&timer, expires);
+    sleep_on(wq);
+    timer_del(&timer);
+    restore_flags(flags); // critical section ends
+    left = (int32_t)(expires - system_time.count_ms);
+    return (left > 0) ? left : 0;
+}
+
+
+/* msleep
+   description: block the current process for the given time; other processes run in the meantime. a signal ends the sleep early, request_signal wakes the process up for it.
+   input: ms - time to sleep in ms
+   output: none
+   return value: time left in ms; 0 if the whole time has passed
+   side effect: gives up the cpu
+*/
+uint32_t msleep(uint32_t ms) {
+    wait_queue_t wq;
+    uint32_t flags;
+    init_wait_queue(&wq);
+    cli_and_save(flags); // a signal raised between the test and the sleep would not wake the process
+    while (ms > 0 && !signal_pending(cur_proc_pcb))
+        ms = sleep_on_timeout(&wq, ms);
+    restore_flags(flags);
+    return ms;
+}
+
+
 /* sleep
-   description: delay for specifed amount of time (spins cpu)
+   description: delay for specifed amount of time (spins cpu). for boot code and drivers that run before any process does; processes should use msleep
    input: delay - amount of time to delay
    output: none
    return value: none
@@ -49,14 +206,19 @@ void sleep(int ms) {
 
 
 /* system_time_init
-   description: sets global system time, initializes pit
+   description: sets global system time, empties the timer wheel, initializes pit and the clock
    input: none
    output: none
    return value: none
    side effect: none
 */
 void system_time_init(void) {
+    int i;
     system_time.count_ms = 0;
+    for (i = 0; i < TIMER_WHEEL_SIZE; i++)
+        init_list_head(&timer_wheel[i]);
     //TODO: get current time from server
     pit_init();
+    smp_init(); // the application processors are started with pit_udelay
+    clock_init();
 }
@@ -19,6 +19,29 @@ void free_dentry(dentry_t * dentry) {
     }
 }
 
+/// Copies a dentry and all of its ancestors up to (excluding) the root,
+/// so that the copy can be released by free_dentry independently.
+///
+/// - return: the copy of the given dentry, or NULL if out of memory
+dentry_t * dup_dentry(dentry_t * dentry) {
+    dentry_t * head, ** link;
+    link = &head;
+    while (dentry != &superblock.s_root) {
+        *link = (dentry_t *)malloc(sizeof(dentry_t));
+        if (*link == NULL) {
+            // Release the part of the chain copied so far.
+            *link = &superblock.s_root;
+            free_dentry(head);
+            return NULL;
+        }
+        **link = *dentry;
+        link = &(*link)->d_parent;
+        dentry = dentry->d_parent;
+    }
+    *link = &superblock.s_root;
+    return head;
+}
+
 int32_t parse_path(const int8_t * path, dentry_t * parent, dentry_t * node) {
     uint32_t i, j;
     int32_t retval;
@@ -0,0 +1,288 @@
+/* vm.c - demand-paged user address space. The 4mb user region of a process is mapped with 4kb pages that are filled
+   in on first touch: pages overlapping the program image are read from the executable, everything else (bss, heap
+   grown by brk, user stack) is handed out zero-filled. Nothing is mapped at execute time. A forked child shares the
+   frames of its parent copy-on-write; frames are reference counted by the frame allocator. The program break grows
+   upwards from the end of the image and anonymous mappings grow downwards from the stack; both only reserve address
+   space, frames still come from the fault handler.
+*/
+
+#include <vm.h>
+#include <frame.h>
+#include <ext2.h>
+#include <paging.h>
+#include <proc.h>
+#include <ring.h>
+#include <bitmap.h>
+#include <lib.h>
+#include <types.h>
+#include <system.h>
+
+/* vm_proc_init
+   description: give a process an empty user address space backed by a program image, with the program break right after the image. frames of a previous image of the same process are released first.
+   input: pcb - pcb of the process
+          prog_inode - inode of the executable
+   output: none
+   return value: none
+   side effect: Modifies the page directory and user page table of the process
+*/
+void vm_proc_init(pcb_t* pcb, const inode_t* prog_inode) {
+    vm_release(pcb->pid);
+    pgdir_init(pcb->pid);
+    pcb->prog_inode = *prog_inode;
+    pcb->prog_break = align_addr_long(PROG_VIRT_START + prog_inode->i_size);
+    bitmap_clear(pcb->mmap_map, USER_MMAP_PAGES);
+    pcb->ring = 0; // the rings went with the old mappings
+    pcb->ring_entries = 0;
+}
+
+
+/* vm_release
+   description: give every frame mapped in the user region of a process back to the frame allocator
+   input: pid - pid of the process
+   output: none
+   return value: none
+   side effect: the user page table of the process is cleared. the caller must not be running on these entries, or must flush the tlb afterwards
+*/
+void vm_release(uint32_t pid) {
+    uint32_t i;
+    uint32_t* table = get_pcb_by_pid(pid)->user_table;
+    for (i = 0; i < NUM_PTE; i++) {
+        if (table[i] & EN_P)
+            frame_free(table[i] & USER_PAGE_MASK);
+        table[i] = 0;
+    }
+}
+
+
+/* vm_fork
+   description: share the user address space of a parent with its child. writable pages become read-only copy-on-write in both, so a page is copied only once either side writes it.
+   input: parent - pcb of the parent process, must be the current process
+          child - pcb of the child process
+   output: none
+   return value: none
+   side effect: Modifies the page directory and user page tables of both processes, flushes the tlb
+*/
+void vm_fork(pcb_t* parent, pcb_t* child) {
+    uint32_t i;
+    uint32_t* src = parent->user_table;
+    uint32_t* dst = child->user_table;
+    vm_release(child->pid);
+    pgdir_init(child->pid);
+    for (i = 0; i < NUM_PTE; i++) {
+        if (!(src[i] & EN_P))
+            continue;
+        if (src[i] & EN_RW)
+            src[i] = (src[i] & ~EN_RW) | EN_COW;
+        dst[i] = src[i];
+        frame_get(src[i] & USER_PAGE_MASK);
+    }
+    child->prog_inode = parent->prog_inode;
+    bitmap_copy(child->mmap_map, parent->mmap_map, USER_MMAP_PAGES);
+    flush_tlb(); // parent's cached entries may still allow writes
+}
+
+
+/* vm_break_cow
+   description: give the current process a private, writable copy of a copy-on-write page
+   input: pte - user page table entry of the page
+          vaddr - page aligned user address
+   output: none
+   return value: 0 if success; -1 if out of memory
+   side effect: drops a reference to the shared frame
+*/
+static int32_t vm_break_cow(uint32_t* pte, uint32_t vaddr) {
+    uint32_t old_phys = *pte & USER_PAGE_MASK;
+    uint32_t new_phys;
+
+    /* every other sharer is gone, the page can be taken over as is */
+    if (frame_ref_count(old_phys) == 1) {
+        *pte = (*pte & ~EN_COW) | EN_RW;
+        invlpg(vaddr);
+        return 0;
+    }
+
+    if ((new_phys = frame_alloc()) == ENOMEM)
+        return -1;
+    map_virtual_4kb_first(new_phys, KMAP_ADDR);
+    invlpg(KMAP_ADDR); // the mapping is needed right away, even inside a tlb batch
+    memcpy((void* )KMAP_ADDR, (const void* )vaddr, PAGE_SIZE);
+    *pte = (new_phys & USER_PAGE_MASK & ~EN_A) | EN_P | EN_RW | EN_US;
+    invlpg(vaddr);
+    frame_free(old_phys);
+    return 0;
+}
+
+
+/* vm_load_image
+   description: copy the part of the program image that overlaps a user page into that page
+   input: pcb - pcb of the process
+          vaddr - page aligned user address
+   output: none
+   return value: 0 if success; -1 if the file can not be read
+   side effect: none
+*/
+static int32_t vm_load_image(pcb_t* pcb, uint32_t vaddr) {
+    file_t image;
+    uint32_t start, end;
+    uint32_t image_end = PROG_VIRT_START + pcb->prog_inode.i_size;
+    if (vaddr + PAGE_SIZE <= PROG_VIRT_START || vaddr >= image_end)
+        return 0; // page is not part of the image, stays zero-filled
+
+    start = (vaddr < PROG_VIRT_START) ? PROG_VIRT_START : vaddr;
+    end = (vaddr + PAGE_SIZE > image_end) ? image_end : vaddr + PAGE_SIZE;
+    image.f_op = ext2_file_fop;
+    image.f_dentry.d_inode = pcb->prog_inode;
+    image.f_pos = start - PROG_VIRT_START;
+    return (image.f_op->read(&image, (void* )start, end - start) == -1) ? -1 : 0;
+}
+
+
+/* vm_handle_fault
+   description: resolve a page fault on a user address of the current process, either by mapping a fresh frame and filling it or by breaking copy-on-write sharing of the page
+   input: fault_addr - faulting linear address (cr2)
+          err_code - error code pushed by the processor
+   output: none
+   return value: 0 if the page is now mapped and the faulting instruction can be restarted; -1 if the fault is a genuine error
+   side effect: Modifies the user page table of the current process
+*/
+int32_t vm_handle_fault(uint32_t fault_addr, uint32_t err_code) {
+    uint32_t vaddr = fault_addr & USER_PAGE_MASK;
+    uint32_t phys;
+    uint32_t* pte;
+    if (cur_proc_pcb == NULL || fault_addr < USER_VIRT_TOP || fault_addr >= USER_VIRT_BOT)
+        return -1;
+
+    pte = &(cur_proc_pcb->user_table[USER_PTE_IDX(vaddr)]);
+    if (err_code & PF_PRESENT) { // protection violation, only writes to shared pages are expected
+        if ((err_code & PF_WRITE) && (*pte & EN_COW))
+            return vm_break_cow(pte, vaddr);
+        return -1;
+    }
+    if (*pte & EN_P) { // already mapped, only the tlb was stale
+        invlpg(vaddr);
+        return 0;
+    }
+    if ((phys = frame_alloc()) == ENOMEM)
+        return -1;
+    *pte = (phys & USER_PAGE_MASK & ~EN_A) | EN_P | EN_RW | EN_US;
+
+    memset((void* )vaddr, 0, PAGE_SIZE);
+    if (vm_load_image(cur_proc_pcb, vaddr) == -1) {
+        *pte = 0;
+        invlpg(vaddr);
+        frame_free(phys);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* vm_unmap_page
+   description: drop the frame behind a user page of the current process, if any. must be called inside a tlb batch.
+   input: vaddr - page aligned user address
+   output: none
+   return value: none
+   side effect: Modifies the user page table of the current process
+*/
+static void vm_unmap_page(uint32_t vaddr) {
+    uint32_t* pte = &(cur_proc_pcb->user_table[USER_PTE_IDX(vaddr)]);
+    if (!(*pte & EN_P))
+        return;
+    frame_free(*pte & USER_PAGE_MASK);
+    *pte = 0;
+    tlb_batch_add(vaddr);
+}
+
+
+/* vm_brk
+   description: move the program break of the current process. the break can not drop below the program image nor run into an anonymous mapping; pages given up by a shrinking break are released.
+   input: addr - new program break; 0 to query the current one
+   output: none
+   return value: the program break after the call; -1 if the request is invalid
+   side effect: a guard word is written at the new break
+*/
+int32_t vm_brk(uint32_t addr) {
+    uint32_t old_end, new_end, page;
+    if (addr == 0)
+        return cur_proc_pcb->prog_break;
+    addr = align_addr_long(addr);
+    if (addr < PROG_VIRT_START + cur_proc_pcb->prog_inode.i_size || addr + LONG_SIZE > USER_HEAP_BOT)
+        return -1;
+
+    /* pages the break is about to cover must not belong to an anonymous mapping */
+    old_end = PAGE_ALIGN_UP(cur_proc_pcb->prog_break + LONG_SIZE);
+    new_end = PAGE_ALIGN_UP(addr + LONG_SIZE);
+    for (page = old_end; page < new_end; page += PAGE_SIZE) {
+        if (bitmap_query_bit(cur_proc_pcb->mmap_map, MMAP_IDX(page)))
+            return -1;
+    }
+
+    tlb_batch_begin();
+    for (page = new_end; page < old_end; page += PAGE_SIZE)
+        vm_unmap_page(page);
+    tlb_batch_flush();
+    SET_BRK(addr);
+    return cur_proc_pcb->prog_break;
+}
+
+
+/* vm_mmap
+   description: reserve an anonymous, zero-filled region in the current process, as high up below the stack as it fits
+   input: length - length of the region in bytes
+   output: none
+   return value: starting address of the region; -1 if there is no room left above the program break
+   side effect: none
+*/
+int32_t vm_mmap(uint32_t length) {
+    uint32_t nr, idx, start;
+    if (length == 0 || length > USER_MMAP_PAGES * PAGE_SIZE)
+        return -1;
+    nr = PAGE_ALIGN_UP(length) >> 12;
+    idx = find_next_zero_area(cur_proc_pcb->mmap_map, USER_MMAP_PAGES, 0, nr);
+    if (idx >= USER_MMAP_PAGES)
+        return -1;
+
+    /* first fit from the top, so a fit below the break means there is no fit at all */
+    start = MMAP_ADDR(idx + nr - 1);
+    if (start < PAGE_ALIGN_UP(cur_proc_pcb->prog_break + LONG_SIZE))
+        return -1;
+
+    /* a page touched before it was reserved still holds old data, make sure it faults in zeroed */
+    tlb_batch_begin();
+    for (; nr > 0; nr--, idx++) {
+        bitmap_set_bit(cur_proc_pcb->mmap_map, idx);
+        vm_unmap_page(MMAP_ADDR(idx));
+    }
+    tlb_batch_flush();
+    return start;
+}
+
+
+/* vm_munmap
+   description: release the anonymous mappings of the current process within a range; pages of the range that are not mapped anonymously are left alone
+   input: addr - page aligned starting address
+          length - length of the range in bytes
+   output: none
+   return value: 0 if success; -1 if the range is invalid or overlaps the rings of the process
+   side effect: none
+*/
+int32_t vm_munmap(uint32_t addr, uint32_t length) {
+    uint32_t end, ring = cur_proc_pcb->ring;
+    if ((addr & ~USER_PAGE_MASK) || length == 0 || addr < USER_VIRT_TOP || addr >= USER_HEAP_BOT)
+        return -1;
+    end = (length > USER_HEAP_BOT - addr) ? USER_HEAP_BOT : PAGE_ALIGN_UP(addr + length);
+
+    /* ring_enter keeps writing completions there, into whatever a later vm_mmap puts in its place */
+    if (ring != 0 && addr < ring + RING_SIZE(cur_proc_pcb->ring_entries) && end > ring)
+        return -1;
+
+    tlb_batch_begin();
+    for (; addr < end; addr += PAGE_SIZE) {
+        if (!bitmap_query_bit(cur_proc_pcb->mmap_map, MMAP_IDX(addr)))
+            continue;
+        bitmap_clear_bit(cur_proc_pcb->mmap_map, MMAP_IDX(addr));
+        vm_unmap_page(addr);
+    }
+    tlb_batch_flush();
+    return 0;
+}
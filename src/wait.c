@@ -0,0 +1,83 @@
+/* wait.c - wait queues. a sleeping process is BLOCKED and linked into the wait queue instead of the run queue, so it
+   costs no cpu time until wake_up puts it back at the end of the run queue.
+*/
+
+#include <wait.h>
+#include <types.h>
+#include <lib.h>
+#include <list.h>
+#include <proc.h>
+#include <sched.h>
+
+/* sleep_on
+   description: block the current process on a wait queue until it is woken up. if no other process can run, the cpu halts until an interrupt arrives (see sched_idle); an interrupt that wakes the process lets it run again right away.
+   input: wq - wait queue
+   output: none
+   return value: none
+   side effect: gives up the cpu
+*/
+void sleep_on(wait_queue_t* wq) {
+    pcb_t* pcb = cur_proc_pcb;
+    uint32_t flags;
+    cli_and_save(flags); // critical section begins
+    list_insert_before(&(pcb->wait_node), &(wq->task_list));
+    proc_set_state(pcb, BLOCKED);
+    while (proc_status[pcb->pid] != ACTIVE)
+        sched_idle();
+    restore_flags(flags); // critical section ends
+}
+
+
+/* wake_up
+   description: make every process sleeping on a wait queue runnable. each one goes to the back of the run queue.
+   input: wq - wait queue
+   output: none
+   return value: none
+   side effect: none
+*/
+void wake_up(wait_queue_t* wq) {
+    pcb_t* pcb;
+    uint32_t flags;
+    cli_and_save(flags); // critical section begins
+    while (!list_is_empty(&(wq->task_list))) {
+        pcb = LIST_FIRST_ENTRY(&(wq->task_list), pcb_t, wait_node);
+        proc_set_state(pcb, RUNNABLE); // this also takes it off the wait queue
+    }
+    restore_flags(flags); // critical section ends
+}
+
+
+/* wake_up_process
+   description: make a process that sleeps on a wait queue runnable, whatever the queue. every sleeper tests its wait condition again when it runs, so waking one early is harmless. a process that is BLOCKED but not on a wait queue, such as a parent waiting on its child in sys_execute, is left alone.
+   input: pcb - pcb of the process
+   output: none
+   return value: none
+   side effect: none
+*/
+void wake_up_process(pcb_t* pcb) {
+    uint32_t flags;
+    cli_and_save(flags); // critical section begins
+    if (proc_status[pcb->pid] == BLOCKED && !list_is_empty(&(pcb->wait_node)))
+        proc_set_state(pcb, RUNNABLE); // this also takes it off the wait queue
+    restore_flags(flags); // critical section ends
+}
+
+
+/* wake_up_boost
+   description: make every process sleeping on a wait queue runnable at its base priority level, with a full time slice
+   input: wq - wait queue
+   output: none
+   return value: none
+   side effect: none
+*/
+void wake_up_boost(wait_queue_t* wq) {
+    pcb_t* pcb;
+    uint32_t flags;
+    cli_and_save(flags); // critical section begins
+    while (!list_is_empty(&(wq->task_list))) {
+        pcb = LIST_FIRST_ENTRY(&(wq->task_list), pcb_t, wait_node);
+        sched_set_level(pcb, pcb->nice);
+        proc_set_state(pcb, RUNNABLE);
+    }
+    restore_flags(flags); // critical section ends
+}
@@ -0,0 +1,182 @@
+/* umalloc.c - user-space memory allocator on top of the brk and mmap system calls. Small blocks are carved out of
+   memory past the program break and kept on a free list sorted by address, so that neighbouring free blocks merge
+   back together. Large blocks get an anonymous mapping of their own and are unmapped as soon as they are freed.
+   Layout of a block:
++--------+------+---------------------+
+| size   | next | payload ...         |
++--------+------+---------------------+
+   next is only meaningful while the block is free.
+*/
+
+#include "umalloc.h"
+#include "usyscall.h"
+
+#define SYS_BRK 33
+#define SYS_MMAP 34
+#define SYS_MUNMAP 35
+#define UMALLOC_ALIGN 8 // payloads are 8 byte aligned
+#define UMALLOC_PAGE 0x1000 // the heap grows by whole pages
+#define UMALLOC_MMAP_THRESHOLD 0x10000 // blocks of 64kb and up are mapped on their own
+#define BLOCK_MMAP 0x1 // low bit of size, the block is a mapping of its own
+
+#define ALIGN_UP(x, a) \
+    (((x) + (a) - 1) & ~((a) - 1))
+
+typedef struct block_t {
+    uint32_t size; // size of the block including this header
+    struct block_t* next; // next free block by address
+} block_t;
+
+static block_t* free_list; // free blocks past the program break, sorted by address
+
+/* brk
+   description: set the program break
+   input: addr - new program break
+   output: none
+   return value: 0 if success; -1 if the break can not be moved there
+   side effect: none
+*/
+int32_t brk(void* addr) {
+    return (do_syscall(SYS_BRK, (uint32_t)addr, 0, 0) == -1) ? -1 : 0;
+}
+
+
+/* sbrk
+   description: move the program break by an increment
+   input: increment - number of bytes to grow (or shrink if negative) the break by
+   output: none
+   return value: the previous program break, which is the start of the new memory; (void* )-1 if out of memory
+   side effect: none
+*/
+void* sbrk(int32_t increment) {
+    int32_t cur = do_syscall(SYS_BRK, 0, 0, 0);
+    if (increment != 0 && do_syscall(SYS_BRK, cur + increment, 0, 0) == -1)
+        return (void* )-1;
+    return (void* )cur;
+}
+
+
+/* mmap
+   description: map an anonymous, zero-filled region
+   input: length - length of the region in bytes
+   output: none
+   return value: starting address of the region; NULL if out of address space
+   side effect: none
+*/
+void* mmap(uint32_t length) {
+    int32_t addr = do_syscall(SYS_MMAP, length, 0, 0);
+    return (addr == -1) ? NULL : (void* )addr;
+}
+
+
+/* munmap
+   description: unmap an anonymous region
+   input: addr - starting address of the region
+          length - length of the region in bytes
+   output: none
+   return value: 0 if success; -1 if the range is invalid
+   side effect: none
+*/
+int32_t munmap(void* addr, uint32_t length) {
+    return do_syscall(SYS_MUNMAP, (uint32_t)addr, length, 0);
+}
+
+
+/* free_list_insert
+   description: put a block back on the free list, merging it with free neighbours
+   input: blk - block to insert
+   output: none
+   return value: none
+   side effect: none
+*/
+static void free_list_insert(block_t* blk) {
+    block_t* prev = NULL, * cur = free_list;
+    while (cur != NULL && cur < blk) {
+        prev = cur;
+        cur = cur->next;
+    }
+
+    blk->next = cur;
+    if (cur != NULL && (uint8_t* )blk + blk->size == (uint8_t* )cur) { // merge with the block after
+        blk->size += cur->size;
+        blk->next = cur->next;
+    }
+    if (prev == NULL)
+        free_list = blk;
+    else if ((uint8_t* )prev + prev->size == (uint8_t* )blk) { // merge with the block before
+        prev->size += blk->size;
+        prev->next = blk->next;
+    }
+    else
+        prev->next = blk;
+}
+
+
+/* umalloc
+   description: allocate memory
+   input: size - number of bytes to allocate
+   output: none
+   return value: pointer to the memory; NULL if size is 0 or out of memory
+   side effect: may move the program break
+*/
+void* umalloc(uint32_t size) {
+    block_t* blk, ** link;
+    block_t* rest;
+    uint32_t need, grow;
+    if (size == 0 || size > UINT32_MAX - sizeof(block_t) - UMALLOC_PAGE)
+        return NULL;
+    need = ALIGN_UP(size + sizeof(block_t), UMALLOC_ALIGN);
+
+    /* large blocks are not worth keeping around after they are freed */
+    if (need >= UMALLOC_MMAP_THRESHOLD) {
+        if ((blk = (block_t* )mmap(need)) == NULL)
+            return NULL;
+        blk->size = need | BLOCK_MMAP;
+        return blk + 1;
+    }
+
+    while (1) {
+        /* first fit; a block with enough room left over is split and its front is handed out */
+        for (link = &free_list; *link != NULL; link = &((*link)->next)) {
+            blk = *link;
+            if (blk->size < need)
+                continue;
+            if (blk->size - need >= sizeof(block_t) + UMALLOC_ALIGN) {
+                rest = (block_t* )((uint8_t* )blk + need);
+                rest->size = blk->size - need;
+                rest->next = blk->next;
+                *link = rest;
+                blk->size = need;
+            }
+            else
+                *link = blk->next;
+            return blk + 1;
+        }
+
+        /* nothing fits; growing by whole pages keeps successive chunks adjacent despite the kernel aligning the break */
+        grow = ALIGN_UP(need, UMALLOC_PAGE);
+        if ((blk = (block_t* )sbrk(grow)) == (block_t* )-1)
+            return NULL;
+        blk->size = grow;
+        free_list_insert(blk);
+    }
+}
+
+
+/* ufree
+   description: free memory returned by umalloc
+   input: ptr - pointer to the memory, may be NULL
+   output: none
+   return value: none
+   side effect: none
+*/
+void ufree(void* ptr) {
+    block_t* blk;
+    if (ptr == NULL)
+        return;
+    blk = (block_t* )ptr - 1;
+    if (blk->size & BLOCK_MMAP)
+        munmap(blk, blk->size & ~BLOCK_MMAP);
+    else
+        free_list_insert(blk);
+}
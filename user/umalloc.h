@@ -0,0 +1,19 @@
+/* umalloc.h - user-space memory allocator and memory system call wrappers */
+
+#ifndef _UMALLOC_H
+#define _UMALLOC_H
+#include <stdint.h>
+
+#ifndef NULL
+#define NULL ((void* )0)
+#endif
+
+int32_t brk(void* addr);
+void* sbrk(int32_t increment);
+void* mmap(uint32_t length);
+int32_t munmap(void* addr, uint32_t length);
+
+void* umalloc(uint32_t size);
+void ufree(void* ptr);
+
+#endif
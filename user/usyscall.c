@@ -0,0 +1,68 @@
+/* usyscall.c - system call stub for user programs. The kernel points the sysenter MSRs at its fast entry whenever the
+   cpu has sysenter, so the stub makes the same cpuid test once, then traps with sysenter, or with int 0x80 on cpus
+   without it. Both take the system call number in eax and arguments in ebx, ecx and edx, and return in eax.
+*/
+
+#include "usyscall.h"
+
+#define CPUID_SEP 0x800 // CPUID.1:EDX, sysenter and sysexit
+#define SYSCALL_UNKNOWN 0
+#define SYSCALL_INT80 1
+#define SYSCALL_SYSENTER 2
+
+static int32_t syscall_kind = SYSCALL_UNKNOWN;
+
+/* syscall_probe
+   description: test whether the cpu has sysenter, in the same way the kernel does
+   input: none
+   output: none
+   return value: SYSCALL_SYSENTER or SYSCALL_INT80
+   side effect: none
+*/
+static int32_t syscall_probe(void) {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile ("cpuid\n" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    if (!(edx & CPUID_SEP))
+        return SYSCALL_INT80;
+    if (((eax >> 8) & 0xF) == 6 && ((eax >> 4) & 0xF) < 3 && (eax & 0xF) < 3) // early pentium pro sets the bit without the instructions
+        return SYSCALL_INT80;
+    return SYSCALL_SYSENTER;
+}
+
+
+/* do_syscall
+   description: trap into the kernel. sysexit returns with ecx and edx clobbered, so they are saved with ebp; the
+                kernel takes the return address from the top of the stack ebp points to and returns past it.
+   input: num - system call number
+          arg1, arg2, arg3 - first, second and third argument
+   output: none
+   return value: return value of the system call
+   side effect: none
+*/
+int32_t do_syscall(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    int32_t retval;
+    if (syscall_kind == SYSCALL_UNKNOWN)
+        syscall_kind = syscall_probe();
+    if (syscall_kind == SYSCALL_SYSENTER) {
+        asm volatile ("pushl %%ecx\n"
+            "pushl %%edx\n"
+            "pushl %%ebp\n"
+            "pushl $1f\n"
+            "movl %%esp,%%ebp\n"
+            "sysenter\n"
+            "1:\n"
+            "popl %%ebp\n"
+            "popl %%edx\n"
+            "popl %%ecx\n"
+            : "=a" (retval)
+            : "a" (num), "b" (arg1), "c" (arg2), "d" (arg3)
+            : "memory", "cc");
+    }
+    else {
+        asm volatile ("int $0x80"
+            : "=a" (retval)
+            : "a" (num), "b" (arg1), "c" (arg2), "d" (arg3)
+            : "memory", "cc");
+    }
+    return retval;
+}
@@ -0,0 +1,9 @@
+/* usyscall.h - system call stub for user programs */
+
+#ifndef _USYSCALL_H
+#define _USYSCALL_H
+#include <stdint.h>
+
+int32_t do_syscall(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+#endif